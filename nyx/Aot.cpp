@@ -0,0 +1,167 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Aot.h"
+#include <utility>
+
+Value Aot::call(Runtime* rt,
+                Func* f,
+                ObjectArray args,
+                const BoundFunc* closure) {
+    for (;;) {
+        Value ret = f->compiled(rt, f, closure, args);
+        if (Interpreter::tailCallee == nullptr) {
+            return ret;
+        }
+        f = Interpreter::tailCallee;
+        closure = nullptr;
+        Interpreter::tailCallee = nullptr;
+        args = std::move(Interpreter::tailCallArgs);
+    }
+}
+
+Value Aot::callClosure(Runtime* rt,
+                       ContextChain* ctxChain,
+                       Symbol funcName,
+                       Address addr,
+                       ObjectArray args,
+                       int line,
+                       int column) {
+    Value closure = Interpreter::lookupClosure(ctxChain, addr);
+    if (closure == nullptr) {
+        panic("can not find function %s at line %d, col %d", funcName.c_str(),
+              line, column);
+    }
+    auto* closureFunc = closure.asClosure();
+    if (closureFunc->func->params.size() != args.size()) {
+        argumentsMismatch((int)closureFunc->func->params.size(),
+                          (int)args.size(), line, column);
+    }
+    return Aot::call(rt, closureFunc->func, std::move(args), closureFunc);
+}
+
+void Aot::tailCall(Func* f, ContextChain* funcCtxChain, ObjectArray args) {
+    // Tail calls only appear in named functions without closures, nothing
+    // else refers to their context chains
+    Interpreter::leaveFunc(funcCtxChain);
+    Interpreter::tailCallArgs = std::move(args);
+    Interpreter::tailCallee = f;
+}
+
+Func* Aot::newPrototype(std::vector<Symbol> params,
+                        std::vector<FreeVariable> freeVars,
+                        int frameSize,
+                        std::vector<bool> captured,
+                        CompiledFunc body) {
+    auto* f = new Func;
+    f->params = std::move(params);
+    f->freeVars = std::move(freeVars);
+    f->frameSize = frameSize;
+    f->captured = std::move(captured);
+    f->compiled = body;
+    return f;
+}
+
+Value Aot::newClosure(Runtime* rt, ContextChain* ctxChain, Func* f) {
+    return Interpreter::newClosure(rt, f, ctxChain);
+}
+
+ContextChain* Aot::enter(Runtime* rt,
+                         Func* f,
+                         const BoundFunc* closure,
+                         const ObjectArray& args) {
+    ContextChain* funcCtxChain = Interpreter::enterFunc(f, closure);
+    for (int i = 0; i < (int)f->params.size(); i++) {
+        Interpreter::bindArgument(rt, funcCtxChain, i, args[i]);
+    }
+    return funcCtxChain;
+}
+
+Value Aot::leave(ContextChain* funcCtxChain, Value ret) {
+    Interpreter::leaveFunc(funcCtxChain);
+    return ret;
+}
+
+Value Aot::lookupName(Runtime* rt,
+                      ContextChain* ctxChain,
+                      Symbol identName,
+                      Address addr,
+                      int line,
+                      int column) {
+    return Interpreter::lookupName(rt, ctxChain, identName, addr, line, column);
+}
+
+Variable* Aot::lookupArray(ContextChain* ctxChain,
+                           Symbol identName,
+                           Address addr,
+                           int line,
+                           int column) {
+    auto* var = Interpreter::lookupVariable(ctxChain, addr);
+    if (var == nullptr) {
+        panic(
+            "use of undefined variable \"%s\" at line %d, col "
+            "%d\n",
+            identName.c_str(), line, column);
+    }
+    return var;
+}
+
+void Aot::assign(ContextChain* ctxChain, Address addr, Token opt, Value rhs) {
+    Interpreter::assignVariable(ctxChain, addr, opt, rhs);
+}
+
+Value Aot::length(Runtime* rt, Value receiver) {
+    if (receiver.isArray()) {
+        return rt->newObject((int)(receiver.asArray().size()));
+    } else if (receiver.isString()) {
+        return rt->newObject((int)(receiver.asString().length()));
+    }
+    return nullptr;
+}
+
+bool Aot::condition(Value cond, int line, int column) {
+    if (!cond.isBool()) {
+        panic(
+            "expects bool type in while condition at line %d, "
+            "col %d\n",
+            line, column);
+    }
+    return cond.asBool();
+}
+
+ObjectArray Aot::elements(Value list, int line, int column) {
+    if (!list.isArray()) {
+        panic(
+            "expects array type within foreach statement at line "
+            "%d, col %d\n",
+            line, column);
+    }
+    return list.asArray();
+}
+
+void Aot::argumentsMismatch(int expected, int actual, int line, int column) {
+    panic(
+        "expects %d arguments but got %d at line %d, "
+        "col %d\n",
+        expected, actual, line, column);
+}
@@ -0,0 +1,125 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_AOT_H
+#define NYX_AOT_H
+
+#include <string>
+#include <vector>
+#include "Builtin.h"
+#include "Interpreter.h"
+#include "Object.hpp"
+#include "Runtime.hpp"
+#include "Utils.hpp"
+
+// Thrown by statically typed code once its assumptions fail, the call is then
+// executed again by dynamically typed code of the same function
+struct Bailout {};
+
+//===----------------------------------------------------------------------===//
+// Runtime support of programs compiled by nyxc. Generated code keeps variables
+// in context chains and calls into these helpers wherever types are unknown,
+// so that it behaves exactly the same as interpreter does
+//===----------------------------------------------------------------------===//
+class Aot {
+public:
+    // Call compiled function with evaluated arguments, tail calls it returns
+    // to run in its place
+    static Value call(Runtime* rt,
+                      Func* f,
+                      ObjectArray args,
+                      const BoundFunc* closure = nullptr);
+
+    // Call closure variable funcName, panic if there is no such one
+    static Value callClosure(Runtime* rt,
+                             ContextChain* ctxChain,
+                             Symbol funcName,
+                             Address addr,
+                             ObjectArray args,
+                             int line,
+                             int column);
+
+    // Schedule a tail call to named function f and leave current frame
+    static void tailCall(Func* f,
+                         ContextChain* funcCtxChain,
+                         ObjectArray args);
+
+    // Function shared by all closures that a closure expression creates
+    static Func* newPrototype(std::vector<Symbol> params,
+                              std::vector<FreeVariable> freeVars,
+                              int frameSize,
+                              std::vector<bool> captured,
+                              CompiledFunc body);
+
+    static Value newClosure(Runtime* rt, ContextChain* ctxChain, Func* f);
+
+    // Create context chain of function f and bind arguments to it, closures
+    // see variables they captured as well
+    static ContextChain* enter(Runtime* rt,
+                               Func* f,
+                               const BoundFunc* closure,
+                               const ObjectArray& args);
+
+    // Leave context chain of current function, which returns ret
+    static Value leave(ContextChain* funcCtxChain, Value ret);
+
+    static Value lookupName(Runtime* rt,
+                            ContextChain* ctxChain,
+                            Symbol identName,
+                            Address addr,
+                            int line,
+                            int column);
+
+    static Variable* lookupArray(ContextChain* ctxChain,
+                                 Symbol identName,
+                                 Address addr,
+                                 int line,
+                                 int column);
+
+    static void assign(ContextChain* ctxChain,
+                       Address addr,
+                       Token opt,
+                       Value rhs);
+
+    // Length of string or array receiver, or null if it's neither of them
+    static Value length(Runtime* rt, Value receiver);
+
+    static bool condition(Value cond, int line, int column);
+
+    static ObjectArray elements(Value list, int line, int column);
+
+    static Value binary(Value lhs, Token opt, Value rhs) {
+        // Operator is unary if only right hand side operand is null
+        if (!lhs.isNull() && rhs.isNull()) {
+            return Interpreter::evalUnaryExpr(lhs, opt);
+        }
+        return Interpreter::evalBinaryExpr(lhs, opt, rhs);
+    }
+
+    [[noreturn]] static void argumentsMismatch(int expected,
+                                               int actual,
+                                               int line,
+                                               int column);
+};
+
+#endif  // NYX_AOT_H
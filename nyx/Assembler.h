@@ -0,0 +1,300 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_ASSEMBLER_H
+#define NYX_ASSEMBLER_H
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define NYX_JIT_SUPPORTED 1
+#else
+#define NYX_JIT_SUPPORTED 0
+#endif
+
+enum Reg {
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+};
+
+// Condition codes of jcc and setcc, unsigned ones are for comparing doubles
+enum Cond {
+    CondB = 0x2,
+    CondAE = 0x3,
+    CondE = 0x4,
+    CondNE = 0x5,
+    CondA = 0x7,
+    CondP = 0xa,
+    CondNP = 0xb,
+    CondL = 0xc,
+    CondGE = 0xd,
+    CondLE = 0xe,
+    CondG = 0xf,
+};
+
+//===----------------------------------------------------------------------===//
+// Emit x86-64 instructions that JIT compilers need. Values are computed in rax
+// (eax for int and bool values), rcx holds the second operand while xmm0 and
+// xmm1 are used for double arithmetic
+//===----------------------------------------------------------------------===//
+class Assembler {
+public:
+    using Label = int;
+
+    Label newLabel() {
+        labels.push_back(-1);
+        return (Label)labels.size() - 1;
+    }
+
+    void bind(Label label) { labels[label] = (int)code.size(); }
+
+    // push rbp; mov rbp, rsp; sub rsp, imm32 where frame size is set later
+    void prologue() {
+        emit(0x55);
+        emit(0x48, 0x89, 0xe5);
+        emit(0x48, 0x81, 0xec);
+        frameSizeAt = (int)code.size();
+        emit32(0);
+    }
+
+    void setFrameSize(int size) {
+        size = (size + 15) & ~15;
+        memcpy(&code[frameSizeAt], &size, sizeof(int));
+    }
+
+    void leave() { emit(0xc9); }
+    void ret() { emit(0xc3); }
+
+    void push(Reg reg) {
+        if (reg >= R8) {
+            emit(0x41);
+        }
+        emit(0x50 + (reg & 7));
+    }
+
+    void pop(Reg reg) {
+        if (reg >= R8) {
+            emit(0x41);
+        }
+        emit(0x58 + (reg & 7));
+    }
+
+    // mov dst, src of 64 bits
+    void mov(Reg dst, Reg src) {
+        emit(0x48 | (src >= R8 ? 4 : 0) | (dst >= R8 ? 1 : 0), 0x89,
+             0xc0 | ((src & 7) << 3) | (dst & 7));
+    }
+
+    // mov dword [base + disp], reg
+    void store32(Reg base, int disp, Reg reg) {
+        memoryOperand(false, 0x89, base, disp, reg);
+    }
+
+    // mov reg, dword [base + disp]
+    void load32(Reg reg, Reg base, int disp) {
+        memoryOperand(false, 0x8b, base, disp, reg);
+    }
+
+    // mov qword [base + disp], reg
+    void store64(Reg base, int disp, Reg reg) {
+        memoryOperand(true, 0x89, base, disp, reg);
+    }
+
+    // mov reg, qword [base + disp]
+    void load64(Reg reg, Reg base, int disp) {
+        memoryOperand(true, 0x8b, base, disp, reg);
+    }
+
+    // inc qword [base + disp]
+    void inc64(Reg base, int disp) {
+        memoryOperand(true, 0xff, base, disp, RAX);
+    }
+
+    // lea rsp, [rbp + disp]
+    void restoreStack(int disp) { memoryOperand(true, 0x8d, RBP, disp, RSP); }
+
+    void loadImm(int32_t value) {
+        emit(0xb8);  // mov eax, imm32
+        emit32(value);
+    }
+
+    void loadImm64(int64_t value) {
+        emit(0x48, 0xb8);  // mov rax, imm64
+        emit64(value);
+    }
+
+    void movEdxImm(int32_t value) {
+        emit(0xba);  // mov edx, imm32
+        emit32(value);
+    }
+
+    void zeroEdx() { emit(0x31, 0xd2); }     // xor edx, edx
+    void movEaxEdx() { emit(0x89, 0xd0); }   // mov eax, edx
+    void add() { emit(0x01, 0xc8); }         // add eax, ecx
+    void sub() { emit(0x29, 0xc8); }         // sub eax, ecx
+    void imul() { emit(0x0f, 0xaf, 0xc1); }  // imul eax, ecx
+    void andOp() { emit(0x21, 0xc8); }       // and eax, ecx
+    void orOp() { emit(0x09, 0xc8); }        // or eax, ecx
+    void neg() { emit(0xf7, 0xd8); }         // neg eax
+    void xorOne() { emit(0x83, 0xf0, 0x01); }  // xor eax, 1
+    void flipSign() { emit(0x48, 0x0f, 0xba, 0xf8, 0x3f); }  // btc rax, 63
+
+    // Divide eax by ecx, quotient is left in eax and remainder in edx
+    void idiv(Label zeroDivisor) {
+        emit(0x85, 0xc9);  // test ecx, ecx
+        jump(zeroDivisor, CondE);
+        emit(0x99);        // cdq
+        emit(0xf7, 0xf9);  // idiv ecx
+    }
+
+    // Compare eax with ecx and set eax to 0 or 1
+    void compare(Cond cond) {
+        emit(0x39, 0xc8);  // cmp eax, ecx
+        setcc(cond);
+    }
+
+    // Compare xmm0 with xmm1, or xmm1 with xmm0 if swapped, and set eax to 0 or
+    // 1. Unordered operands compare unequal to anything
+    void compareDouble(Cond cond, bool swapped) {
+        emit(0x66, 0x0f, 0x2e, swapped ? 0xc8 : 0xc1);  // ucomisd
+        if (cond == CondE || cond == CondNE) {
+            emit(0x0f, 0x90 | cond, 0xc0);  // setcc al
+            emit(0x0f, 0x90 | (cond == CondE ? CondNP : CondP), 0xc1);
+            emit(cond == CondE ? 0x20 : 0x08, 0xc8);  // and/or al, cl
+            emit(0x0f, 0xb6, 0xc0);                   // movzx eax, al
+            return;
+        }
+        setcc(cond);
+    }
+
+    // Move operands to xmm0 and xmm1, converting int operands to double
+    void toDouble(bool lhsIsInt, bool rhsIsInt) {
+        if (lhsIsInt) {
+            emit(0xf2, 0x0f, 0x2a, 0xc0);  // cvtsi2sd xmm0, eax
+        } else {
+            emit(0x66, 0x48, 0x0f, 0x6e, 0xc0);  // movq xmm0, rax
+        }
+        if (rhsIsInt) {
+            emit(0xf2, 0x0f, 0x2a, 0xc9);  // cvtsi2sd xmm1, ecx
+        } else {
+            emit(0x66, 0x48, 0x0f, 0x6e, 0xc9);  // movq xmm1, rcx
+        }
+    }
+
+    // Apply addsd, subsd, mulsd or divsd to xmm0 and xmm1, result goes to rax
+    void doubleOp(uint8_t opcode) {
+        emit(0xf2, 0x0f, opcode, 0xc1);
+        emit(0x66, 0x48, 0x0f, 0x7e, 0xc0);  // movq rax, xmm0
+    }
+
+    void testEax() { emit(0x85, 0xc0); }
+    void testRdx() { emit(0x48, 0x85, 0xd2); }
+
+    void jump(Label target) {
+        emit(0xe9);
+        fixup(target);
+    }
+
+    void jump(Label target, Cond cond) {
+        emit(0x0f, 0x80 | cond);
+        fixup(target);
+    }
+
+    void call(Label target) {
+        emit(0xe8);
+        fixup(target);
+    }
+
+    void call(void* target) {
+        loadImm64((int64_t)target);
+        emit(0xff, 0xd0);  // call rax
+    }
+
+    // Copy code into executable memory once all labels are bound
+    void* finalize();
+
+private:
+    template <typename... Bytes>
+    void emit(Bytes... bytes) {
+        (code.push_back((uint8_t)bytes), ...);
+    }
+
+    void emit32(int32_t value) {
+        for (int i = 0; i < 4; i++) {
+            emit((uint8_t)(value >> (i * 8)));
+        }
+    }
+
+    void emit64(int64_t value) {
+        for (int i = 0; i < 8; i++) {
+            emit((uint8_t)(value >> (i * 8)));
+        }
+    }
+
+    void setcc(Cond cond) {
+        emit(0x0f, 0x90 | cond, 0xc0);  // setcc al
+        emit(0x0f, 0xb6, 0xc0);         // movzx eax, al
+    }
+
+    void memoryOperand(bool wide, uint8_t opcode, Reg base, int disp, Reg reg) {
+        uint8_t rex = (wide ? 0x48 : 0x40) | (reg >= R8 ? 4 : 0) |
+                      (base >= R8 ? 1 : 0);
+        if (rex != 0x40) {
+            emit(rex);
+        }
+        emit(opcode, 0x80 | ((reg & 7) << 3) | (base & 7));  // [base + disp32]
+        if ((base & 7) == RSP) {
+            emit(0x24);  // SIB byte
+        }
+        emit32(disp);
+    }
+
+    void fixup(Label target) {
+        fixups.emplace_back((int)code.size(), target);
+        emit32(0);
+    }
+
+    std::vector<uint8_t> code;
+    std::vector<int> labels;
+    std::vector<std::pair<int, Label>> fixups;
+    int frameSizeAt{};
+};
+
+#endif  // NYX_ASSEMBLER_H
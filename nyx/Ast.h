@@ -97,6 +97,7 @@ struct Statement;
 struct AstNode;
 
 struct AstVisitor;
+struct LoopTrace;
 struct BoolExpr;
 struct CharExpr;
 struct NullExpr;
@@ -110,6 +111,8 @@ struct BinaryExpr;
 struct FunCallExpr;
 struct AssignExpr;
 struct ClosureExpr;
+struct FusedExpr;
+struct InlinedCallExpr;
 struct Statement;
 struct BreakStmt;
 struct ContinueStmt;
@@ -136,6 +139,10 @@ struct AstVisitor {
     virtual void visitFunCallExpr(FunCallExpr* node) {}
     virtual void visitAssignExpr(AssignExpr* node) {}
     virtual void visitClosureExpr(ClosureExpr* node) {}
+    // Fused nodes are seen as the nodes they replace unless it's overridden
+    virtual void visitFusedExpr(FusedExpr* node);
+    // Inlined calls are seen as the calls they replace unless it's overridden
+    virtual void visitInlinedCallExpr(InlinedCallExpr* node);
     virtual void visitStatement(Statement* node) {}
     virtual void visitBreakStmt(BreakStmt* node) {}
     virtual void visitContinueStmt(ContinueStmt* node) {}
@@ -166,7 +173,7 @@ struct Expression : public AstNode {
     using AstNode::AstNode;
 
     ~Expression() override = default;
-    virtual Object* eval(Runtime* rt, ContextChain* ctxChain);
+    virtual Value eval(Runtime* rt, ContextChain* ctxChain);
 
     void visit(AstVisitor* visitor) override { visitor->visitExpression(this); }
 };
@@ -176,7 +183,7 @@ struct BoolExpr : public Expression {
 
     bool literal;
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
 
     void visit(AstVisitor* visitor) override { visitor->visitBoolExpr(this); }
 };
@@ -186,7 +193,7 @@ struct CharExpr : public Expression {
 
     char literal;
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
 
     void visit(AstVisitor* visitor) override { visitor->visitCharExpr(this); }
 };
@@ -194,7 +201,9 @@ struct CharExpr : public Expression {
 struct NullExpr : public Expression {
     using Expression::Expression;
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
+
+    void visit(AstVisitor* visitor) override { visitor->visitNullExpr(this); }
 };
 
 struct IntExpr : public Expression {
@@ -202,7 +211,7 @@ struct IntExpr : public Expression {
 
     int literal;
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
 
     void visit(AstVisitor* visitor) override { visitor->visitIntExpr(this); }
 };
@@ -212,7 +221,7 @@ struct DoubleExpr : public Expression {
 
     double literal;
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
 
     void visit(AstVisitor* visitor) override { visitor->visitDoubleExpr(this); }
 };
@@ -220,9 +229,10 @@ struct DoubleExpr : public Expression {
 struct StringExpr : public Expression {
     using Expression::Expression;
 
-    std::string literal;
+    // Shared by every string the literal evaluates to
+    ObjectString literal;
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
     void visit(AstVisitor* visitor) override { visitor->visitStringExpr(this); }
 };
 
@@ -231,26 +241,29 @@ struct ArrayExpr : public Expression {
 
     std::vector<Expression*> literal;
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
     void visit(AstVisitor* visitor) override { visitor->visitArrayExpr(this); }
 };
 
 struct NameExpr : public Expression {
     using Expression::Expression;
 
-    std::string identName;
+    Symbol identName;
+    // Unresolved if it names a function rather than a variable
+    Address addr;
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
     void visit(AstVisitor* visitor) override { visitor->visitNameExpr(this); }
 };
 
 struct IndexExpr : public Expression {
     using Expression::Expression;
 
-    std::string identName;
+    Symbol identName;
+    Address addr;
     Expression* index{};
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
     void visit(AstVisitor* visitor) override { visitor->visitIndexExpr(this); }
 };
 
@@ -260,20 +273,50 @@ struct BinaryExpr : public Expression {
     Expression* lhs{};
     Token opt{};
     Expression* rhs{};
+    // Where parent node holds this expression. It rewrites itself into a node
+    // specialized for operand types seen at its first evaluation unless it was
+    // found to be generic
+    Expression** slot{};
+    bool generic{};
+
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value compute(Value lhsObject, Value rhsObject) const;
 
     void visit(AstVisitor* visitor) override { visitor->visitBinaryExpr(this); }
 };
 
+// Node that replaces a BinaryExpr, it looks like the original one to all AST
+// visitors and puts it back once operands of unexpected types are seen
+struct SpecializedBinaryExpr : public Expression {
+    explicit SpecializedBinaryExpr(BinaryExpr* original)
+        : Expression(original->line, original->column), original(original) {}
+
+    Value despecialize(Value lhsObject, Value rhsObject);
+
+    void visit(AstVisitor* visitor) override { original->visit(visitor); }
+
+    BinaryExpr* original;
+};
+
+template <typename Operand, typename Operation>
+struct TypedBinaryExpr : public SpecializedBinaryExpr {
+    using SpecializedBinaryExpr::SpecializedBinaryExpr;
+
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
+};
+
 struct FunCallExpr : public Expression {
     using Expression::Expression;
 
     Expression* receiver{};
-    std::string funcName;
+    Symbol funcName;
     std::vector<Expression*> args;
+    CallCache cache;
+    // Closure variable it calls unless callee is builtin or named function
+    Address addr;
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
     void visit(AstVisitor* visitor) override {
         visitor->visitFunCallExpr(this);
     }
@@ -286,22 +329,141 @@ struct AssignExpr : public Expression {
     Token opt;
     Expression* rhs{};
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
     void visit(AstVisitor* visitor) override { visitor->visitAssignExpr(this); }
 };
 
 struct ClosureExpr : public Expression {
     using Expression::Expression;
 
-    std::vector<std::string> params;
+    std::vector<Symbol> params;
     Block* block{};
+    // Function shared by all closures it creates, see ClosureConverter
+    Func* func{};
 
-    Object* eval(Runtime* rt, ContextChain* ctxChain) override;
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
     void visit(AstVisitor* visitor) override {
         visitor->visitClosureExpr(this);
     }
 };
 
+// Call of a small named function whose body was copied into the call site by
+// Inliner, with parameters and local variables renamed so that they never
+// capture variables of the caller
+struct InlinedCallExpr : public Expression {
+    explicit InlinedCallExpr(FunCallExpr* call,
+                             std::vector<Symbol> params,
+                             Block* block)
+        : Expression(call->line, call->column),
+          call(call),
+          params(std::move(params)),
+          block(block) {}
+
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
+
+    void visit(AstVisitor* visitor) override {
+        visitor->visitInlinedCallExpr(this);
+    }
+
+    FunCallExpr* call;
+    std::vector<Symbol> params;
+    Block* block;
+};
+
+inline void AstVisitor::visitInlinedCallExpr(InlinedCallExpr* node) {
+    node->call->visit(this);
+}
+
+//===----------------------------------------------------------------------===//
+// Nodes that replace common idioms found by SuperinstructionFuser, each of them
+// performs the whole idiom at once. They fall back to the original nodes once
+// operands of unexpected types are seen
+//===----------------------------------------------------------------------===//
+struct FusedExpr : public Expression {
+    explicit FusedExpr(Expression* original, const char* idiom)
+        : Expression(original->line, original->column),
+          original(original),
+          idiom(idiom) {}
+
+    void visit(AstVisitor* visitor) override { visitor->visitFusedExpr(this); }
+
+    Expression* original;
+    const char* idiom;
+};
+
+inline void AstVisitor::visitFusedExpr(FusedExpr* node) {
+    node->original->visit(this);
+}
+
+// i += 1, i -= 1
+struct IncrementExpr : public FusedExpr {
+    explicit IncrementExpr(AssignExpr* assign, int delta)
+        : FusedExpr(assign, "increment"), assign(assign), delta(delta) {}
+
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
+
+    AssignExpr* assign;
+    int delta;
+    // Value of assignment expression, that is, its rhs literal
+    Value literal{};
+};
+
+// i < n, i == 0, comparisons between int variables and literals
+struct CompareExpr : public FusedExpr {
+    explicit CompareExpr(BinaryExpr* binary)
+        : FusedExpr(binary, "compare"), binary(binary) {}
+
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
+
+    BinaryExpr* binary;
+};
+
+// x == "literal", x != 'c', equality between variables and other literals
+struct EqualsLiteralExpr : public FusedExpr {
+    explicit EqualsLiteralExpr(BinaryExpr* binary)
+        : FusedExpr(binary, "equals_literal"), binary(binary) {}
+
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
+
+    BinaryExpr* binary;
+    Value literal{};
+};
+
+// a[i] < a[j], a[i] + b[0], binary operations between array elements
+struct IndexBinaryExpr : public FusedExpr {
+    explicit IndexBinaryExpr(BinaryExpr* binary)
+        : FusedExpr(binary, "index_binary"), binary(binary) {}
+
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
+
+    // Element of array, or nullptr if it's left to the original node
+    Value element(IndexExpr* node, ContextChain* ctxChain);
+
+    BinaryExpr* binary;
+};
+
+// s = s + expr
+struct AppendExpr : public FusedExpr {
+    explicit AppendExpr(AssignExpr* assign, BinaryExpr* concat)
+        : FusedExpr(assign, "append"), assign(assign), concat(concat) {}
+
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
+
+    AssignExpr* assign;
+    // It's held here since rhs of assign might be quickened later
+    BinaryExpr* concat;
+};
+
+// Literal case of match statement, which is compared with the matched value
+struct CaseLiteralExpr : public FusedExpr {
+    explicit CaseLiteralExpr(Expression* literal)
+        : FusedExpr(literal, "case_literal") {}
+
+    Value eval(Runtime* rt, ContextChain* ctxChain) override;
+
+    Value value{};
+};
+
 //===----------------------------------------------------------------------===//
 // Statement
 //===----------------------------------------------------------------------===//
@@ -343,6 +505,9 @@ struct ReturnStmt : public Statement {
     using Statement::Statement;
 
     Expression* ret{};
+    // Set if it returns result of calling a named function, which is then
+    // called within frame of its caller rather than on top of it
+    FunCallExpr* tailCall{};
 
     ExecResult interpret(Runtime* rt, ContextChain* ctxChain) override;
     void visit(AstVisitor* visitor) override { visitor->visitReturnStmt(this); }
@@ -364,6 +529,9 @@ struct WhileStmt : public Statement {
 
     Expression* cond{};
     Block* block{};
+    // Times its back-edge was taken and the native trace once it's hot
+    int backEdges{};
+    LoopTrace* trace{};
 
     ExecResult interpret(Runtime* rt, ContextChain* ctxChain) override;
     void visit(AstVisitor* visitor) override { visitor->visitWhileStmt(this); }
@@ -376,6 +544,9 @@ struct ForStmt : public Statement {
     Expression* cond{};
     Expression* post{};
     Block* block{};
+    // Times its back-edge was taken and the native trace once it's hot
+    int backEdges{};
+    LoopTrace* trace{};
 
     ExecResult interpret(Runtime* rt, ContextChain* ctxChain) override;
     void visit(AstVisitor* visitor) override { visitor->visitForStmt(this); }
@@ -384,7 +555,8 @@ struct ForStmt : public Statement {
 struct ForEachStmt : public Statement {
     using Statement::Statement;
 
-    std::string identName;
+    Symbol identName;
+    Address addr;
     Expression* list{};
     Block* block{};
 
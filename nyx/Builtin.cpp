@@ -29,21 +29,29 @@
 #include "Runtime.hpp"
 #include "Utils.hpp"
 
-Object* nyx_builtin_print(Runtime* rt,
-                          ContextChain* ctxChain,
-                          ObjectArray args) {
+// Strings are written as they are rather than copied by toString()
+static void printValue(Value arg) {
+    if (arg.isString()) {
+        std::cout << arg.asString();
+    } else {
+        std::cout << arg.toString();
+    }
+}
+
+Value nyx_builtin_print(Runtime* rt, ContextChain* ctxChain, ObjectArray args) {
     for (auto arg : args) {
-        std::cout << arg->toString();
+        printValue(arg);
     }
     return rt->newObject((int)args.size());
 }
 
-Object* nyx_builtin_println(Runtime* rt,
-                            ContextChain* ctxChain,
-                            ObjectArray args) {
+Value nyx_builtin_println(Runtime* rt,
+                          ContextChain* ctxChain,
+                          ObjectArray args) {
     if (!args.empty()) {
         for (auto arg : args) {
-            std::cout << arg->toString() << "\n";
+            printValue(arg);
+            std::cout << "\n";
         }
     } else {
         std::cout << "\n";
@@ -52,9 +60,7 @@ Object* nyx_builtin_println(Runtime* rt,
     return rt->newObject((int)args.size());
 }
 
-Object* nyx_builtin_input(Runtime* rt,
-                          ContextChain* ctxChain,
-                          ObjectArray args) {
+Value nyx_builtin_input(Runtime* rt, ContextChain* ctxChain, ObjectArray args) {
     checkArgsCount(0, &args);
 
     std::string str;
@@ -62,23 +68,23 @@ Object* nyx_builtin_input(Runtime* rt,
     return rt->newObject(str);
 }
 
-Object* nyx_builtin_typeof(Runtime* rt,
-                           ContextChain* ctxChain,
-                           ObjectArray args) {
+Value nyx_builtin_typeof(Runtime* rt,
+                         ContextChain* ctxChain,
+                         ObjectArray args) {
     checkArgsCount(1, &args);
-    return rt->newObject(type2String(args[0]->getType()));
+    return rt->newObject(type2String(args[0].getType()));
 }
 
-Object* nyx_builtin_length(Runtime* rt,
-                           ContextChain* ctxChain,
-                           ObjectArray args) {
+Value nyx_builtin_length(Runtime* rt,
+                         ContextChain* ctxChain,
+                         ObjectArray args) {
     checkArgsCount(1, &args);
 
-    if (args[0]->isString()) {
-        return rt->newObject((int)args[0]->asString().length());
+    if (args[0].isString()) {
+        return rt->newObject((int)args[0].asString().length());
     }
-    if (args[0]->isArray()) {
-        return rt->newObject((int)args[0]->asArray().size());
+    if (args[0].isArray()) {
+        return rt->newObject((int)args[0].asArray().size());
     }
 
     panic(
@@ -88,40 +94,38 @@ Object* nyx_builtin_length(Runtime* rt,
         __func__);
 }
 
-Object* nyx_builtin_to_int(Runtime* rt,
-                           ContextChain* ctxChain,
-                           ObjectArray args) {
+Value nyx_builtin_to_int(Runtime* rt,
+                         ContextChain* ctxChain,
+                         ObjectArray args) {
     checkArgsCount(1, &args);
     checkArgsType(0, &args, Double);
 
-    return rt->newObject((int)args[0]->asDouble());
+    return rt->newObject((int)args[0].asDouble());
 }
 
-Object* nyx_builtin_to_double(Runtime* rt,
-                              ContextChain* ctxChain,
-                              ObjectArray args) {
+Value nyx_builtin_to_double(Runtime* rt,
+                            ContextChain* ctxChain,
+                            ObjectArray args) {
     checkArgsCount(1, &args);
     checkArgsType(0, &args, Int);
 
-    return rt->newObject((double)args[0]->asInt());
+    return rt->newObject((double)args[0].asInt());
 }
 
-Object* nyx_builtin_range(Runtime* rt,
-                          ContextChain* ctxChain,
-                          ObjectArray args) {
+Value nyx_builtin_range(Runtime* rt, ContextChain* ctxChain, ObjectArray args) {
     checkArgsCount(1, &args);
 
     ObjectArray vals;
-    if (args[0]->asInt() <= 0) {
+    if (args[0].asInt() <= 0) {
         return rt->newObject(vals);
     }
     int start = 0, stop = 0;
     if (args.size() == 1) {
         start = 0;
-        stop = args[0]->asInt();
+        stop = args[0].asInt();
     } else {
-        start = args[0]->asInt();
-        stop = args[1]->asInt();
+        start = args[0].asInt();
+        stop = args[1].asInt();
     }
     for (; start < stop; start++) {
         vals.push_back(rt->newObject(start));
@@ -129,13 +133,13 @@ Object* nyx_builtin_range(Runtime* rt,
     return rt->newObject(vals);
 }
 
-Object* nyx_builtin_assert(Runtime* rt,
-                           ContextChain* ctxChain,
-                           ObjectArray args) {
+Value nyx_builtin_assert(Runtime* rt,
+                         ContextChain* ctxChain,
+                         ObjectArray args) {
     checkArgsType(0, &args, Bool);
-    if (!args[0]->asBool()) {
+    if (!args[0].asBool()) {
         if (args.size() == 2) {
-            std::cerr << "AssertionFailure: " << args[1]->asString()
+            std::cerr << "AssertionFailure: " << args[1].asString()
                       << std::endl;
         } else {
             std::cerr << "AssertionFailure" << std::endl;
@@ -146,17 +150,17 @@ Object* nyx_builtin_assert(Runtime* rt,
     return rt->newObject();
 }
 
-Object* nyx_builtin_dump_ast(Runtime* rt,
-                             ContextChain* ctxChain,
-                             ObjectArray args) {
+Value nyx_builtin_dump_ast(Runtime* rt,
+                           ContextChain* ctxChain,
+                           ObjectArray args) {
     checkArgsCount(1, &args);
     checkArgsType(0, &args, Closure);
-    auto func = args[0]->asClosure();
+    Func* func = args[0].asClosure()->func;
 
-    std::cout << "-Func[" << func.name << "]" << std::endl;
+    std::cout << "-Func[" << func->name << "]" << std::endl;
     AstDumper d(2);
-    if (func.block != nullptr) {
-        for (const auto& item : func.block->stmts) {
+    if (func->block != nullptr) {
+        for (const auto& item : func->block->stmts) {
             item->visit(&d);
         }
     }
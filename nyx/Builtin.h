@@ -27,42 +27,28 @@
 #include "Object.hpp"
 #include "Runtime.hpp"
 
-Object* nyx_builtin_print(Runtime* rt,
+Value nyx_builtin_print(Runtime* rt, ContextChain* ctxChain, ObjectArray args);
+
+Value nyx_builtin_println(Runtime* rt,
                           ContextChain* ctxChain,
                           ObjectArray args);
 
-Object* nyx_builtin_println(Runtime* rt,
-                            ContextChain* ctxChain,
-                            ObjectArray args);
+Value nyx_builtin_input(Runtime* rt, ContextChain* ctxChain, ObjectArray args);
 
-Object* nyx_builtin_input(Runtime* rt,
-                          ContextChain* ctxChain,
-                          ObjectArray args);
+Value nyx_builtin_typeof(Runtime* rt, ContextChain* ctxChain, ObjectArray args);
 
-Object* nyx_builtin_typeof(Runtime* rt,
-                           ContextChain* ctxChain,
-                           ObjectArray args);
+Value nyx_builtin_length(Runtime* rt, ContextChain* ctxChain, ObjectArray args);
 
-Object* nyx_builtin_length(Runtime* rt,
-                           ContextChain* ctxChain,
-                           ObjectArray args);
+Value nyx_builtin_to_int(Runtime* rt, ContextChain* ctxChain, ObjectArray args);
 
-Object* nyx_builtin_to_int(Runtime* rt,
-                           ContextChain* ctxChain,
-                           ObjectArray args);
+Value nyx_builtin_to_double(Runtime* rt,
+                            ContextChain* ctxChain,
+                            ObjectArray args);
 
-Object* nyx_builtin_to_double(Runtime* rt,
-                              ContextChain* ctxChain,
-                              ObjectArray args);
+Value nyx_builtin_range(Runtime* rt, ContextChain* ctxChain, ObjectArray args);
 
-Object* nyx_builtin_range(Runtime* rt,
-                          ContextChain* ctxChain,
-                          ObjectArray args);
+Value nyx_builtin_assert(Runtime* rt, ContextChain* ctxChain, ObjectArray args);
 
-Object* nyx_builtin_assert(Runtime* rt,
+Value nyx_builtin_dump_ast(Runtime* rt,
                            ContextChain* ctxChain,
                            ObjectArray args);
-
-Object* nyx_builtin_dump_ast(Runtime* rt,
-                             ContextChain* ctxChain,
-                             ObjectArray args);
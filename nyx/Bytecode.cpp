@@ -0,0 +1,393 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Bytecode.h"
+#include <typeinfo>
+#include "Gc.h"
+#include "Rewriter.h"
+#include "Utils.hpp"
+
+int Chunk::emit(OpCode op, int a, int b, AstNode* node) {
+    return emit(op, a, b, Address{}, node);
+}
+
+int Chunk::emit(OpCode op, int a, int b, Address addr, AstNode* node) {
+    code.push_back(Instruction{op, a, b});
+    addresses.push_back(addr);
+    if (node != nullptr) {
+        positions.emplace_back(node->line, node->column);
+    } else {
+        positions.emplace_back(-1, -1);
+    }
+    return (int)code.size() - 1;
+}
+
+int Chunk::addConstant(Value object) {
+    // Constants live as long as the chunk, i.e. the whole program
+    constants.push_back(Gc::pin(object));
+    return (int)constants.size() - 1;
+}
+
+int Chunk::addName(Symbol name) {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) {
+            return (int)i;
+        }
+    }
+    names.push_back(name);
+    return (int)names.size() - 1;
+}
+
+Chunk* BytecodeCompiler::compile(const std::vector<Statement*>& stmts,
+                                 bool isFunc) {
+    this->chunk = new Chunk;
+    this->isFunc = isFunc;
+    for (auto* stmt : stmts) {
+        stmt->visit(this);
+        patchAll(stmtEnds, here());
+        stmtEnds.clear();
+    }
+    chunk->emit(OP_RETURN_NULL, 0, 0, nullptr);
+    chunk->calls.resize(chunk->code.size());
+    return chunk;
+}
+
+void BytecodeCompiler::patch(int at, int target) {
+    chunk->code[at].a = target;
+}
+
+void BytecodeCompiler::patchAll(const std::vector<int>& at, int target) {
+    for (int i : at) {
+        patch(i, target);
+    }
+}
+
+void BytecodeCompiler::compileBlock(Block* block) {
+    enterContext(nullptr);
+    for (auto* stmt : block->stmts) {
+        stmt->visit(this);
+    }
+    leaveContext(nullptr);
+}
+
+void BytecodeCompiler::enterContext(AstNode* node) {
+    chunk->emit(OP_NEW_CONTEXT, 0, 0, node);
+    depth++;
+}
+
+void BytecodeCompiler::leaveContext(AstNode* node) {
+    depth--;
+    chunk->emit(OP_LEAVE_CONTEXT, depth, 0, node);
+}
+
+void BytecodeCompiler::leaveTo(int target, AstNode* node) {
+    if (depth > target) {
+        chunk->emit(OP_LEAVE_CONTEXT, target, 0, node);
+    }
+}
+
+void BytecodeCompiler::compileLoopBody(Block* block, Loop* loop) {
+    loop->depth = depth;
+    loops.push_back(loop);
+    for (auto* stmt : block->stmts) {
+        stmt->visit(this);
+    }
+    loops.pop_back();
+}
+
+//===----------------------------------------------------------------------===//
+// Expressions
+//===----------------------------------------------------------------------===//
+void BytecodeCompiler::visitExpression(Expression* node) {
+    panic("unexpected expression at line %d, col %d\n", node->line,
+          node->column);
+}
+
+void BytecodeCompiler::visitBoolExpr(BoolExpr* node) {
+    chunk->emit(OP_CONST, chunk->addConstant(rt->newObject(node->literal)), 0,
+                node);
+}
+
+void BytecodeCompiler::visitCharExpr(CharExpr* node) {
+    chunk->emit(OP_CONST, chunk->addConstant(rt->newObject(node->literal)), 0,
+                node);
+}
+
+void BytecodeCompiler::visitNullExpr(NullExpr* node) {
+    chunk->emit(OP_CONST, chunk->addConstant(rt->newObject()), 0, node);
+}
+
+void BytecodeCompiler::visitIntExpr(IntExpr* node) {
+    chunk->emit(OP_CONST, chunk->addConstant(rt->newObject(node->literal)), 0,
+                node);
+}
+
+void BytecodeCompiler::visitDoubleExpr(DoubleExpr* node) {
+    chunk->emit(OP_CONST, chunk->addConstant(rt->newObject(node->literal)), 0,
+                node);
+}
+
+void BytecodeCompiler::visitStringExpr(StringExpr* node) {
+    chunk->emit(OP_CONST, chunk->addConstant(rt->newObject(node->literal)), 0,
+                node);
+}
+
+void BytecodeCompiler::visitArrayExpr(ArrayExpr* node) {
+    // Array is the only mutable object, it must be created at runtime
+    for (auto* e : node->literal) {
+        e->visit(this);
+    }
+    chunk->emit(OP_ARRAY, (int)node->literal.size(), 0, node);
+}
+
+void BytecodeCompiler::visitNameExpr(NameExpr* node) {
+    chunk->emit(OP_LOAD_NAME, chunk->addName(node->identName), 0, node->addr,
+                node);
+}
+
+void BytecodeCompiler::visitIndexExpr(IndexExpr* node) {
+    node->index->visit(this);
+    chunk->emit(OP_LOAD_INDEX, chunk->addName(node->identName), 0, node->addr,
+                node);
+}
+
+void BytecodeCompiler::visitBinaryExpr(BinaryExpr* node) {
+    if (node->lhs != nullptr) {
+        node->lhs->visit(this);
+    } else {
+        chunk->emit(OP_CONST, chunk->addConstant(rt->newObject()), 0, node);
+    }
+    if (node->rhs == nullptr) {
+        chunk->emit(OP_UNARY, 0, node->opt, node);
+        return;
+    }
+    node->rhs->visit(this);
+    chunk->emit(OP_BINARY, 0, node->opt, node);
+}
+
+void BytecodeCompiler::visitFunCallExpr(FunCallExpr* node) {
+    int length = -1;
+    if (node->receiver != nullptr) {
+        node->receiver->visit(this);
+        // Same as interpreter, the receiver is meaningful only for length()
+        // call, otherwise it degenerates to normal function call
+        if (node->funcName == Runtime::LengthMethod) {
+            length = chunk->emit(OP_LENGTH, 0, 0, node);
+        } else {
+            chunk->emit(OP_POP, 0, 0, node);
+        }
+    }
+    for (auto* arg : node->args) {
+        arg->visit(this);
+    }
+    chunk->emit(OP_CALL, chunk->addName(node->funcName),
+                (int)node->args.size(), node->addr, node);
+    if (length != -1) {
+        patch(length, here());
+    }
+}
+
+void BytecodeCompiler::visitAssignExpr(AssignExpr* node) {
+    node->rhs->visit(this);
+    if (typeid(*node->lhs) == typeid(NameExpr)) {
+        auto* lhs = dynamic_cast<NameExpr*>(node->lhs);
+        chunk->emit(OP_ASSIGN_NAME, chunk->addName(lhs->identName), node->opt,
+                    lhs->addr, node);
+    } else if (typeid(*node->lhs) == typeid(IndexExpr)) {
+        auto* lhs = dynamic_cast<IndexExpr*>(node->lhs);
+        lhs->index->visit(this);
+        chunk->emit(OP_ASSIGN_INDEX, chunk->addName(lhs->identName), node->opt,
+                    lhs->addr, node);
+    } else {
+        panic("can not assign to %s at line %d, col %d\n",
+              typeid(node->lhs).name(), node->line, node->column);
+    }
+}
+
+void BytecodeCompiler::visitClosureExpr(ClosureExpr* node) {
+    chunk->closures.push_back(ClosureConverter::prototype(node));
+    chunk->emit(OP_CLOSURE, (int)chunk->closures.size() - 1, 0, node);
+}
+
+//===----------------------------------------------------------------------===//
+// Statements
+//===----------------------------------------------------------------------===//
+void BytecodeCompiler::visitStatement(Statement* node) {
+    panic("unexpected statement at line %d, col %d\n", node->line,
+          node->column);
+}
+
+void BytecodeCompiler::visitBreakStmt(BreakStmt* node) {
+    if (loops.empty()) {
+        leaveTo(1, node);
+        stmtEnds.push_back(chunk->emit(OP_JUMP, 0, 0, node));
+        return;
+    }
+    loops.back()->breaks.push_back(chunk->emit(OP_JUMP, 0, 0, node));
+}
+
+void BytecodeCompiler::visitContinueStmt(ContinueStmt* node) {
+    if (loops.empty()) {
+        leaveTo(1, node);
+        stmtEnds.push_back(chunk->emit(OP_JUMP, 0, 0, node));
+        return;
+    }
+    // Contexts of the loop are left by the loop itself, unlike those of blocks
+    // within it
+    leaveTo(loops.back()->depth, node);
+    loops.back()->continues.push_back(chunk->emit(OP_JUMP, 0, 0, node));
+}
+
+void BytecodeCompiler::visitSimpleStmt(SimpleStmt* node) {
+    node->expr->visit(this);
+    chunk->emit(OP_POP, 0, 0, node);
+}
+
+void BytecodeCompiler::visitReturnStmt(ReturnStmt* node) {
+    if (!isFunc) {
+        // Return from top-level statement merely skips the rest of it
+        if (node->ret != nullptr) {
+            node->ret->visit(this);
+            chunk->emit(OP_POP, 0, 0, node);
+        }
+        chunk->emit(OP_ITER_RESET, 0, 0, node);
+        leaveTo(1, node);
+        stmtEnds.push_back(chunk->emit(OP_JUMP, 0, 0, node));
+        return;
+    }
+    if (node->tailCall != nullptr) {
+        for (auto* arg : node->tailCall->args) {
+            arg->visit(this);
+        }
+        chunk->emit(OP_TAIL_CALL, chunk->addName(node->tailCall->funcName),
+                    (int)node->tailCall->args.size(), node->tailCall->addr,
+                    node->tailCall);
+    } else if (node->ret != nullptr) {
+        node->ret->visit(this);
+        chunk->emit(OP_RETURN, 0, 0, node);
+    } else {
+        chunk->emit(OP_RETURN_NULL, 0, 0, node);
+    }
+}
+
+void BytecodeCompiler::visitIfStmt(IfStmt* node) {
+    node->cond->visit(this);
+    int toElse = chunk->emit(OP_JUMP_IF_FALSE, 0, 0, node);
+    compileBlock(node->block);
+    if (node->elseBlock == nullptr) {
+        patch(toElse, here());
+        return;
+    }
+    int toEnd = chunk->emit(OP_JUMP, 0, 0, node);
+    patch(toElse, here());
+    compileBlock(node->elseBlock);
+    patch(toEnd, here());
+}
+
+void BytecodeCompiler::visitWhileStmt(WhileStmt* node) {
+    Loop loop;
+    enterContext(node);
+    int start = here();
+    node->cond->visit(this);
+    int toEnd = chunk->emit(OP_JUMP_IF_FALSE, 0, 0, node);
+    compileLoopBody(node->block, &loop);
+    chunk->emit(OP_JUMP, start, 0, node);
+    patch(toEnd, here());
+    patchAll(loop.breaks, here());
+    patchAll(loop.continues, start);
+    leaveContext(node);
+}
+
+void BytecodeCompiler::visitForStmt(ForStmt* node) {
+    Loop loop;
+    enterContext(node);
+    if (node->init != nullptr) {
+        node->init->visit(this);
+        chunk->emit(OP_POP, 0, 0, node);
+    }
+    int start = here();
+    int toEnd = -1;
+    if (node->cond != nullptr) {
+        node->cond->visit(this);
+        toEnd = chunk->emit(OP_JUMP_IF_FALSE, 0, 0, node);
+    }
+    compileLoopBody(node->block, &loop);
+    int post = here();
+    if (node->post != nullptr) {
+        node->post->visit(this);
+        chunk->emit(OP_POP, 0, 0, node);
+    }
+    chunk->emit(OP_JUMP, start, 0, node);
+    if (toEnd != -1) {
+        patch(toEnd, here());
+    }
+    patchAll(loop.breaks, here());
+    patchAll(loop.continues, post);
+    leaveContext(node);
+}
+
+void BytecodeCompiler::visitForEachStmt(ForEachStmt* node) {
+    Loop loop;
+    loop.isForEach = true;
+    int name = chunk->addName(node->identName);
+    enterContext(node);
+    chunk->emit(OP_DEFINE_NAME, name, 0, node->addr, node);
+    node->list->visit(this);
+    chunk->emit(OP_ITER_PREP, name, 0, node->addr, node);
+    int next = chunk->emit(OP_ITER_NEXT, 0, 0, node);
+    compileLoopBody(node->block, &loop);
+    chunk->emit(OP_JUMP, next, 0, node);
+    patch(next, here());
+    patchAll(loop.breaks, here());
+    patchAll(loop.continues, next);
+    chunk->emit(OP_ITER_END, 0, 0, node);
+    leaveContext(node);
+}
+
+void BytecodeCompiler::visitMatchStmt(MatchStmt* node) {
+    if (node->cond != nullptr) {
+        node->cond->visit(this);
+    } else {
+        chunk->emit(OP_CONST, chunk->addConstant(rt->newObject(true)), 0,
+                    node);
+    }
+    // Condition value stays on stack while cases are compared against it and
+    // it's popped exactly once on every way out of the match
+    std::vector<int> toEnd;
+    for (const auto& [theCase, theBranch, isAny] : node->matches) {
+        int toNext = -1;
+        if (!isAny) {
+            theCase->visit(this);
+            toNext = chunk->emit(OP_JUMP_IF_NE, 0, 0, node);
+        }
+        chunk->emit(OP_POP, 0, 0, node);
+        compileBlock(theBranch);
+        toEnd.push_back(chunk->emit(OP_JUMP, 0, 0, node));
+        if (toNext != -1) {
+            patch(toNext, here());
+        }
+    }
+    // Nothing matched, drop the condition value
+    chunk->emit(OP_POP, 0, 0, node);
+    patchAll(toEnd, here());
+}
@@ -0,0 +1,169 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_BYTECODE_H
+#define NYX_BYTECODE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "Ast.h"
+#include "Interpreter.h"
+#include "Object.hpp"
+#include "Runtime.hpp"
+
+//===----------------------------------------------------------------------===//
+// Instruction set of nyx virtual machine. Every instruction carries at most two
+// integer operands, their meanings are listed along with the opcodes. Those
+// refer to variables find them at addresses their chunk keeps for them
+//===----------------------------------------------------------------------===//
+enum OpCode : unsigned char {
+    OP_CONST,          // push constants[a]
+    OP_POP,            // pop top of stack
+    OP_LOAD_NAME,      // push value of variable names[a]
+    OP_LOAD_INDEX,     // pop index, push element of array names[a]
+    OP_ASSIGN_NAME,    // assign top of stack to names[a] with token b
+    OP_ASSIGN_INDEX,   // pop index, assign top of stack to names[a][index]
+    OP_DEFINE_NAME,    // create null variable names[a] in current context
+    OP_UNARY,          // pop operand, push result of unary operator b
+    OP_BINARY,         // pop rhs and lhs, push result of binary operator b
+    OP_ARRAY,          // pop a elements, push an array of them
+    OP_CLOSURE,        // push a closure made of closures[a]
+    OP_CALL,           // pop b arguments, call function names[a]
+    OP_TAIL_CALL,      // same as OP_CALL but return its result in its place
+    OP_LENGTH,         // pop receiver, push its length and jump to a if any
+    OP_JUMP,           // jump to a
+    OP_JUMP_IF_FALSE,  // pop condition, jump to a if it's false
+    OP_JUMP_IF_NE,     // pop case value, jump to a if it mismatches top
+    OP_NEW_CONTEXT,    // push a new context into current context chain
+    OP_LEAVE_CONTEXT,  // pop contexts until a of them are left
+    OP_ITER_PREP,      // pop array, iterate it over variable names[a]
+    OP_ITER_NEXT,      // assign next element or jump to a once exhausted
+    OP_ITER_END,       // finish the innermost iteration
+    OP_ITER_RESET,     // finish all iterations of current frame
+    OP_RETURN,         // pop return value and leave current frame
+    OP_RETURN_NULL,    // leave current frame without return value
+};
+
+struct Instruction {
+    OpCode op;
+    int a;
+    int b;
+};
+
+struct Chunk {
+    explicit Chunk() = default;
+
+    int emit(OpCode op, int a, int b, AstNode* node);
+
+    int emit(OpCode op, int a, int b, Address addr, AstNode* node);
+
+    int addConstant(Value object);
+
+    int addName(Symbol name);
+
+    std::vector<Instruction> code;
+    // Source position of each instruction, for error reporting only
+    std::vector<std::pair<int, int>> positions;
+    std::vector<Value> constants;
+    std::vector<Symbol> names;
+    std::vector<Func*> closures;
+    // Address of variable that each instruction refers to, if any
+    std::vector<Address> addresses;
+    std::vector<CallCache> calls;
+};
+
+//===----------------------------------------------------------------------===//
+// Lower AST nodes to bytecode, statements leave the operand stack balanced
+// while expressions push exactly one value
+//===----------------------------------------------------------------------===//
+class BytecodeCompiler : public AstVisitor {
+public:
+    explicit BytecodeCompiler(Runtime* rt) : rt(rt) {}
+
+    Chunk* compile(const std::vector<Statement*>& stmts, bool isFunc);
+
+private:
+    struct Loop {
+        bool isForEach{};
+        std::vector<int> breaks;
+        std::vector<int> continues;
+        // Contexts of current frame while its body runs
+        int depth{};
+    };
+
+    void visitExpression(Expression* node) override;
+    void visitBoolExpr(BoolExpr* node) override;
+    void visitCharExpr(CharExpr* node) override;
+    void visitNullExpr(NullExpr* node) override;
+    void visitIntExpr(IntExpr* node) override;
+    void visitDoubleExpr(DoubleExpr* node) override;
+    void visitStringExpr(StringExpr* node) override;
+    void visitArrayExpr(ArrayExpr* node) override;
+    void visitNameExpr(NameExpr* node) override;
+    void visitIndexExpr(IndexExpr* node) override;
+    void visitBinaryExpr(BinaryExpr* node) override;
+    void visitFunCallExpr(FunCallExpr* node) override;
+    void visitAssignExpr(AssignExpr* node) override;
+    void visitClosureExpr(ClosureExpr* node) override;
+    void visitStatement(Statement* node) override;
+    void visitBreakStmt(BreakStmt* node) override;
+    void visitContinueStmt(ContinueStmt* node) override;
+    void visitSimpleStmt(SimpleStmt* node) override;
+    void visitReturnStmt(ReturnStmt* node) override;
+    void visitIfStmt(IfStmt* node) override;
+    void visitWhileStmt(WhileStmt* node) override;
+    void visitForStmt(ForStmt* node) override;
+    void visitForEachStmt(ForEachStmt* node) override;
+    void visitMatchStmt(MatchStmt* node) override;
+
+    void compileBlock(Block* block);
+
+    void enterContext(AstNode* node);
+
+    void leaveContext(AstNode* node);
+
+    // Pop contexts of blocks that break, continue and return jump out of
+    void leaveTo(int target, AstNode* node);
+
+    void compileLoopBody(Block* block, Loop* loop);
+
+    void patch(int at, int target);
+
+    void patchAll(const std::vector<int>& at, int target);
+
+    int here() const { return (int)chunk->code.size(); }
+
+    Runtime* rt;
+    Chunk* chunk{};
+    bool isFunc{};
+    std::vector<Loop*> loops;
+    // Contexts that current frame has while running current instruction, it
+    // starts with the one that functions and top-level statements run in
+    int depth = 1;
+    // Jumps to the end of current outermost statement, which is where break,
+    // continue outside of loops and top-level return resume execution
+    std::vector<int> stmtEnds;
+};
+
+#endif  // NYX_BYTECODE_H
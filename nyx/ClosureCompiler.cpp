@@ -0,0 +1,618 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "ClosureCompiler.h"
+#include "Gc.h"
+#include "Jit.h"
+#include "Rewriter.h"
+#include "Utils.hpp"
+
+using BinaryOperator = Value (Value::*)(Value) const;
+using UnaryOperator = Value (Value::*)() const;
+
+static BinaryOperator binaryOperator(Token opt) {
+    switch (opt) {
+        case TK_PLUS:
+        case TK_PLUS_AGN:
+            return &Value::operator+;
+        case TK_MINUS:
+        case TK_MINUS_AGN:
+            return static_cast<BinaryOperator>(&Value::operator-);
+        case TK_TIMES:
+        case TK_TIMES_AGN:
+            return &Value::operator*;
+        case TK_DIV:
+        case TK_DIV_AGN:
+            return &Value::operator/;
+        case TK_MOD:
+        case TK_MOD_AGN:
+            return &Value::operator%;
+        case TK_LOGAND:
+            return &Value::operator&&;
+        case TK_LOGOR:
+            return &Value::operator||;
+        case TK_EQ:
+            return &Value::operator==;
+        case TK_NE:
+            return &Value::operator!=;
+        case TK_GT:
+            return &Value::operator>;
+        case TK_GE:
+            return &Value::operator>=;
+        case TK_LT:
+            return &Value::operator<;
+        case TK_LE:
+            return &Value::operator<=;
+        case TK_BITAND:
+            return &Value::operator&;
+        case TK_BITOR:
+            return &Value::operator|;
+        default:
+            panic("unexpected token %d", opt);
+    }
+    return nullptr;
+}
+
+// Execute statements of a block until any of them breaks the normal flow
+static ExecResult runBlock(const CompiledBlock& stmts, ContextChain* ctxChain) {
+    ExecResult ret(ExecNormal);
+    for (const auto& stmt : stmts) {
+        ret = stmt(ctxChain);
+        if (ret.execType != ExecNormal) {
+            break;
+        }
+    }
+    return ret;
+}
+
+void ClosureCompiler::execute() {
+    Interpreter::newContext(ctxChain);
+    GcRoot chainRoot(&ctxChain);
+
+    for (auto* stmt : rt->getStatements()) {
+        compile(stmt)(ctxChain);
+    }
+}
+
+CompiledExpr ClosureCompiler::compile(Expression* node) {
+    node->visit(this);
+    return std::move(expr);
+}
+
+CompiledStmt ClosureCompiler::compile(Statement* node) {
+    node->visit(this);
+    return std::move(stmt);
+}
+
+CompiledBlock* ClosureCompiler::compile(Block* block) {
+    if (auto iter = blocks.find(block); iter != blocks.end()) {
+        return iter->second;
+    }
+    auto* compiled = new CompiledBlock;
+    for (auto* s : block->stmts) {
+        compiled->push_back(compile(s));
+    }
+    blocks.emplace(block, compiled);
+    return compiled;
+}
+
+CompiledExpr ClosureCompiler::constant(Value object) {
+    return [object = Gc::pin(object)](ContextChain*) { return object; };
+}
+
+Value ClosureCompiler::callFunc(Func* f,
+                                ContextChain* lastCtxChain,
+                                const std::vector<CompiledExpr>& args,
+                                const BoundFunc* closure) {
+    ContextChain* funcCtxChain = Interpreter::enterFunc(f, closure);
+    GcRoot chainRoot(&funcCtxChain);
+    for (int i = 0; i < (int)f->params.size(); i++) {
+        Value argValue = args[i](lastCtxChain);
+        Interpreter::bindArgument(rt, funcCtxChain, i, argValue);
+    }
+    if (Value ret = Jit::invoke(rt, f, funcCtxChain->back()); ret != nullptr) {
+        Interpreter::leaveFunc(funcCtxChain);
+        return ret;
+    }
+
+    for (;;) {
+        CompiledBlock* body = compile(f->block);
+        Gc::safepoint();
+        ExecResult ret(ExecNormal);
+        for (const auto& s : *body) {
+            ret = s(funcCtxChain);
+            if (ret.execType == ExecReturn) {
+                break;
+            }
+        }
+        if (Interpreter::tailCallee == nullptr) {
+            Interpreter::leaveFunc(funcCtxChain);
+            return ret.retValue;
+        }
+        // Callee of tail call replaces current frame
+        f = Interpreter::tailCallee;
+        Interpreter::tailCallee = nullptr;
+        ObjectArray argValues = std::move(Interpreter::tailCallArgs);
+        if (Value ret = Jit::invoke(rt, f, argValues.data());
+            ret != nullptr) {
+            Interpreter::leaveFunc(funcCtxChain);
+            return ret;
+        }
+        Interpreter::leaveFunc(funcCtxChain);
+        funcCtxChain = Interpreter::enterFunc(f);
+        for (int i = 0; i < (int)f->params.size(); i++) {
+            Interpreter::bindArgument(rt, funcCtxChain, i, argValues[i]);
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Compile expressions, literals are evaluated only once since no operator
+// modifies its operands in place
+//===----------------------------------------------------------------------===//
+void ClosureCompiler::visitExpression(Expression* node) {
+    panic("abstract expression at line %d, col %d\n", node->line,
+          node->column);
+}
+
+void ClosureCompiler::visitBoolExpr(BoolExpr* node) {
+    expr = constant(rt->newObject(node->literal));
+}
+
+void ClosureCompiler::visitCharExpr(CharExpr* node) {
+    expr = constant(rt->newObject(node->literal));
+}
+
+void ClosureCompiler::visitNullExpr(NullExpr* node) {
+    expr = constant(rt->newObject());
+}
+
+void ClosureCompiler::visitIntExpr(IntExpr* node) {
+    expr = constant(rt->newObject(node->literal));
+}
+
+void ClosureCompiler::visitDoubleExpr(DoubleExpr* node) {
+    expr = constant(rt->newObject(node->literal));
+}
+
+void ClosureCompiler::visitStringExpr(StringExpr* node) {
+    expr = constant(rt->newObject(node->literal));
+}
+
+void ClosureCompiler::visitArrayExpr(ArrayExpr* node) {
+    std::vector<CompiledExpr> elements;
+    for (auto* e : node->literal) {
+        elements.push_back(compile(e));
+    }
+    expr = [rt = rt, elements](ContextChain* ctxChain) {
+        ObjectArray values;
+        GcRoot valuesRoot(&values);
+        for (const auto& e : elements) {
+            values.push_back(e(ctxChain));
+        }
+        return rt->newObject(values);
+    };
+}
+
+void ClosureCompiler::visitNameExpr(NameExpr* node) {
+    if (!node->addr.isResolved()) {
+        // It names a function
+        expr = [rt = rt, identName = node->identName, line = node->line,
+                column = node->column](ContextChain* ctxChain) {
+            return Interpreter::lookupName(rt, ctxChain, identName, Address{},
+                                           line, column);
+        };
+        return;
+    }
+    expr = [rt = rt, identName = node->identName, addr = node->addr,
+            line = node->line, column = node->column](ContextChain* ctxChain) {
+        if (auto* var = Interpreter::lookupVariable(ctxChain, addr);
+            var != nullptr) {
+            return var->value;
+        }
+        return Interpreter::lookupName(rt, ctxChain, identName, addr, line,
+                                       column);
+    };
+}
+
+void ClosureCompiler::visitIndexExpr(IndexExpr* node) {
+    CompiledExpr index = compile(node->index);
+    expr = [index, identName = node->identName, addr = node->addr,
+            line = node->line, column = node->column](ContextChain* ctxChain) {
+        auto* var = Interpreter::lookupVariable(ctxChain, addr);
+        if (var == nullptr) {
+            panic(
+                "use of undefined variable \"%s\" at line %d, col "
+                "%d\n",
+                identName.c_str(), line, column);
+        }
+        Value idx = index(ctxChain);
+        return Interpreter::lookupElement(identName, var, idx, line, column);
+    };
+}
+
+void ClosureCompiler::visitBinaryExpr(BinaryExpr* node) {
+    CompiledExpr lhs =
+        node->lhs ? compile(node->lhs) : constant(rt->newObject());
+    Token opt = node->opt;
+    if (node->rhs == nullptr) {
+        // Unary expression, operator is applicable only to non-null operand
+        expr = [lhs, opt, rt = rt](ContextChain* ctxChain) {
+            Value lhsObject = lhs(ctxChain);
+            if (!lhsObject.isNull()) {
+                return Interpreter::evalUnaryExpr(lhsObject, opt);
+            }
+            return Interpreter::evalBinaryExpr(lhsObject, opt, rt->newObject());
+        };
+        return;
+    }
+    CompiledExpr rhs = compile(node->rhs);
+    BinaryOperator op = binaryOperator(opt);
+    expr = [lhs, rhs, opt, op](ContextChain* ctxChain) {
+        Value lhsObject = lhs(ctxChain);
+        GcRoot lhsRoot(&lhsObject);
+        Value rhsObject = rhs(ctxChain);
+        if (!lhsObject.isNull() && rhsObject.isNull()) {
+            return Interpreter::evalUnaryExpr(lhsObject, opt);
+        }
+        return (lhsObject.*op)(rhsObject);
+    };
+}
+
+void ClosureCompiler::visitFunCallExpr(FunCallExpr* node) {
+    CompiledExpr receiver;
+    if (node->receiver != nullptr && node->funcName == Runtime::LengthMethod) {
+        receiver = compile(node->receiver);
+    } else if (node->receiver != nullptr) {
+        // Receiver is evaluated for its side effects only
+        CompiledExpr recv = compile(node->receiver);
+        receiver = [recv](ContextChain* ctxChain) {
+            recv(ctxChain);
+            return nullptr;
+        };
+    }
+    std::vector<CompiledExpr> args;
+    for (auto* e : node->args) {
+        args.push_back(compile(e));
+    }
+    expr = [this, receiver, args, funcName = node->funcName, addr = node->addr,
+            line = node->line, column = node->column,
+            cache = CallCache{}](ContextChain* ctxChain) mutable {
+        if (receiver) {
+            if (Value recv = receiver(ctxChain); recv != nullptr) {
+                if (recv.isArray()) {
+                    return rt->newObject((int)(recv.asArray().size()));
+                } else if (recv.isString()) {
+                    return rt->newObject((int)(recv.asString().length()));
+                }
+            }
+        }
+        // Lookup order is the same as interpreter does, i.e. builtin function,
+        // user defined function and closure function
+        Interpreter::resolveCall(rt, funcName, &cache);
+        if (auto* builtinFunc = cache.builtin; builtinFunc != nullptr) {
+            ObjectArray arguments;
+            GcRoot argsRoot(&arguments);
+            for (const auto& e : args) {
+                arguments.push_back(e(ctxChain));
+            }
+            return builtinFunc(rt, ctxChain, arguments);
+        }
+        if (auto* normalFunc = cache.func; normalFunc != nullptr) {
+            if (normalFunc->params.size() != args.size()) {
+                panic(
+                    "expects %d arguments but got %d at line %d, "
+                    "col %d\n",
+                    (int)normalFunc->params.size(), (int)args.size(), line,
+                    column);
+            }
+            return callFunc(normalFunc, ctxChain, args);
+        }
+        if (auto closure = Interpreter::lookupClosure(ctxChain, addr);
+            closure != nullptr) {
+            auto* closureFunc = closure.asClosure();
+            if (closureFunc->func->params.size() != args.size()) {
+                panic(
+                    "expects %d arguments but got %d at line "
+                    "%d, col %d\n",
+                    (int)closureFunc->func->params.size(), (int)args.size(),
+                    line, column);
+            }
+            return callFunc(closureFunc->func, ctxChain, args, closureFunc);
+        }
+        panic("can not find function %s at line %d, col %d", funcName.c_str(),
+              line, column);
+    };
+}
+
+void ClosureCompiler::visitAssignExpr(AssignExpr* node) {
+    CompiledExpr rhs = compile(node->rhs);
+    Token opt = node->opt;
+    if (typeid(*node->lhs) == typeid(NameExpr)) {
+        Address addr = static_cast<NameExpr*>(node->lhs)->addr;
+        BinaryOperator op = opt == TK_ASSIGN ? nullptr : binaryOperator(opt);
+        expr = [rhs, op, addr](ContextChain* ctxChain) {
+            Value rhsObject = rhs(ctxChain);
+            if (auto* var = Interpreter::lookupVariable(ctxChain, addr);
+                var != nullptr) {
+                var->value =
+                    op == nullptr ? rhsObject : (var->value.*op)(rhsObject);
+                Gc::writeBarrier(var);
+            } else {
+                Interpreter::defineVariable(ctxChain, addr, rhsObject);
+            }
+            return rhsObject;
+        };
+    } else if (typeid(*node->lhs) == typeid(IndexExpr)) {
+        auto* lhs = dynamic_cast<IndexExpr*>(node->lhs);
+        CompiledExpr index = compile(lhs->index);
+        expr = [rhs, index, opt, identName = lhs->identName, addr = lhs->addr,
+                line = node->line,
+                column = node->column](ContextChain* ctxChain) {
+            Value rhsObject = rhs(ctxChain);
+            GcRoot rhsRoot(&rhsObject);
+            Value indexObject = index(ctxChain);
+            Interpreter::assignElement(ctxChain, identName, addr, opt,
+                                       indexObject, rhsObject, line, column);
+            return rhsObject;
+        };
+    } else {
+        panic("can not assign to %s at line %d, col %d\n",
+              typeid(node->lhs).name(), node->line, node->column);
+    }
+}
+
+void ClosureCompiler::visitClosureExpr(ClosureExpr* node) {
+    expr = [rt = rt, f = ClosureConverter::prototype(node)](
+               ContextChain* ctxChain) {
+        return Interpreter::newClosure(rt, f, ctxChain);
+    };
+}
+
+//===----------------------------------------------------------------------===//
+// Compile statements, execution results are exactly the same as interpreter
+// produces
+//===----------------------------------------------------------------------===//
+void ClosureCompiler::visitStatement(Statement* node) {
+    panic("abstract statement at line %d, col %d\n", node->line, node->column);
+}
+
+void ClosureCompiler::visitBreakStmt(BreakStmt* node) {
+    stmt = [](ContextChain*) { return ExecResult(ExecBreak); };
+}
+
+void ClosureCompiler::visitContinueStmt(ContinueStmt* node) {
+    stmt = [](ContextChain*) { return ExecResult(ExecContinue); };
+}
+
+void ClosureCompiler::visitSimpleStmt(SimpleStmt* node) {
+    CompiledExpr e = compile(node->expr);
+    stmt = [e](ContextChain* ctxChain) {
+        e(ctxChain);
+        return ExecResult(ExecNormal);
+    };
+}
+
+void ClosureCompiler::visitReturnStmt(ReturnStmt* node) {
+    if (node->ret == nullptr) {
+        stmt = [](ContextChain*) { return ExecResult(ExecReturn, nullptr); };
+        return;
+    }
+    CompiledExpr e = compile(node->ret);
+    if (node->tailCall != nullptr) {
+        std::vector<CompiledExpr> args;
+        for (auto* arg : node->tailCall->args) {
+            args.push_back(compile(arg));
+        }
+        stmt = [this, e, args, call = node->tailCall,
+                cache = CallCache{}](ContextChain* ctxChain) mutable {
+            // Leave the call to frame of current function if it calls a named
+            // function, see Interpreter::callFunc
+            Interpreter::resolveCall(rt, call->funcName, &cache);
+            if (Func* callee = cache.func;
+                callee != nullptr && callee->params.size() == args.size()) {
+                ObjectArray argValues;
+                GcRoot argsRoot(&argValues);
+                for (const auto& arg : args) {
+                    argValues.push_back(arg(ctxChain));
+                }
+                Interpreter::tailCallArgs = std::move(argValues);
+                Interpreter::tailCallee = callee;
+                return ExecResult(ExecReturn, nullptr);
+            }
+            return ExecResult(ExecReturn, e(ctxChain));
+        };
+        return;
+    }
+    stmt = [e](ContextChain* ctxChain) {
+        return ExecResult(ExecReturn, e(ctxChain));
+    };
+}
+
+void ClosureCompiler::visitIfStmt(IfStmt* node) {
+    CompiledExpr cond = compile(node->cond);
+    CompiledBlock* block = compile(node->block);
+    CompiledBlock* elseBlock =
+        node->elseBlock != nullptr ? compile(node->elseBlock) : nullptr;
+    stmt = [cond, block, elseBlock, line = node->line,
+            column = node->column](ContextChain* ctxChain) {
+        Value condition = cond(ctxChain);
+        if (!condition.isBool()) {
+            panic(
+                "expects bool type in while condition at line %d, "
+                "col %d\n",
+                line, column);
+        }
+        if (condition.asBool()) {
+            Scope scope(ctxChain);
+            return runBlock(*block, ctxChain);
+        }
+        if (elseBlock != nullptr) {
+            Scope scope(ctxChain);
+            return runBlock(*elseBlock, ctxChain);
+        }
+        return ExecResult(ExecNormal);
+    };
+}
+
+// Execute one iteration of loop body, break and continue are consumed here so
+// that they never propagate to the enclosing statement. Return true if loop
+// should be terminated
+static bool runLoopBody(const CompiledBlock& stmts,
+                        ContextChain* ctxChain,
+                        ExecResult* ret) {
+    Gc::safepoint();
+    for (const auto& s : stmts) {
+        *ret = s(ctxChain);
+        if (ret->execType == ExecReturn) {
+            return true;
+        } else if (ret->execType == ExecBreak) {
+            ret->execType = ExecNormal;
+            return true;
+        } else if (ret->execType == ExecContinue) {
+            ret->execType = ExecNormal;
+            break;
+        }
+    }
+    return false;
+}
+
+void ClosureCompiler::visitWhileStmt(WhileStmt* node) {
+    CompiledExpr cond = compile(node->cond);
+    CompiledBlock* block = compile(node->block);
+    stmt = [cond, block, line = node->line,
+            column = node->column](ContextChain* ctxChain) {
+        ExecResult ret(ExecNormal);
+        Scope scope(ctxChain);
+        Value condition = cond(ctxChain);
+        if (!condition.isBool()) {
+            panic(
+                "expects bool type in while condition at line %d, "
+                "col %d\n",
+                line, column);
+        }
+        while (condition.asBool()) {
+            if (runLoopBody(*block, ctxChain, &ret)) {
+                break;
+            }
+            condition = cond(ctxChain);
+            if (!condition.isBool()) {
+                panic(
+                    "expects bool type in while condition at line %d, "
+                    "col %d\n",
+                    line, column);
+            }
+        }
+        return ret;
+    };
+}
+
+void ClosureCompiler::visitForStmt(ForStmt* node) {
+    CompiledExpr init = compile(node->init);
+    CompiledExpr cond = compile(node->cond);
+    CompiledExpr post = compile(node->post);
+    CompiledBlock* block = compile(node->block);
+    stmt = [init, cond, post, block, line = node->line,
+            column = node->column](ContextChain* ctxChain) {
+        ExecResult ret(ExecNormal);
+        Scope scope(ctxChain);
+        init(ctxChain);
+        Value condition = cond(ctxChain);
+        if (!condition.isBool()) {
+            panic(
+                "expects bool type in while condition at line %d, "
+                "col %d\n",
+                line, column);
+        }
+        while (condition.asBool()) {
+            if (runLoopBody(*block, ctxChain, &ret)) {
+                break;
+            }
+            post(ctxChain);
+            condition = cond(ctxChain);
+            if (!condition.isBool()) {
+                panic(
+                    "expects bool type in while condition at line %d, "
+                    "col %d\n",
+                    line, column);
+            }
+        }
+        return ret;
+    };
+}
+
+void ClosureCompiler::visitForEachStmt(ForEachStmt* node) {
+    CompiledExpr list = compile(node->list);
+    CompiledBlock* block = compile(node->block);
+    stmt = [rt = rt, list, block, addr = node->addr, line = node->line,
+            column = node->column](ContextChain* ctxChain) {
+        ExecResult ret(ExecNormal);
+        Scope scope(ctxChain);
+        auto* iterVar =
+            Interpreter::defineVariable(ctxChain, addr, rt->newObject());
+        Value listV = list(ctxChain);
+        if (!listV.isArray()) {
+            panic(
+                "expects array type within foreach statement at line "
+                "%d, col %d\n",
+                line, column);
+        }
+        auto listValues = listV.asArray();
+        GcRoot listRoot(&listValues);
+        for (auto val : listValues) {
+            iterVar->value = val;
+            Gc::writeBarrier(iterVar);
+            if (runLoopBody(*block, ctxChain, &ret)) {
+                break;
+            }
+        }
+        return ret;
+    };
+}
+
+void ClosureCompiler::visitMatchStmt(MatchStmt* node) {
+    CompiledExpr cond = node->cond != nullptr ? compile(node->cond)
+                                              : constant(rt->newObject(true));
+    struct Case {
+        CompiledExpr theCase;
+        CompiledBlock* theBranch;
+        bool isAny;
+    };
+    std::vector<Case> cases;
+    for (const auto& [theCase, theBranch, isAny] : node->matches) {
+        // Case expression of any(_) match is never evaluated
+        cases.push_back(Case{isAny ? nullptr : compile(theCase),
+                             compile(theBranch), isAny});
+    }
+    stmt = [cond, cases](ContextChain* ctxChain) {
+        Value condition = cond(ctxChain);
+        GcRoot conditionRoot(&condition);
+        for (const auto& c : cases) {
+            if (c.isAny || condition.equalsDeep(c.theCase(ctxChain))) {
+                Scope scope(ctxChain);
+                return runBlock(*c.theBranch, ctxChain);
+            }
+        }
+        return ExecResult(ExecNormal);
+    };
+}
@@ -0,0 +1,99 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_CLOSURECOMPILER_H
+#define NYX_CLOSURECOMPILER_H
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "Ast.h"
+#include "Interpreter.h"
+#include "Object.hpp"
+#include "Runtime.hpp"
+
+using CompiledExpr = std::function<Value(ContextChain*)>;
+using CompiledStmt = std::function<ExecResult(ContextChain*)>;
+using CompiledBlock = std::vector<CompiledStmt>;
+
+//===----------------------------------------------------------------------===//
+// Compile every AST node once into a C++ closure with its operator, literal
+// and children bound in advance, so that executing a node never needs to
+// decode it again. AST is kept untouched, function blocks are compiled at
+// their first call
+//===----------------------------------------------------------------------===//
+class ClosureCompiler : public AstVisitor {
+public:
+    explicit ClosureCompiler(Runtime* rt)
+        : rt(rt), ctxChain(new ContextChain) {}
+
+    void execute();
+
+    CompiledExpr compile(Expression* node);
+
+    CompiledStmt compile(Statement* node);
+
+    CompiledBlock* compile(Block* block);
+
+private:
+    void visitExpression(Expression* node) override;
+    void visitBoolExpr(BoolExpr* node) override;
+    void visitCharExpr(CharExpr* node) override;
+    void visitNullExpr(NullExpr* node) override;
+    void visitIntExpr(IntExpr* node) override;
+    void visitDoubleExpr(DoubleExpr* node) override;
+    void visitStringExpr(StringExpr* node) override;
+    void visitArrayExpr(ArrayExpr* node) override;
+    void visitNameExpr(NameExpr* node) override;
+    void visitIndexExpr(IndexExpr* node) override;
+    void visitBinaryExpr(BinaryExpr* node) override;
+    void visitFunCallExpr(FunCallExpr* node) override;
+    void visitAssignExpr(AssignExpr* node) override;
+    void visitClosureExpr(ClosureExpr* node) override;
+    void visitStatement(Statement* node) override;
+    void visitBreakStmt(BreakStmt* node) override;
+    void visitContinueStmt(ContinueStmt* node) override;
+    void visitSimpleStmt(SimpleStmt* node) override;
+    void visitReturnStmt(ReturnStmt* node) override;
+    void visitIfStmt(IfStmt* node) override;
+    void visitWhileStmt(WhileStmt* node) override;
+    void visitForStmt(ForStmt* node) override;
+    void visitForEachStmt(ForEachStmt* node) override;
+    void visitMatchStmt(MatchStmt* node) override;
+
+    CompiledExpr constant(Value object);
+
+    Value callFunc(Func* f,
+                   ContextChain* lastCtxChain,
+                   const std::vector<CompiledExpr>& args,
+                   const BoundFunc* closure = nullptr);
+
+    Runtime* rt;
+    ContextChain* ctxChain;
+    // Closure produced by the latest visited node
+    CompiledExpr expr;
+    CompiledStmt stmt;
+    std::unordered_map<Block*, CompiledBlock*> blocks;
+};
+
+#endif  // NYX_CLOSURECOMPILER_H
@@ -127,6 +127,13 @@ void AstDumper::visitClosureExpr(ClosureExpr* node) {
     }
     ident -= 2;
 }
+void AstDumper::visitFusedExpr(FusedExpr* node) {
+    printPadding();
+    std::cout << "-FusedExpr[" << node->idiom << "]" << std::endl;
+    ident += 2;
+    node->original->visit(this);
+    ident -= 2;
+}
 void AstDumper::visitBreakStmt(BreakStmt* node) {
     printPadding();
     std::cout << "-BreakStmt" << std::endl;
@@ -54,6 +54,7 @@ struct AstDumper : public AstVisitor {
     void visitFunCallExpr(FunCallExpr* node) override;
     void visitAssignExpr(AssignExpr* node) override;
     void visitClosureExpr(ClosureExpr* node) override;
+    void visitFusedExpr(FusedExpr* node) override;
     void visitStatement(Statement* node) override {}
     void visitBreakStmt(BreakStmt* node) override;
     void visitContinueStmt(ContinueStmt* node) override;
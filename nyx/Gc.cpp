@@ -0,0 +1,423 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Gc.h"
+#include <algorithm>
+#include <cstdio>
+
+size_t Gc::nurserySize = 512 * 1024;
+size_t Gc::minHeapSize = 1024 * 1024;
+int Gc::growth = 100;
+int Gc::maxPauseUs = 1000;
+std::vector<Object*> Gc::chunks;
+Object* Gc::top = nullptr;
+Object* Gc::limit = nullptr;
+size_t Gc::allocated = 0;
+bool Gc::evacuating = false;
+Gc::Phase Gc::phase = Idle;
+std::vector<Object*> Gc::objects;
+std::vector<Variable*> Gc::variables;
+std::vector<Object*> Gc::rememberedObjects;
+std::vector<Variable*> Gc::rememberedVariables;
+std::vector<Object*> Gc::promoted;
+std::vector<Object*> Gc::grey;
+std::vector<Value> Gc::pinned;
+std::vector<RootSet*> Gc::rootSets;
+std::vector<Value*> Gc::values;
+std::vector<ObjectArray*> Gc::arrays;
+std::vector<ContextChain* const*> Gc::chains;
+size_t Gc::heapSize = 0;
+size_t Gc::threshold = 0;
+Gc::Sweeper Gc::objectSweeper;
+Gc::Sweeper Gc::variableSweeper;
+size_t Gc::liveSize = 0;
+size_t Gc::heapSizeBeforeSweep = 0;
+std::vector<size_t> Gc::pauses;
+long long Gc::longestPause = 0;
+size_t Gc::oldCollections = 0;
+
+void Gc::trackVariable(Variable* var) {
+    var->captured = true;
+    variables.push_back(var);
+    heapSize += sizeof(Variable);
+}
+
+Value Gc::pin(Value object) {
+    if (object.isHeapObject()) {
+        evacuating = true;
+        mark(object);
+        while (!promoted.empty()) {
+            Object* copy = promoted.back();
+            promoted.pop_back();
+            scan(copy);
+        }
+        evacuating = false;
+        pinned.push_back(object);
+    }
+    return object;
+}
+
+void Gc::addRootSet(RootSet* roots) {
+    rootSets.push_back(roots);
+}
+
+void Gc::removeRootSet(RootSet* roots) {
+    rootSets.erase(std::find(rootSets.begin(), rootSets.end(), roots));
+}
+
+void Gc::grow() {
+    // It's only collected at safepoints, allocations in between take more
+    // chunks if they don't fit
+    chunks.push_back(
+        static_cast<Object*>(::operator new(ChunkObjects * sizeof(Object))));
+    top = chunks.back();
+    limit = top + ChunkObjects;
+}
+
+void Gc::collect() {
+    auto start = Clock::now();
+    collectYoung();
+    if (phase == Idle && heapSize >= threshold && heapSize >= minHeapSize) {
+        phase = Marking;
+        for (auto& value : pinned) {
+            mark(value);
+        }
+        markRoots();
+    }
+    if (phase != Idle) {
+        // Budget is counted from here on, old generation would never be done
+        // if minor collections took it up
+        collectOld(maxPauseUs > 0
+                       ? Clock::now() + std::chrono::microseconds(maxPauseUs)
+                       : Clock::time_point::max());
+    }
+
+    auto pause = std::chrono::duration_cast<std::chrono::microseconds>(
+                     Clock::now() - start)
+                     .count();
+    size_t bucket = 0;
+    while ((1LL << bucket) <= pause) {
+        bucket++;
+    }
+    if (pauses.size() <= bucket) {
+        pauses.resize(bucket + 1);
+    }
+    pauses[bucket]++;
+    longestPause = std::max(longestPause, (long long)pause);
+}
+
+void Gc::printStats() {
+    size_t total = 0;
+    for (auto count : pauses) {
+        total += count;
+    }
+    fprintf(stderr,
+            "gc: %zu pauses, %zu collections of old generation, longest pause "
+            "%lldus\n",
+            total, oldCollections, longestPause);
+    for (size_t i = 0; i < pauses.size(); i++) {
+        if (pauses[i] != 0) {
+            long long low = i == 0 ? 0 : 1LL << (i - 1);
+            fprintf(stderr, "gc: %8lldus - %8lldus %10zu\n", low, 1LL << i,
+                    pauses[i]);
+        }
+    }
+}
+
+void Gc::mark(Value& value) {
+    if (!value.isHeapObject()) {
+        return;
+    }
+    Object* object = value.object();
+    if (object->young) {
+        // Young objects are marked only by the time they are promoted
+        if (evacuating) {
+            value = Value(promote(object));
+        }
+    } else if (!evacuating && !object->marked) {
+        object->marked = true;
+        grey.push_back(object);
+    }
+}
+
+void Gc::mark(ObjectArray& values) {
+    for (auto& value : values) {
+        mark(value);
+    }
+}
+
+void Gc::mark(const ContextChain* ctxChain) {
+    for (auto* ctx : *ctxChain) {
+        for (auto* var : ctx->getVariables()) {
+            if (var != nullptr) {
+                mark(var);
+            }
+        }
+    }
+}
+
+void Gc::mark(Variable* var) {
+    if (!evacuating && var->captured) {
+        // Captured ones might be reachable from both contexts and closures
+        if (var->marked) {
+            return;
+        }
+        var->marked = true;
+    }
+    mark(var->value);
+}
+
+Object* Gc::promote(Object* object) {
+    if (object->forwarded) {
+        return object->forwardee;
+    }
+    Object* copy;
+    switch (object->type) {
+        case String:
+            copy = new Object(std::move(object->str));
+            break;
+        case Array:
+            copy = new Object(std::move(object->array));
+            break;
+        default:
+            copy = new Object(std::move(object->closure));
+            break;
+    }
+    object->forward(copy);
+    objects.push_back(copy);
+    heapSize += sizeOf(copy);
+    // Objects it refers to are promoted as well
+    promoted.push_back(copy);
+    if (phase == Marking) {
+        // It's marked as if it had been there when marking started, objects
+        // it refers to are marked later on
+        copy->marked = true;
+        grey.push_back(copy);
+    }
+    return copy;
+}
+
+void Gc::markRoots() {
+    for (auto* roots : rootSets) {
+        roots->markRoots();
+    }
+    for (auto* value : values) {
+        mark(*value);
+    }
+    for (auto* array : arrays) {
+        mark(*array);
+    }
+    for (auto* const* ctxChain : chains) {
+        if (*ctxChain != nullptr) {
+            mark(*ctxChain);
+        }
+    }
+}
+
+void Gc::scan(Object* object) {
+    if (object->type == Array) {
+        mark(object->array);
+    } else if (object->type == Closure) {
+        for (auto* var : object->closure.upvalues) {
+            if (var != nullptr) {
+                mark(var);
+            }
+        }
+    }
+}
+
+bool Gc::drain(Clock::time_point deadline) {
+    // Trace with an explicit stack rather than recursion, deeply nested arrays
+    // would overflow native stack otherwise
+    size_t scanned = 0;
+    while (!grey.empty()) {
+        Object* object = grey.back();
+        grey.pop_back();
+        scan(object);
+        if (++scanned % SliceObjects == 0 && Clock::now() >= deadline) {
+            return grey.empty();
+        }
+    }
+    return true;
+}
+
+void Gc::collectYoung() {
+    // Old objects are not traced, except those in remembered set, which might
+    // be the only ones that refer to young objects
+    evacuating = true;
+    markRoots();
+    for (auto* object : rememberedObjects) {
+        object->remembered = false;
+        promoted.push_back(object);
+    }
+    rememberedObjects.clear();
+    for (auto* var : rememberedVariables) {
+        var->remembered = false;
+        mark(var->value);
+    }
+    rememberedVariables.clear();
+    while (!promoted.empty()) {
+        Object* object = promoted.back();
+        promoted.pop_back();
+        scan(object);
+    }
+    evacuating = false;
+
+    // Survivors have been copied, what's left in nursery is garbage
+    for (auto* chunk : chunks) {
+        Object* end = chunk == chunks.back() ? top : chunk + ChunkObjects;
+        for (Object* object = chunk; object != end; object++) {
+            object->~Object();
+        }
+    }
+    while (chunks.size() > 1) {
+        ::operator delete(chunks.back());
+        chunks.pop_back();
+    }
+    if (!chunks.empty()) {
+        top = chunks.front();
+        limit = top + ChunkObjects;
+    }
+    allocated = 0;
+}
+
+void Gc::collectOld(Clock::time_point deadline) {
+    while (phase == Marking) {
+        if (!drain(deadline)) {
+            return;
+        }
+        // Roots are not guarded by write barriers, objects stored to them
+        // since they were marked are only found by marking them again
+        markRoots();
+        if (grey.empty()) {
+            startSweeping();
+        } else if (Clock::now() >= deadline) {
+            return;
+        }
+    }
+    if (sweep(deadline)) {
+        phase = Idle;
+        oldCollections++;
+    }
+}
+
+void Gc::startSweeping() {
+    phase = Sweeping;
+    // Objects promoted and variables captured from now on are left alone
+    objectSweeper = Sweeper{objects.size(), 0, 0};
+    variableSweeper = Sweeper{variables.size(), 0, 0};
+    liveSize = 0;
+    heapSizeBeforeSweep = heapSize;
+}
+
+bool Gc::sweep(Clock::time_point deadline) {
+    if (!sweep(objects, &objectSweeper, deadline) ||
+        !sweep(variables, &variableSweeper, deadline)) {
+        return false;
+    }
+    heapSize = liveSize + (heapSize - heapSizeBeforeSweep);
+    threshold = heapSize * (100 + growth) / 100;
+    return true;
+}
+
+template <typename T>
+bool Gc::sweep(std::vector<T*>& list,
+               Sweeper* sweeper,
+               Clock::time_point deadline) {
+    while (sweeper->next < sweeper->end) {
+        T* item = list[sweeper->next++];
+        if (survive(item)) {
+            list[sweeper->kept++] = item;
+        }
+        if (sweeper->next % SliceObjects == 0 && Clock::now() >= deadline) {
+            return false;
+        }
+    }
+    if (sweeper->kept < sweeper->end) {
+        list.erase(list.begin() + sweeper->kept, list.begin() + sweeper->end);
+        sweeper->end = sweeper->next = sweeper->kept;
+    }
+    return true;
+}
+
+bool Gc::survive(Object* object) {
+    if (!object->marked) {
+        delete object;
+        return false;
+    }
+    object->marked = false;
+    liveSize += sizeOf(object);
+    return true;
+}
+
+bool Gc::survive(Variable* var) {
+    // Captured variables that are not marked are neither visible from any
+    // context chain nor referred to by any closure
+    if (!var->marked) {
+        delete var;
+        return false;
+    }
+    var->marked = false;
+    liveSize += sizeof(Variable);
+    return true;
+}
+
+size_t Gc::sizeOf(const Object* object) {
+    switch (object->type) {
+        case String:
+            return sizeof(Object) + object->str.footprint();
+        case Array:
+            return sizeof(Object) + object->array.capacity() * sizeof(Value);
+        default:
+            return sizeof(Object) +
+                   object->closure.upvalues.capacity() * sizeof(Variable*);
+    }
+}
+
+GcRoot::GcRoot(Value* value) : kind(OfValue) {
+    // Registered even if it's not a heap object yet since it may be assigned
+    // one later, it's checked once it's marked
+    Gc::values.push_back(value);
+}
+
+GcRoot::GcRoot(ObjectArray* values) : kind(OfArray) {
+    Gc::arrays.push_back(values);
+}
+
+GcRoot::GcRoot(ContextChain* const* ctxChain) : kind(OfChain) {
+    Gc::chains.push_back(ctxChain);
+}
+
+GcRoot::~GcRoot() {
+    switch (kind) {
+        case OfValue:
+            Gc::values.pop_back();
+            break;
+        case OfArray:
+            Gc::arrays.pop_back();
+            break;
+        case OfChain:
+            Gc::chains.pop_back();
+            break;
+    }
+}
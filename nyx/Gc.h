@@ -0,0 +1,272 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_GC_H
+#define NYX_GC_H
+
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <vector>
+#include "Object.hpp"
+#include "Runtime.hpp"
+
+// Roots that an engine keeps in its own structures, e.g. operand stack of VM.
+// They are updated in place once objects they refer to are moved
+class RootSet {
+public:
+    virtual ~RootSet() = default;
+
+    virtual void markRoots() = 0;
+};
+
+//===----------------------------------------------------------------------===//
+// Generational garbage collector of heap objects. Objects are allocated by
+// bumping a pointer in nursery, most of them die young and are reclaimed at
+// once by a minor collection, which copies survivors to old generation. Old
+// generation is collected by incremental mark-sweep once it has grown enough,
+// each minor collection then marks or sweeps it a bit further for at most
+// maxPauseUs. Objects are traced from roots, i.e. context
+// chains being executed, values that native code holds on to and constants
+// that compilers cached, as well as remembered set, i.e. old objects and
+// captured variables that might refer to young objects. Write barriers add to
+// remembered set, and mark objects stored to old generation while it's being
+// marked, so that no object is left unmarked behind marked ones. It only
+// collects at safepoints, that is, loop back-edges and entries of functions,
+// where all engines have their temporaries registered as roots. Variables
+// captured by closures are managed as well, they outlive contexts that created
+// them until no closure refers to them
+//===----------------------------------------------------------------------===//
+class Gc {
+public:
+    // Bytes allocated in nursery to trigger a minor collection
+    static size_t nurserySize;
+    // Size of old generation in bytes below which it's not collected
+    static size_t minHeapSize;
+    // Percentage that old generation grows by since the last collection of it
+    // to trigger the next one
+    static int growth;
+    // Microseconds that a pause takes at most to mark or sweep old generation,
+    // it's collected at once if it's 0
+    static int maxPauseUs;
+
+    template <typename T>
+    static Object* allocate(T data) {
+        if (top == limit) {
+            grow();
+        }
+        auto* object = new (top++) Object(std::move(data));
+        object->young = true;
+        allocated += sizeOf(object);
+        return object;
+    }
+
+    static void trackVariable(Variable* var);
+
+    // Keep object alive for good, e.g. literals cached by compilers. It's
+    // moved to old generation at once, so use the returned value instead
+    static Value pin(Value object);
+
+    // Called once variable was assigned, only captured ones matter since the
+    // rest are roots
+    static void writeBarrier(Variable* var) {
+        if (!var->captured) {
+            return;
+        }
+        if (!var->remembered && isYoung(var->value)) {
+            var->remembered = true;
+            rememberedVariables.push_back(var);
+        }
+        if (phase == Marking) {
+            shade(var->value);
+        }
+    }
+
+    // Called once element of array was assigned
+    static void writeBarrier(Value array, Value element) {
+        Object* object = array.object();
+        if (object->young) {
+            return;
+        }
+        if (!object->remembered && isYoung(element)) {
+            object->remembered = true;
+            rememberedObjects.push_back(object);
+        }
+        if (phase == Marking) {
+            shade(element);
+        }
+    }
+
+    static void addRootSet(RootSet* roots);
+
+    static void removeRootSet(RootSet* roots);
+
+    static void safepoint() {
+        if (allocated >= nurserySize) {
+            collect();
+        }
+    }
+
+    static void collect();
+
+    // Print histogram of pause times to stderr
+    static void printStats();
+
+    static void mark(Value& value);
+
+    static void mark(ObjectArray& values);
+
+    static void mark(const ContextChain* ctxChain);
+
+private:
+    friend class GcRoot;
+
+    using Clock = std::chrono::steady_clock;
+
+    // Progress of collecting old generation
+    enum Phase { Idle, Marking, Sweeping };
+
+    // Progress of sweeping a list of objects or variables, which covers those
+    // that were there when sweeping started. Those before next are done and
+    // survivors among them are moved to the front
+    struct Sweeper {
+        size_t end;
+        size_t next;
+        size_t kept;
+    };
+
+    // Objects that a nursery chunk holds
+    static constexpr size_t ChunkObjects = 4096;
+    // Objects that are marked or swept between two checks of elapsed time,
+    // each pause makes at least this much progress
+    static constexpr size_t SliceObjects = 64;
+
+    static bool isYoung(Value value) {
+        return value.isHeapObject() && value.object()->young;
+    }
+
+    static void shade(Value value) {
+        if (value.isHeapObject()) {
+            if (Object* object = value.object();
+                !object->young && !object->marked) {
+                object->marked = true;
+                grey.push_back(object);
+            }
+        }
+    }
+
+    static void grow();
+
+    static Object* promote(Object* object);
+
+    static void mark(Variable* var);
+
+    static void markRoots();
+
+    static void scan(Object* object);
+
+    static bool drain(Clock::time_point deadline);
+
+    static void collectYoung();
+
+    static void collectOld(Clock::time_point deadline);
+
+    static void startSweeping();
+
+    static bool sweep(Clock::time_point deadline);
+
+    template <typename T>
+    static bool sweep(std::vector<T*>& list,
+                      Sweeper* sweeper,
+                      Clock::time_point deadline);
+
+    // Whether it survives sweeping, it's freed otherwise
+    static bool survive(Object* object);
+
+    static bool survive(Variable* var);
+
+    static size_t sizeOf(const Object* object);
+
+    // Nursery is made of chunks, objects are allocated from the last one
+    static std::vector<Object*> chunks;
+    static Object* top;
+    static Object* limit;
+    static size_t allocated;
+    // Whether young objects are being copied to old generation rather than
+    // old generation being marked
+    static bool evacuating;
+    static Phase phase;
+    static std::vector<Object*> objects;
+    static std::vector<Variable*> variables;
+    static std::vector<Object*> rememberedObjects;
+    static std::vector<Variable*> rememberedVariables;
+    // Objects copied to old generation whose fields are yet to be evacuated
+    static std::vector<Object*> promoted;
+    // Objects marked but not scanned yet
+    static std::vector<Object*> grey;
+    static std::vector<Value> pinned;
+    static std::vector<RootSet*> rootSets;
+    // Roots registered by GcRoot, innermost ones come last
+    static std::vector<Value*> values;
+    static std::vector<ObjectArray*> arrays;
+    static std::vector<ContextChain* const*> chains;
+    static size_t heapSize;
+    static size_t threshold;
+    static Sweeper objectSweeper;
+    static Sweeper variableSweeper;
+    // Bytes of survivors and heap size when sweeping started
+    static size_t liveSize;
+    static size_t heapSizeBeforeSweep;
+    // Pause times, the i-th bucket counts those in [2^(i-1), 2^i)
+    // microseconds, the first one counts those under 1 microsecond
+    static std::vector<size_t> pauses;
+    static long long longestPause;
+    static size_t oldCollections;
+};
+
+//===----------------------------------------------------------------------===//
+// Register what native code holds on to as a root until the end of current
+// scope. Everything is rooted by address, so that changes made to it later are
+// seen and it's updated once objects it refers to are moved
+//===----------------------------------------------------------------------===//
+class GcRoot {
+public:
+    explicit GcRoot(Value* value);
+
+    explicit GcRoot(ObjectArray* values);
+
+    explicit GcRoot(ContextChain* const* ctxChain);
+
+    ~GcRoot();
+
+    GcRoot(const GcRoot&) = delete;
+
+    GcRoot& operator=(const GcRoot&) = delete;
+
+private:
+    enum Kind { OfValue, OfArray, OfChain };
+
+    Kind kind;
+};
+
+#endif  // NYX_GC_H
@@ -22,16 +22,35 @@
 //
 #include "Interpreter.h"
 #include <deque>
+#include <functional>
 #include <memory>
 #include <vector>
 #include "Ast.h"
 #include "Debug.hpp"
+#include "Gc.h"
+#include "Jit.h"
 #include "Object.hpp"
+#include "Rewriter.h"
 #include "Runtime.hpp"
+#include "Trace.h"
 #include "Utils.hpp"
 
+Func* Interpreter::tailCallee = nullptr;
+ObjectArray Interpreter::tailCallArgs;
+std::vector<Context*> Interpreter::freeContexts;
+std::vector<ContextChain*> Interpreter::freeChains;
+FrameStack Interpreter::frameStack;
+
 void Interpreter::execute(Runtime* rt) {
     Interpreter::newContext(ctxChain);
+    GcRoot chainRoot(&ctxChain);
+
+    Inliner inliner(rt);
+    inliner.rewriteAll(rt);
+    SuperinstructionFuser fuser;
+    fuser.rewriteAll(rt);
+    BinaryExprQuickener quickener;
+    quickener.rewriteAll(rt);
 
     AstDumper dumper;
     for (auto stmt : rt->getStatements()) {
@@ -43,57 +62,161 @@ void Interpreter::execute(Runtime* rt) {
 }
 
 void Interpreter::newContext(ContextChain* ctxChain) {
-    auto* tempContext = new Context;
-    ctxChain->push_back(tempContext);
+    if (freeContexts.empty()) {
+        ctxChain->push_back(new Context);
+        return;
+    }
+    ctxChain->push_back(freeContexts.back());
+    freeContexts.pop_back();
+}
+
+void Interpreter::leaveContext(ContextChain* ctxChain, size_t depth) {
+    while (ctxChain->size() > depth) {
+        auto* ctx = ctxChain->back();
+        ctxChain->pop_back();
+        if (!ctx->isEmpty()) {
+            ctx->clear();
+        }
+        freeContexts.push_back(ctx);
+    }
 }
 
-Object* Interpreter::callFunc(Runtime* rt,
-                              Func* f,
-                              ContextChain* lastCtxChain,
-                              std::vector<Expression*> args) {
+Value Interpreter::newClosure(Runtime* rt, Func* f, ContextChain* ctxChain) {
+    BoundFunc closure{f, {}};
+    closure.upvalues.reserve(f->freeVars.size());
+    for (const auto& freeVar : f->freeVars) {
+        if (!freeVar.capture.isResolved()) {
+            closure.upvalues.push_back(nullptr);
+            continue;
+        }
+        auto* var = Interpreter::lookupVariable(ctxChain, freeVar.capture);
+        if (var == nullptr && !freeVar.assigned &&
+            !rt->hasBuiltinFunction(freeVar.name) &&
+            !rt->hasFunction(freeVar.name)) {
+            // It's referred to before being defined, e.g. a closure that calls
+            // itself through the variable it's about to be assigned to
+            var = Interpreter::defineVariable(ctxChain, freeVar.capture,
+                                              rt->newObject());
+        }
+        if (var != nullptr && !var->captured) {
+            Gc::trackVariable(var);
+        }
+        closure.upvalues.push_back(var);
+    }
+    return rt->newObject(std::move(closure));
+}
+
+ContextChain* Interpreter::enterFunc(const Func* f,
+                                     const BoundFunc* closure) {
     ContextChain* funcCtxChain = nullptr;
-    if (!f->name.empty() || f->outerContext == nullptr) {
-        funcCtxChain = new ContextChain();
+    if (!freeChains.empty()) {
+        funcCtxChain = freeChains.back();
+        freeChains.pop_back();
     } else {
-        funcCtxChain = f->outerContext;
+        funcCtxChain = new ContextChain();
     }
     Interpreter::newContext(funcCtxChain);
+    funcCtxChain->back()->bindFrame(frameStack.push(f->frameSize), f);
+    Interpreter::bindUpvalues(funcCtxChain, closure);
+    return funcCtxChain;
+}
 
-    auto* funcCtx = funcCtxChain->back();
-    for (int i = 0; i < f->params.size(); i++) {
-        std::string paramName = f->params[i];
-        // Evaluate argument values from previous context chain and push them
-        // into newly created context chain
-        Object* argValue = args[i]->eval(rt, lastCtxChain);
-        if (argValue->isPrimitive()) {
-            // Pass by value
-            funcCtx->createVariable(paramName, rt->cloneObject(argValue));
-        } else {
-            // Pass by reference
-            funcCtx->createVariable(paramName, argValue);
+void Interpreter::bindUpvalues(ContextChain* funcCtxChain,
+                               const BoundFunc* closure) {
+    if (closure == nullptr) {
+        return;
+    }
+    // Closure sees nothing but its captured variables of the scope that
+    // created it, free variables it's going to define are left local
+    const auto& freeVars = closure->func->freeVars;
+    for (int i = 0; i < (int)closure->upvalues.size(); i++) {
+        if (auto* var = closure->upvalues[i]; var != nullptr) {
+            funcCtxChain->back()->shareVariable(freeVars[i].slot, var);
         }
     }
+}
+
+void Interpreter::leaveFunc(ContextChain* funcCtxChain) {
+    Variable* frame = funcCtxChain->front()->getFrame();
+    Interpreter::leaveContext(funcCtxChain, 0);
+    frameStack.pop(frame);
+    freeChains.push_back(funcCtxChain);
+}
+
+void Interpreter::bindArgument(Runtime* rt,
+                               ContextChain* funcCtxChain,
+                               int index,
+                               Value argValue) {
+    if (argValue.isPrimitive()) {
+        // Pass by value
+        funcCtxChain->back()->createVariable(index, rt->cloneObject(argValue));
+    } else {
+        // Pass by reference
+        funcCtxChain->back()->createVariable(index, argValue);
+    }
+}
+
+Value Interpreter::callFunc(Runtime* rt,
+                            Func* f,
+                            ContextChain* lastCtxChain,
+                            const std::vector<Expression*>& args,
+                            const BoundFunc* closure) {
+    ContextChain* funcCtxChain = Interpreter::enterFunc(f, closure);
+    GcRoot chainRoot(&funcCtxChain);
+    for (int i = 0; i < (int)f->params.size(); i++) {
+        // Evaluate argument values from previous context chain and write them
+        // into slots of parameters in newly created context chain
+        Value argValue = args[i]->eval(rt, lastCtxChain);
+        Interpreter::bindArgument(rt, funcCtxChain, i, argValue);
+    }
+    if (Value ret = Jit::invoke(rt, f, funcCtxChain->back()); ret != nullptr) {
+        Interpreter::leaveFunc(funcCtxChain);
+        return ret;
+    }
 
     // Execute user defined function
-    ExecResult ret(ExecNormal);
-    for (auto& stmt : f->block->stmts) {
-        ret = stmt->interpret(rt, funcCtxChain);
-        if (ret.execType == ExecReturn) {
-            break;
+    for (;;) {
+        Gc::safepoint();
+        ExecResult ret(ExecNormal);
+        for (auto& stmt : f->block->stmts) {
+            ret = stmt->interpret(rt, funcCtxChain);
+            if (ret.execType == ExecReturn) {
+                break;
+            }
+        }
+        if (tailCallee == nullptr) {
+            // Variables that closures captured survive their contexts
+            Interpreter::leaveFunc(funcCtxChain);
+            return ret.retValue;
+        }
+        // Current frame returns whatever its tail call returns, it's no longer
+        // needed, so the callee takes its place instead of growing the stack.
+        // Tail calls only appear in named functions without closures, nothing
+        // else refers to their context chains
+        f = tailCallee;
+        tailCallee = nullptr;
+        ObjectArray argValues = std::move(tailCallArgs);
+        if (Value ret = Jit::invoke(rt, f, argValues.data());
+            ret != nullptr) {
+            Interpreter::leaveFunc(funcCtxChain);
+            return ret;
+        }
+        Interpreter::leaveFunc(funcCtxChain);
+        funcCtxChain = Interpreter::enterFunc(f);
+        for (int i = 0; i < (int)f->params.size(); i++) {
+            Interpreter::bindArgument(rt, funcCtxChain, i, argValues[i]);
         }
     }
-    // Do not free context memory deliberately since we are not ready yet...
-    return ret.retValue;
 }
 
-Object* Interpreter::evalUnaryExpr(Object* lhs, Token opt) {
+Value Interpreter::evalUnaryExpr(Value lhs, Token opt) {
     switch (opt) {
         case TK_MINUS:
-            return lhs->operator-();
+            return lhs.operator-();
         case TK_LOGNOT:
-            return lhs->operator!();
+            return lhs.operator!();
         case TK_BITNOT:
-            return lhs->operator~();
+            return lhs.operator~();
         default:
             panic("unexpected token %d", opt);
     }
@@ -101,64 +224,529 @@ Object* Interpreter::evalUnaryExpr(Object* lhs, Token opt) {
     return lhs;
 }
 
-Object* Interpreter::evalBinaryExpr(Object* lhs, Token opt, Object* rhs) {
+Value Interpreter::evalBinaryExpr(Value lhs, Token opt, Value rhs) {
     switch (opt) {
         case TK_PLUS:
-            return lhs->operator+(rhs);
+            return lhs.operator+(rhs);
         case TK_MINUS:
-            return lhs->operator-(rhs);
+            return lhs.operator-(rhs);
         case TK_TIMES:
-            return lhs->operator*(rhs);
+            return lhs.operator*(rhs);
         case TK_DIV:
-            return lhs->operator/(rhs);
+            return lhs.operator/(rhs);
         case TK_MOD:
-            return lhs->operator%(rhs);
+            return lhs.operator%(rhs);
         case TK_LOGAND:
-            return lhs->operator&&(rhs);
+            return lhs.operator&&(rhs);
         case TK_LOGOR:
-            return lhs->operator||(rhs);
+            return lhs.operator||(rhs);
         case TK_EQ:
-            return lhs->operator==(rhs);
+            return lhs.operator==(rhs);
         case TK_NE:
-            return lhs->operator!=(rhs);
+            return lhs.operator!=(rhs);
             break;
         case TK_GT:
-            return lhs->operator>(rhs);
+            return lhs.operator>(rhs);
         case TK_GE:
-            return lhs->operator>=(rhs);
+            return lhs.operator>=(rhs);
         case TK_LT:
-            return lhs->operator<(rhs);
+            return lhs.operator<(rhs);
         case TK_LE:
-            return lhs->operator<=(rhs);
+            return lhs.operator<=(rhs);
         case TK_BITAND:
-            return lhs->operator&(rhs);
+            return lhs.operator&(rhs);
         case TK_BITOR:
-            return lhs->operator|(rhs);
+            return lhs.operator|(rhs);
         default:
             panic("unexpected token %d", opt);
     }
     return nullptr;
 }
 
-Object* Interpreter::assignment(Token opt, Object* lhs, Object* rhs) {
+//===----------------------------------------------------------------------===//
+// Binary expressions specialized for operand types
+//===----------------------------------------------------------------------===//
+struct IntOperand {
+    static bool accepts(Value object) { return object.isInt(); }
+    static int get(Value object) { return object.asInt(); }
+};
+
+struct DoubleOperand {
+    static bool accepts(Value object) { return object.isDouble(); }
+    static double get(Value object) { return object.asDouble(); }
+};
+
+struct StringOperand {
+    static bool accepts(Value object) { return object.isString(); }
+    static const ObjectString& get(Value object) {
+        return object.asString();
+    }
+};
+
+struct BoolOperand {
+    static bool accepts(Value object) { return object.isBool(); }
+    static bool get(Value object) { return object.asBool(); }
+};
+
+struct Concatenation {
+    ObjectString operator()(const ObjectString& lhs,
+                            const ObjectString& rhs) const {
+        return concatString(lhs, rhs);
+    }
+};
+
+using IntAddNode = TypedBinaryExpr<IntOperand, std::plus<>>;
+using IntSubNode = TypedBinaryExpr<IntOperand, std::minus<>>;
+using IntMulNode = TypedBinaryExpr<IntOperand, std::multiplies<>>;
+using IntDivNode = TypedBinaryExpr<IntOperand, std::divides<>>;
+using IntModNode = TypedBinaryExpr<IntOperand, std::modulus<>>;
+using IntBitAndNode = TypedBinaryExpr<IntOperand, std::bit_and<>>;
+using IntBitOrNode = TypedBinaryExpr<IntOperand, std::bit_or<>>;
+using IntLtNode = TypedBinaryExpr<IntOperand, std::less<>>;
+using IntLeNode = TypedBinaryExpr<IntOperand, std::less_equal<>>;
+using IntGtNode = TypedBinaryExpr<IntOperand, std::greater<>>;
+using IntGeNode = TypedBinaryExpr<IntOperand, std::greater_equal<>>;
+using IntEqNode = TypedBinaryExpr<IntOperand, std::equal_to<>>;
+using IntNeNode = TypedBinaryExpr<IntOperand, std::not_equal_to<>>;
+using DoubleAddNode = TypedBinaryExpr<DoubleOperand, std::plus<>>;
+using DoubleSubNode = TypedBinaryExpr<DoubleOperand, std::minus<>>;
+using DoubleMulNode = TypedBinaryExpr<DoubleOperand, std::multiplies<>>;
+using DoubleDivNode = TypedBinaryExpr<DoubleOperand, std::divides<>>;
+using DoubleLtNode = TypedBinaryExpr<DoubleOperand, std::less<>>;
+using DoubleLeNode = TypedBinaryExpr<DoubleOperand, std::less_equal<>>;
+using DoubleGtNode = TypedBinaryExpr<DoubleOperand, std::greater<>>;
+using DoubleGeNode = TypedBinaryExpr<DoubleOperand, std::greater_equal<>>;
+using DoubleEqNode = TypedBinaryExpr<DoubleOperand, std::equal_to<>>;
+using DoubleNeNode = TypedBinaryExpr<DoubleOperand, std::not_equal_to<>>;
+using StringConcatNode = TypedBinaryExpr<StringOperand, Concatenation>;
+using StringEqNode = TypedBinaryExpr<StringOperand, std::equal_to<>>;
+using StringNeNode = TypedBinaryExpr<StringOperand, std::not_equal_to<>>;
+using BoolAndNode = TypedBinaryExpr<BoolOperand, std::logical_and<>>;
+using BoolOrNode = TypedBinaryExpr<BoolOperand, std::logical_or<>>;
+using BoolEqNode = TypedBinaryExpr<BoolOperand, std::equal_to<>>;
+using BoolNeNode = TypedBinaryExpr<BoolOperand, std::not_equal_to<>>;
+
+template <typename Operand, typename Operation>
+Value TypedBinaryExpr<Operand, Operation>::eval(Runtime* rt,
+                                                ContextChain* ctxChain) {
+    Value lhsObject = original->lhs->eval(rt, ctxChain);
+    GcRoot lhsRoot(&lhsObject);
+    Value rhsObject = original->rhs->eval(rt, ctxChain);
+    if (!Operand::accepts(lhsObject) || !Operand::accepts(rhsObject)) {
+        return despecialize(lhsObject, rhsObject);
+    }
+    return rt->newObject(
+        Operation()(Operand::get(lhsObject), Operand::get(rhsObject)));
+}
+
+Value SpecializedBinaryExpr::despecialize(Value lhsObject, Value rhsObject) {
+    original->generic = true;
+    *original->slot = original;
+    return original->compute(lhsObject, rhsObject);
+}
+
+SpecializedBinaryExpr* Interpreter::specializeBinaryExpr(BinaryExpr* node,
+                                                         Value lhs,
+                                                         Value rhs) {
+    if (node->rhs == nullptr) {
+        return nullptr;
+    }
+    if (lhs.isInt() && rhs.isInt()) {
+        switch (node->opt) {
+            case TK_PLUS:
+                return new IntAddNode(node);
+            case TK_MINUS:
+                return new IntSubNode(node);
+            case TK_TIMES:
+                return new IntMulNode(node);
+            case TK_DIV:
+                return new IntDivNode(node);
+            case TK_MOD:
+                return new IntModNode(node);
+            case TK_BITAND:
+                return new IntBitAndNode(node);
+            case TK_BITOR:
+                return new IntBitOrNode(node);
+            case TK_LT:
+                return new IntLtNode(node);
+            case TK_LE:
+                return new IntLeNode(node);
+            case TK_GT:
+                return new IntGtNode(node);
+            case TK_GE:
+                return new IntGeNode(node);
+            case TK_EQ:
+                return new IntEqNode(node);
+            case TK_NE:
+                return new IntNeNode(node);
+            default:
+                return nullptr;
+        }
+    } else if (lhs.isDouble() && rhs.isDouble()) {
+        switch (node->opt) {
+            case TK_PLUS:
+                return new DoubleAddNode(node);
+            case TK_MINUS:
+                return new DoubleSubNode(node);
+            case TK_TIMES:
+                return new DoubleMulNode(node);
+            case TK_DIV:
+                return new DoubleDivNode(node);
+            case TK_LT:
+                return new DoubleLtNode(node);
+            case TK_LE:
+                return new DoubleLeNode(node);
+            case TK_GT:
+                return new DoubleGtNode(node);
+            case TK_GE:
+                return new DoubleGeNode(node);
+            case TK_EQ:
+                return new DoubleEqNode(node);
+            case TK_NE:
+                return new DoubleNeNode(node);
+            default:
+                return nullptr;
+        }
+    } else if (lhs.isString() && rhs.isString()) {
+        switch (node->opt) {
+            case TK_PLUS:
+                return new StringConcatNode(node);
+            case TK_EQ:
+                return new StringEqNode(node);
+            case TK_NE:
+                return new StringNeNode(node);
+            default:
+                return nullptr;
+        }
+    } else if (lhs.isBool() && rhs.isBool()) {
+        switch (node->opt) {
+            case TK_LOGAND:
+                return new BoolAndNode(node);
+            case TK_LOGOR:
+                return new BoolOrNode(node);
+            case TK_EQ:
+                return new BoolEqNode(node);
+            case TK_NE:
+                return new BoolNeNode(node);
+            default:
+                return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+//===----------------------------------------------------------------------===//
+// Fused expressions, see SuperinstructionFuser
+//===----------------------------------------------------------------------===//
+static bool compareInts(Token opt, int lhs, int rhs, bool* result) {
+    switch (opt) {
+        case TK_LT:
+            *result = lhs < rhs;
+            return true;
+        case TK_LE:
+            *result = lhs <= rhs;
+            return true;
+        case TK_GT:
+            *result = lhs > rhs;
+            return true;
+        case TK_GE:
+            *result = lhs >= rhs;
+            return true;
+        case TK_EQ:
+            *result = lhs == rhs;
+            return true;
+        case TK_NE:
+            *result = lhs != rhs;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Value of variable or int literal, nullptr if it's neither of them
+static Value operandOf(Expression* node, ContextChain* ctxChain) {
+    if (typeid(*node) != typeid(NameExpr) ||
+        !static_cast<NameExpr*>(node)->addr.isResolved()) {
+        return nullptr;
+    }
+    auto* var = Interpreter::lookupVariable(
+        ctxChain, static_cast<NameExpr*>(node)->addr);
+    return var != nullptr ? var->value : nullptr;
+}
+
+Value IncrementExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    auto* var = Interpreter::lookupVariable(
+        ctxChain, static_cast<NameExpr*>(assign->lhs)->addr);
+    if (var == nullptr || !var->value.isInt()) {
+        return assign->eval(rt, ctxChain);
+    }
+    if (literal == nullptr) {
+        literal = assign->rhs->eval(rt, ctxChain);
+    }
+    var->value = rt->newObject(var->value.asInt() + delta);
+    return literal;
+}
+
+Value CompareExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    Value lhsObject = operandOf(binary->lhs, ctxChain);
+    if (lhsObject == nullptr || !lhsObject.isInt()) {
+        return binary->eval(rt, ctxChain);
+    }
+    int rhsValue;
+    if (typeid(*binary->rhs) == typeid(IntExpr)) {
+        rhsValue = static_cast<IntExpr*>(binary->rhs)->literal;
+    } else if (Value rhsObject = operandOf(binary->rhs, ctxChain);
+               rhsObject != nullptr && rhsObject.isInt()) {
+        rhsValue = rhsObject.asInt();
+    } else {
+        return binary->eval(rt, ctxChain);
+    }
+    bool result = false;
+    compareInts(binary->opt, lhsObject.asInt(), rhsValue, &result);
+    return rt->newObject(result);
+}
+
+Value EqualsLiteralExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    if (literal == nullptr) {
+        literal = Gc::pin(binary->rhs->eval(rt, ctxChain));
+    }
+    Value lhsObject = operandOf(binary->lhs, ctxChain);
+    if (lhsObject == nullptr || lhsObject.getType() != literal.getType()) {
+        return binary->eval(rt, ctxChain);
+    }
+    bool equals = lhsObject.equalsDeep(literal);
+    return rt->newObject(binary->opt == TK_EQ ? equals : !equals);
+}
+
+Value IndexBinaryExpr::element(IndexExpr* node, ContextChain* ctxChain) {
+    auto* var = Interpreter::lookupVariable(ctxChain, node->addr);
+    if (var == nullptr) {
+        return nullptr;
+    }
+    int idx;
+    if (typeid(*node->index) == typeid(IntExpr)) {
+        idx = static_cast<IntExpr*>(node->index)->literal;
+    } else if (Value idxObject = operandOf(node->index, ctxChain);
+               idxObject != nullptr && idxObject.isInt()) {
+        idx = idxObject.asInt();
+    } else {
+        return nullptr;
+    }
+    return Interpreter::lookupElement(node->identName, var, idx, node->line,
+                                      node->column);
+}
+
+Value IndexBinaryExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    Value lhsObject = element(static_cast<IndexExpr*>(binary->lhs), ctxChain);
+    Value rhsObject =
+        lhsObject != nullptr
+            ? element(static_cast<IndexExpr*>(binary->rhs), ctxChain)
+            : nullptr;
+    if (rhsObject == nullptr) {
+        return binary->eval(rt, ctxChain);
+    }
+    if (lhsObject.isInt() && rhsObject.isInt()) {
+        int lhs = lhsObject.asInt();
+        int rhs = rhsObject.asInt();
+        if (bool result; compareInts(binary->opt, lhs, rhs, &result)) {
+            return rt->newObject(result);
+        }
+        switch (binary->opt) {
+            case TK_PLUS:
+                return rt->newObject(lhs + rhs);
+            case TK_MINUS:
+                return rt->newObject(lhs - rhs);
+            case TK_TIMES:
+                return rt->newObject(lhs * rhs);
+            default:
+                break;
+        }
+    }
+    return binary->compute(lhsObject, rhsObject);
+}
+
+Value AppendExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    Address addr = static_cast<NameExpr*>(assign->lhs)->addr;
+    auto* var = Interpreter::lookupVariable(ctxChain, addr);
+    if (var == nullptr || !var->value.isString()) {
+        return assign->eval(rt, ctxChain);
+    }
+    // Value of variable is taken before evaluating the rest as the original
+    // binary expression does
+    Value lhsObject = var->value;
+    GcRoot lhsRoot(&lhsObject);
+    Value rhsObject = concat->rhs->eval(rt, ctxChain);
+    Value result = rhsObject.isString()
+                       ? rt->newObject(concatString(lhsObject.asString(),
+                                                    rhsObject.asString()))
+                       : concat->compute(lhsObject, rhsObject);
+    var->value = result;
+    Gc::writeBarrier(var);
+    return result;
+}
+
+Value CaseLiteralExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    if (value == nullptr) {
+        value = Gc::pin(original->eval(rt, ctxChain));
+    }
+    return value;
+}
+
+Value Interpreter::assignment(Token opt, Value lhs, Value rhs) {
     switch (opt) {
         case TK_ASSIGN:
             return rhs;
         case TK_PLUS_AGN:
-            return lhs->operator+(rhs);
+            return lhs.operator+(rhs);
         case TK_MINUS_AGN:
-            return lhs->operator-(rhs);
+            return lhs.operator-(rhs);
         case TK_TIMES_AGN:
-            return lhs->operator*(rhs);
+            return lhs.operator*(rhs);
         case TK_DIV_AGN:
-            return lhs->operator/(rhs);
+            return lhs.operator/(rhs);
         case TK_MOD_AGN:
-            return lhs->operator%(rhs);
+            return lhs.operator%(rhs);
         default:
             panic("unexpected branch reached");
     }
 }
 
+Variable* Interpreter::defineVariable(ContextChain* ctxChain,
+                                      Address addr,
+                                      Value value) {
+    auto* ctx = (*ctxChain)[ctxChain->size() - 1 - addr.depth];
+    return ctx->createVariable(addr.slot, value);
+}
+
+Value Interpreter::lookupName(Runtime* rt,
+                              ContextChain* ctxChain,
+                              Symbol identName,
+                              Address addr,
+                              int line,
+                              int column) {
+    if (addr.isResolved()) {
+        if (auto* var = Interpreter::lookupVariable(ctxChain, addr);
+            var != nullptr) {
+            return var->value;
+        }
+    }
+    // Closures refer to named functions as their free variables as well
+    auto* globalFunc = rt->getFunction(identName);
+    if (globalFunc != nullptr) {
+        return rt->newObject(BoundFunc{globalFunc, {}});
+    }
+
+    panic(
+        "use of undefined variable \"%s\" at line %d, col "
+        "%d\n",
+        identName.c_str(), line, column);
+}
+
+Value Interpreter::lookupElement(Symbol identName,
+                                 Variable* var,
+                                 Value idx,
+                                 int line,
+                                 int column) {
+    if (!idx.isInt()) {
+        panic(
+            "expects int type within indexing "
+            "expression at "
+            "line %d, col %d\n",
+            line, column);
+    }
+    return Interpreter::lookupElement(identName, var, idx.asInt(), line,
+                                      column);
+}
+
+Value Interpreter::lookupElement(Symbol identName,
+                                 Variable* var,
+                                 int idx,
+                                 int line,
+                                 int column) {
+    if (!var->value.isArray()) {
+        panic(
+            "expects array type of variable %s "
+            "at line %d, col %d\n",
+            identName.c_str(), line, column);
+    }
+    if (idx >= var->value.asArray().size()) {
+        panic(
+            "index %d out of range at line %d, col "
+            "%d\n",
+            idx, line, column);
+    }
+    return var->value.asArray()[idx];
+}
+
+void Interpreter::assignVariable(ContextChain* ctxChain,
+                                 Address addr,
+                                 Token opt,
+                                 Value rhs) {
+    if (auto* var = Interpreter::lookupVariable(ctxChain, addr);
+        var != nullptr) {
+        var->value = Interpreter::assignment(opt, var->value, rhs);
+        Gc::writeBarrier(var);
+        return;
+    }
+    Interpreter::defineVariable(ctxChain, addr, rhs);
+}
+
+void Interpreter::assignElement(ContextChain* ctxChain,
+                                Symbol identName,
+                                Address addr,
+                                Token opt,
+                                Value index,
+                                Value rhs,
+                                int line,
+                                int column) {
+    if (!index.isInt()) {
+        panic(
+            "expects int type when applying indexing "
+            "to variable %s at line %d, col %d\n",
+            identName.c_str(), line, column);
+    }
+    if (auto* var = Interpreter::lookupVariable(ctxChain, addr);
+        var != nullptr) {
+        if (!var->value.isArray()) {
+            panic(
+                "expects array type of variable %s "
+                "at line %d, col %d\n",
+                identName.c_str(), line, column);
+        }
+        auto temp = var->value.asArray();
+        Value element = Interpreter::assignment(opt, temp[index.asInt()], rhs);
+        temp[index.asInt()] = element;
+        var->value.resetObject(std::move(temp));
+        Gc::writeBarrier(var->value, element);
+        return;
+    }
+    Interpreter::defineVariable(ctxChain, addr, rhs);
+}
+
+Value Interpreter::lookupClosure(ContextChain* ctxChain, Address addr) {
+    if (!addr.isResolved()) {
+        return nullptr;
+    }
+    if (auto* var = Interpreter::lookupVariable(ctxChain, addr);
+        var != nullptr && var->value.isClosure()) {
+        return var->value;
+    }
+    return nullptr;
+}
+
+void Interpreter::resolveCall(Runtime* rt,
+                              Symbol funcName,
+                              CallCache* cache) {
+    if (cache->resolved) {
+        return;
+    }
+    cache->builtin = rt->getBuiltinFunction(funcName);
+    if (cache->builtin == nullptr) {
+        cache->func = rt->getFunction(funcName);
+    }
+    cache->resolved = true;
+}
+
 //===----------------------------------------------------------------------===//
 // Interpret various statements within given runtime and context chain. Runtime
 // holds all necessary data that widely used in every context. Context chain
@@ -166,15 +754,18 @@ Object* Interpreter::assignment(Token opt, Object* lhs, Object* rhs) {
 //===----------------------------------------------------------------------===//
 ExecResult IfStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
     ExecResult ret(ExecNormal);
-    Object* condition = this->cond->eval(rt, ctxChain);
-    if (!condition->isBool()) {
+    Value condition = this->cond->eval(rt, ctxChain);
+    if (!condition.isBool()) {
         panic(
             "expects bool type in while condition at line %d, "
             "col %d\n",
             line, column);
     }
-    if (condition->asBool()) {
-        Interpreter::newContext(ctxChain);
+    if (Tracer::recording != nullptr) {
+        Tracer::recordBranch(this, condition.asBool());
+    }
+    if (condition.asBool()) {
+        Scope scope(ctxChain);
         for (auto& stmt : block->stmts) {
             ret = stmt->interpret(rt, ctxChain);
             if (ret.execType == ExecReturn) {
@@ -188,7 +779,7 @@ ExecResult IfStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
 
     } else {
         if (elseBlock != nullptr) {
-            Interpreter::newContext(ctxChain);
+            Scope scope(ctxChain);
             for (auto& elseStmt : elseBlock->stmts) {
                 ret = elseStmt->interpret(rt, ctxChain);
                 if (ret.execType == ExecReturn) {
@@ -207,10 +798,16 @@ ExecResult IfStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
 ExecResult WhileStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
     ExecResult ret{ExecNormal};
 
-    Interpreter::newContext(ctxChain);
-    Object* condition = this->cond->eval(rt, ctxChain);
+    Scope scope(ctxChain);
+    Value condition = this->cond->eval(rt, ctxChain);
+    if (!condition.isBool()) {
+        panic(
+            "expects bool type in while condition at line %d, "
+            "col %d\n",
+            line, column);
+    }
 
-    while (condition->asBool()) {
+    while (condition.asBool()) {
         for (auto& stmt : block->stmts) {
             ret = stmt->interpret(rt, ctxChain);
             if (ret.execType == ExecReturn) {
@@ -225,8 +822,12 @@ ExecResult WhileStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
                 break;
             }
         }
+        if (Tracer::onBackEdge(rt, ctxChain, this)) {
+            break;
+        }
+        Gc::safepoint();
         condition = this->cond->eval(rt, ctxChain);
-        if (!condition->isBool()) {
+        if (!condition.isBool()) {
             panic(
                 "expects bool type in while condition at line %d, "
                 "col %d\n",
@@ -242,11 +843,17 @@ outside:
 ExecResult ForStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
     ExecResult ret{ExecNormal};
 
-    Interpreter::newContext(ctxChain);
+    Scope scope(ctxChain);
     this->init->eval(rt, ctxChain);
-    Object* condition = this->cond->eval(rt, ctxChain);
+    Value condition = this->cond->eval(rt, ctxChain);
+    if (!condition.isBool()) {
+        panic(
+            "expects bool type in while condition at line %d, "
+            "col %d\n",
+            line, column);
+    }
 
-    while (condition->asBool()) {
+    while (condition.asBool()) {
         for (auto& stmt : block->stmts) {
             ret = stmt->interpret(rt, ctxChain);
             if (ret.execType == ExecReturn) {
@@ -259,10 +866,14 @@ ExecResult ForStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
                 break;
             }
         }
+        if (Tracer::onBackEdge(rt, ctxChain, this)) {
+            break;
+        }
+        Gc::safepoint();
 
         this->post->eval(rt, ctxChain);
         condition = this->cond->eval(rt, ctxChain);
-        if (!condition->isBool()) {
+        if (!condition.isBool()) {
             panic(
                 "expects bool type in while condition at line %d, "
                 "col %d\n",
@@ -278,23 +889,28 @@ outside:
 ExecResult ForEachStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
     ExecResult ret{ExecNormal};
 
-    Interpreter::newContext(ctxChain);
+    Scope scope(ctxChain);
 
-    // Save current context for further iterator updating, we should not expect
-    // to call deque.back() to get this since later statement interpretation
-    // might push new context into context chain
-    auto& currentCtx = ctxChain->back();
-    currentCtx->createVariable(this->identName, rt->newObject());
-    Object* listV = this->list->eval(rt, ctxChain);
-    if (!listV->isArray()) {
+    // Save iterator variable for further updating, we should not expect to
+    // lookup it from context chain since later statement interpretation might
+    // push new context into context chain
+    auto* iterVar =
+        Interpreter::defineVariable(ctxChain, this->addr, rt->newObject());
+    Value listV = this->list->eval(rt, ctxChain);
+    if (!listV.isArray()) {
         panic(
             "expects array type within foreach statement at line "
             "%d, col %d\n",
             line, column);
     }
-    auto listValues = listV->asArray();
+    // Elements are iterated over as they were, whatever the body does to the
+    // array
+    auto listValues = listV.asArray();
+    GcRoot listRoot(&listValues);
     for (auto val : listValues) {
-        currentCtx->getVariable(identName)->value = val;
+        iterVar->value = val;
+        Gc::writeBarrier(iterVar);
+        Gc::safepoint();
 
         for (auto stmt : this->block->stmts) {
             ret = stmt->interpret(rt, ctxChain);
@@ -318,16 +934,17 @@ outside:
 ExecResult MatchStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
     ExecResult ret{ExecNormal};
 
-    Object* condition =
+    Value condition =
         cond != nullptr ? this->cond->eval(rt, ctxChain) : rt->newObject(true);
+    GcRoot conditionRoot(&condition);
 
     for (const auto& [theCase, theBranch, isAny] : this->matches) {
         // We must first check if it's an any(_) match because the later one
         // will actually evaluate the value of case expression, that is, the
         // identifier _ will be evaluated and might cause undefined variable
         // error.
-        if (isAny || condition->equalsDeep(theCase->eval(rt, ctxChain))) {
-            Interpreter::newContext(ctxChain);
+        if (isAny || condition.equalsDeep(theCase->eval(rt, ctxChain))) {
+            Scope scope(ctxChain);
             for (auto stmt : theBranch->stmts) {
                 ret = stmt->interpret(rt, ctxChain);
             }
@@ -348,8 +965,29 @@ ExecResult SimpleStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
 }
 
 ExecResult ReturnStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
+    if (FunCallExpr* call = this->tailCall; call != nullptr) {
+        Interpreter::resolveCall(rt, call->funcName, &call->cache);
+        if (Func* callee = call->cache.func; callee != nullptr) {
+            if (callee->params.size() != call->args.size()) {
+                panic(
+                    "expects %d arguments but got %d at line %d, "
+                    "col %d\n",
+                    (int)callee->params.size(), (int)call->args.size(),
+                    call->line, call->column);
+            }
+            // Leave the call to frame of current function
+            ObjectArray argValues;
+            GcRoot argsRoot(&argValues);
+            for (auto* arg : call->args) {
+                argValues.push_back(arg->eval(rt, ctxChain));
+            }
+            Interpreter::tailCallArgs = std::move(argValues);
+            Interpreter::tailCallee = callee;
+            return ExecResult(ExecReturn, nullptr);
+        }
+    }
     if (this->ret != nullptr) {
-        Object* retVal = this->ret->eval(rt, ctxChain);
+        Value retVal = this->ret->eval(rt, ctxChain);
         return ExecResult(ExecReturn, retVal);
     } else {
         return ExecResult(ExecReturn, nullptr);
@@ -369,32 +1007,33 @@ ExecResult ContinueStmt::interpret(Runtime* rt, ContextChain* ctxChain) {
 // contains evaluated data and corresponding data type, it represents sorts
 // of(also all) data type in nyx and can get value by interpreter directly.
 //===----------------------------------------------------------------------===//
-Object* NullExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+Value NullExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     return rt->newObject();
 }
 
-Object* BoolExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+Value BoolExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     return rt->newObject(this->literal);
 }
 
-Object* CharExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+Value CharExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     return rt->newObject(this->literal);
 }
 
-Object* IntExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+Value IntExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     return rt->newObject(this->literal);
 }
 
-Object* DoubleExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+Value DoubleExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     return rt->newObject(this->literal);
 }
 
-Object* StringExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+Value StringExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     return rt->newObject(this->literal);
 }
 
-Object* ArrayExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+Value ArrayExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     ObjectArray elements;
+    GcRoot elementsRoot(&elements);
     for (auto& e : this->literal) {
         elements.push_back(e->eval(rt, ctxChain));
     }
@@ -402,56 +1041,20 @@ Object* ArrayExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     return rt->newObject(elements);
 }
 
-Object* ClosureExpr::eval(Runtime* rt, ContextChain* ctxChain) {
-    auto* f = new Func;
-    f->params = std::move(this->params);
-    f->block = this->block;
-    f->outerContext = ctxChain;  // Save outer context for closure
-    return rt->newObject(*f);
+Value ClosureExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    return Interpreter::newClosure(rt, ClosureConverter::prototype(this),
+                                   ctxChain);
 }
 
-Object* NameExpr::eval(Runtime* rt, ContextChain* ctxChain) {
-    for (auto p = ctxChain->crbegin(); p != ctxChain->crend(); ++p) {
-        auto* ctx = *p;
-        if (auto* var = ctx->getVariable(this->identName); var != nullptr) {
-            return var->value;
-        }
-        if (auto* var = ctx->getFunction(this->identName); var != nullptr) {
-            return rt->newObject(*var);
-        }
-    }
-    // Lookup function in global scope
-    auto* globalFunc = rt->getFunction(this->identName);
-    if (globalFunc != nullptr) {
-        return rt->newObject(*globalFunc);
-    }
-
-    panic(
-        "use of undefined variable \"%s\" at line %d, col "
-        "%d\n",
-        identName.c_str(), this->line, this->column);
+Value NameExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    return Interpreter::lookupName(rt, ctxChain, identName, addr, line, column);
 }
 
-Object* IndexExpr::eval(Runtime* rt, ContextChain* ctxChain) {
-    for (auto p = ctxChain->crbegin(); p != ctxChain->crend(); ++p) {
-        auto* ctx = *p;
-        if (auto* var = ctx->getVariable(this->identName); var != nullptr) {
-            auto idx = this->index->eval(rt, ctxChain);
-            if (!idx->isInt()) {
-                panic(
-                    "expects int type within indexing "
-                    "expression at "
-                    "line %d, col %d\n",
-                    line, column);
-            }
-            if (idx->asInt() >= var->value->asArray().size()) {
-                panic(
-                    "index %d out of range at line %d, col "
-                    "%d\n",
-                    idx->asInt(), line, column);
-            }
-            return var->value->asArray()[idx->asInt()];
-        }
+Value IndexExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    if (auto* var = Interpreter::lookupVariable(ctxChain, addr);
+        var != nullptr) {
+        auto idx = this->index->eval(rt, ctxChain);
+        return Interpreter::lookupElement(identName, var, idx, line, column);
     }
     panic(
         "use of undefined variable \"%s\" at line %d, col "
@@ -459,47 +1062,17 @@ Object* IndexExpr::eval(Runtime* rt, ContextChain* ctxChain) {
         identName.c_str(), this->line, this->column);
 }
 
-Object* AssignExpr::eval(Runtime* rt, ContextChain* ctxChain) {
-    Object* rhs = this->rhs->eval(rt, ctxChain);
+Value AssignExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    Value rhs = this->rhs->eval(rt, ctxChain);
+    GcRoot rhsRoot(&rhs);
     if (typeid(*lhs) == typeid(NameExpr)) {
-        std::string identName = dynamic_cast<NameExpr*>(lhs)->identName;
-
-        for (auto p = ctxChain->crbegin(); p != ctxChain->crend(); ++p) {
-            if (auto* var = (*p)->getVariable(identName); var != nullptr) {
-                var->value =
-                    Interpreter::assignment(this->opt, var->value, rhs);
-                return rhs;
-            }
-        }
-
-        (ctxChain->back())->createVariable(identName, rhs);
+        Interpreter::assignVariable(ctxChain, static_cast<NameExpr*>(lhs)->addr,
+                                    opt, rhs);
     } else if (typeid(*lhs) == typeid(IndexExpr)) {
-        std::string identName = dynamic_cast<IndexExpr*>(lhs)->identName;
-        Object* index =
-            dynamic_cast<IndexExpr*>(lhs)->index->eval(rt, ctxChain);
-        if (!index->isInt()) {
-            panic(
-                "expects int type when applying indexing "
-                "to variable %s at line %d, col %d\n",
-                identName.c_str(), line, column);
-        }
-        for (auto p = ctxChain->crbegin(); p != ctxChain->crend(); ++p) {
-            if (auto* var = (*p)->getVariable(identName); var != nullptr) {
-                if (!var->value->isArray()) {
-                    panic(
-                        "expects array type of variable %s "
-                        "at line %d, col %d\n",
-                        identName.c_str(), line, column);
-                }
-                auto temp = var->value->asArray();
-                temp[index->asInt()] = Interpreter::assignment(
-                    this->opt, temp[index->asInt()], rhs);
-                var->value->resetObject(temp);
-                return rhs;
-            }
-        }
-
-        (ctxChain->back())->createVariable(identName, rhs);
+        auto* target = static_cast<IndexExpr*>(lhs);
+        Value index = target->index->eval(rt, ctxChain);
+        Interpreter::assignElement(ctxChain, target->identName, target->addr,
+                                   opt, index, rhs, line, column);
     } else {
         panic("can not assign to %s at line %d, col %d\n", typeid(lhs).name(),
               line, column);
@@ -507,19 +1080,19 @@ Object* AssignExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     return rhs;
 }
 
-Object* FunCallExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+Value FunCallExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     if (this->receiver != nullptr) {
         // A method call, find method from receiver type
-        Object* recv = receiver->eval(rt, ctxChain);
+        Value recv = receiver->eval(rt, ctxChain);
         // TODO: this dirty hack should be refactor out once we implement OOP
         // mechanism
-        if (recv->isArray()) {
-            if (funcName == "length") {
-                return rt->newObject((int)(recv->asArray().size()));
+        if (recv.isArray()) {
+            if (funcName == Runtime::LengthMethod) {
+                return rt->newObject((int)(recv.asArray().size()));
             }
-        } else if (recv->isString()) {
-            if (funcName == "length") {
-                return rt->newObject((int)(recv->asString().length()));
+        } else if (recv.isString()) {
+            if (funcName == Runtime::LengthMethod) {
+                return rt->newObject((int)(recv.asString().length()));
             }
         }
     }
@@ -527,9 +1100,10 @@ Object* FunCallExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     // firstly then find it as user defined function, the lookup order implies
     // builtin function has higher priority when we have the same name of user
     // defined ones
-    if (auto* builtinFunc = rt->getBuiltinFunction(this->funcName);
-        builtinFunc != nullptr) {
+    Interpreter::resolveCall(rt, this->funcName, &this->cache);
+    if (auto* builtinFunc = this->cache.builtin; builtinFunc != nullptr) {
         ObjectArray arguments;
+        GcRoot argsRoot(&arguments);
         for (auto e : this->args) {
             arguments.push_back(e->eval(rt, ctxChain));
         }
@@ -537,8 +1111,7 @@ Object* FunCallExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     }
 
     // Find it as a user defined function
-    if (auto* normalFunc = rt->getFunction(this->funcName);
-        normalFunc != nullptr) {
+    if (auto* normalFunc = this->cache.func; normalFunc != nullptr) {
         if (normalFunc->params.size() != this->args.size()) {
             panic(
                 "expects %d arguments but got %d at line %d, "
@@ -549,19 +1122,18 @@ Object* FunCallExpr::eval(Runtime* rt, ContextChain* ctxChain) {
     }
 
     // Find it as a closure function
-    for (auto ctx = ctxChain->crbegin(); ctx != ctxChain->crend(); ++ctx) {
-        if (auto* closure = (*ctx)->getVariable(this->funcName);
-            closure != nullptr && closure->value->isClosure()) {
-            auto closureFunc = closure->value->asClosure();
-            if (closureFunc.params.size() != this->args.size()) {
-                panic(
-                    "expects %d arguments but got %d at line "
-                    "%d, col %d\n",
-                    closureFunc.params.size(), this->args.size(), line, column);
-            }
-            return Interpreter::callFunc(rt, &closureFunc, ctxChain,
-                                         this->args);
+    if (auto closure = Interpreter::lookupClosure(ctxChain, this->addr);
+        closure != nullptr) {
+        auto* closureFunc = closure.asClosure();
+        if (closureFunc->func->params.size() != this->args.size()) {
+            panic(
+                "expects %d arguments but got %d at line "
+                "%d, col %d\n",
+                closureFunc->func->params.size(), this->args.size(), line,
+                column);
         }
+        return Interpreter::callFunc(rt, closureFunc->func, ctxChain,
+                                     this->args, closureFunc);
     }
 
     // Panicking since this function was not found
@@ -569,21 +1141,60 @@ Object* FunCallExpr::eval(Runtime* rt, ContextChain* ctxChain) {
           line, column);
 }
 
-Object* BinaryExpr::eval(Runtime* rt, ContextChain* ctxChain) {
-    Object* lhsObject =
+Value InlinedCallExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    // Evaluate arguments and bind them as Interpreter::callFunc does for named
+    // functions, except that they live in a new context of the caller
+    ObjectArray argValues;
+    GcRoot argsRoot(&argValues);
+    for (auto* arg : call->args) {
+        argValues.push_back(arg->eval(rt, ctxChain));
+    }
+    size_t depth = ctxChain->size();
+    Interpreter::newContext(ctxChain);
+    for (int i = 0; i < (int)params.size(); i++) {
+        Interpreter::bindArgument(rt, ctxChain, i, argValues[i]);
+    }
+
+    ExecResult ret(ExecNormal);
+    for (auto* stmt : block->stmts) {
+        ret = stmt->interpret(rt, ctxChain);
+        if (ret.execType == ExecReturn) {
+            break;
+        }
+    }
+
+    Interpreter::leaveContext(ctxChain, depth);
+    return ret.retValue;
+}
+
+Value BinaryExpr::eval(Runtime* rt, ContextChain* ctxChain) {
+    Value lhsObject =
         this->lhs ? this->lhs->eval(rt, ctxChain) : rt->newObject();
-    Object* rhsObject =
+    GcRoot lhsRoot(&lhsObject);
+    Value rhsObject =
         this->rhs ? this->rhs->eval(rt, ctxChain) : rt->newObject();
-    Token exprOpt = this->opt;
 
-    if (!lhsObject->isNull() && rhsObject->isNull()) {
-        return Interpreter::evalUnaryExpr(lhsObject, exprOpt);
+    if (this->slot != nullptr && !this->generic) {
+        if (auto* node =
+                Interpreter::specializeBinaryExpr(this, lhsObject, rhsObject);
+            node != nullptr) {
+            *this->slot = node;
+        } else {
+            this->generic = true;
+        }
+    }
+    return compute(lhsObject, rhsObject);
+}
+
+Value BinaryExpr::compute(Value lhsObject, Value rhsObject) const {
+    if (!lhsObject.isNull() && rhsObject.isNull()) {
+        return Interpreter::evalUnaryExpr(lhsObject, this->opt);
     }
 
-    return Interpreter::evalBinaryExpr(lhsObject, exprOpt, rhsObject);
+    return Interpreter::evalBinaryExpr(lhsObject, this->opt, rhsObject);
 }
 
-Object* Expression::eval(Runtime* rt, ContextChain* ctxChain) {
+Value Expression::eval(Runtime* rt, ContextChain* ctxChain) {
     panic(
         "abstract expression at line %d, "
         "col "
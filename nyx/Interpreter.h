@@ -39,17 +39,121 @@ public:
 public:
     static void newContext(ContextChain* ctxChain);
 
-    static Object* callFunc(Runtime* rt,
-                            Func* f,
-                            ContextChain* lastCtxChain,
-                            std::vector<Expression*> args);
+    // Pop contexts of blocks that have been left until depth of them are left
+    static void leaveContext(ContextChain* ctxChain, size_t depth);
 
-    static Object* evalBinaryExpr(Object* lhs, Token opt, Object* rhs);
+    static Value callFunc(Runtime* rt,
+                          Func* f,
+                          ContextChain* lastCtxChain,
+                          const std::vector<Expression*>& args,
+                          const BoundFunc* closure = nullptr);
 
-    static Object* evalUnaryExpr(Object* lhs, Token opt);
+    static Value evalBinaryExpr(Value lhs, Token opt, Value rhs);
 
-    static Object* assignment(Token opt, Object* lhs, Object* rhs);
+    static Value evalUnaryExpr(Value lhs, Token opt);
+
+    static SpecializedBinaryExpr* specializeBinaryExpr(BinaryExpr* node,
+                                                       Value lhs,
+                                                       Value rhs);
+
+    static Value assignment(Token opt, Value lhs, Value rhs);
+
+    // Variable at addr, or nullptr if it has not been defined yet
+    static Variable* lookupVariable(ContextChain* ctxChain, Address addr) {
+        auto* ctx = (*ctxChain)[ctxChain->size() - 1 - addr.depth];
+        return ctx->getVariable(addr.slot);
+    }
+
+    static Variable* defineVariable(ContextChain* ctxChain,
+                                    Address addr,
+                                    Value value);
+
+    // Value of variable at addr, or named function identName if addr was not
+    // resolved or has not been defined
+    static Value lookupName(Runtime* rt,
+                            ContextChain* ctxChain,
+                            Symbol identName,
+                            Address addr,
+                            int line,
+                            int column);
+
+    static Value lookupElement(Symbol identName,
+                               Variable* var,
+                               Value idx,
+                               int line,
+                               int column);
+
+    static Value lookupElement(Symbol identName,
+                               Variable* var,
+                               int idx,
+                               int line,
+                               int column);
+
+    static void assignVariable(ContextChain* ctxChain,
+                               Address addr,
+                               Token opt,
+                               Value rhs);
+
+    static void assignElement(ContextChain* ctxChain,
+                              Symbol identName,
+                              Address addr,
+                              Token opt,
+                              Value index,
+                              Value rhs,
+                              int line,
+                              int column);
+
+    // Closure held by variable at addr, or nullptr if there is no such one
+    static Value lookupClosure(ContextChain* ctxChain, Address addr);
+
+    static void resolveCall(Runtime* rt,
+                            Symbol funcName,
+                            CallCache* cache);
+
+    static Value newClosure(Runtime* rt, Func* f, ContextChain* ctxChain);
+
+    // New context chain of a call to f, whose variables take a frame of
+    // frameStack
+    static ContextChain* enterFunc(const Func* f,
+                                   const BoundFunc* closure = nullptr);
+
+    static void bindUpvalues(ContextChain* funcCtxChain,
+                             const BoundFunc* closure);
+
+    static void leaveFunc(ContextChain* funcCtxChain);
+
+    // Parameters take the first slots of function context in order
+    static void bindArgument(Runtime* rt,
+                             ContextChain* funcCtxChain,
+                             int index,
+                             Value argValue);
+
+    // Contexts that have been popped, they are reused by newContext
+    static std::vector<Context*> freeContexts;
+    // Context chains of calls that have returned, they are reused by enterFunc
+    static std::vector<ContextChain*> freeChains;
+    static FrameStack frameStack;
+
+    // Callee and arguments of the tail call that current frame is returning to
+    static Func* tailCallee;
+    static ObjectArray tailCallArgs;
+
+private:
+    ContextChain* ctxChain;
+};
+
+// Context of a block, which is pushed once the block is entered and popped
+// however it's left, variables captured by closures outlive it
+class Scope {
+public:
+    explicit Scope(ContextChain* ctxChain)
+        : ctxChain(ctxChain), depth(ctxChain->size()) {
+        Interpreter::newContext(ctxChain);
+    }
+
+    ~Scope() { Interpreter::leaveContext(ctxChain, depth); }
 
 private:
     ContextChain* ctxChain;
+    size_t depth;
 };
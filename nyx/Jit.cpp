@@ -0,0 +1,772 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Jit.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Assembler.h"
+#include "Ast.h"
+#include "Rewriter.h"
+
+int Jit::threshold = 100;
+
+// Native code is disabled after bailing out this many times
+static constexpr int MaxBailouts = 16;
+// Arguments are passed by rdi, rsi, rdx, rcx, r8 and r9
+static constexpr int MaxNativeParams = 6;
+
+// Compiled function returns its value in rax and status in rdx, non-zero
+// status means it bailed out
+struct NativeResult {
+    int64_t value;
+    int64_t status;
+};
+
+using NativeEntry = NativeResult (*)(int64_t,
+                                     int64_t,
+                                     int64_t,
+                                     int64_t,
+                                     int64_t,
+                                     int64_t);
+
+#if NYX_JIT_SUPPORTED
+
+static NativeCode* compileFunc(Runtime* rt, Func* f, bool background);
+
+//===----------------------------------------------------------------------===//
+// Translate function body to machine code, any unsupported construction
+// makes the whole function not compilable. Every variable is statically typed
+// and lives in its own stack slot, which is sound because named functions never
+// see variables other than their own
+//===----------------------------------------------------------------------===//
+class NativeCompiler : public AstVisitor {
+public:
+    explicit NativeCompiler(Runtime* rt,
+                            Func* f,
+                            Block* body,
+                            NativeType returnType,
+                            bool background)
+        : rt(rt),
+          f(f),
+          body(body),
+          returnType(returnType),
+          background(background) {}
+
+    void* compile() {
+        entry = as.newLabel();
+        bailout = as.newLabel();
+        as.bind(entry);
+        as.prologue();
+        static const Reg argRegs[MaxNativeParams] = {RDI, RSI, RDX,
+                                                     RCX, R8,  R9};
+        for (int i = 0; i < (int)f->params.size(); i++) {
+            if (vars.find(f->params[i]) != vars.end()) {
+                return nullptr;
+            }
+            int slot = define(f->params[i], NativeType::Int);
+            as.store32(RBP, local(slot), argRegs[i]);
+        }
+        start = as.newLabel();
+        as.bind(start);
+        for (auto* stmt : body->stmts) {
+            stmt->visit(this);
+            if (failed) {
+                return nullptr;
+            }
+        }
+        // Falling off the end returns null, which is left to interpreter
+        as.bind(bailout);
+        leave(true);
+        if (returns == 0) {
+            return nullptr;
+        }
+        as.setFrameSize(8 * (int)vars.size());
+        return as.finalize();
+    }
+
+    // Whether any return statement disagrees with the assumed return type
+    bool returnTypeMismatch{};
+    // Whether it failed only because some callee is not compiled yet
+    bool deferred{};
+    // Whether compiled code calls any function
+    bool makesCalls{};
+
+private:
+    struct Slot {
+        int index;
+        NativeType type;
+    };
+
+    struct Loop {
+        Assembler::Label breakTarget;
+        Assembler::Label continueTarget;
+    };
+
+    // Frame offset of local variable
+    static int local(int slot) { return -8 * (slot + 1); }
+
+    // Return to caller with bailout status in edx
+    void leave(bool bailout) {
+        if (bailout) {
+            as.movEdxImm(1);
+        } else {
+            as.zeroEdx();
+        }
+        as.leave();
+        as.ret();
+    }
+
+    int define(Symbol name, NativeType t) {
+        int index = (int)vars.size();
+        vars.emplace(name, Slot{index, t});
+        return index;
+    }
+
+    void fail() { failed = true; }
+
+    // Compile expression to eax, return false if it's not of expected type
+    bool expect(Expression* node, NativeType t) {
+        node->visit(this);
+        return !failed && type == t;
+    }
+
+    void nested(Block* block) {
+        depth++;
+        for (auto* stmt : block->stmts) {
+            stmt->visit(this);
+            if (failed) {
+                break;
+            }
+        }
+        depth--;
+    }
+
+    void visitExpression(Expression* node) override { fail(); }
+    void visitCharExpr(CharExpr* node) override { fail(); }
+    void visitNullExpr(NullExpr* node) override { fail(); }
+    void visitDoubleExpr(DoubleExpr* node) override { fail(); }
+    void visitStringExpr(StringExpr* node) override { fail(); }
+    void visitArrayExpr(ArrayExpr* node) override { fail(); }
+    void visitIndexExpr(IndexExpr* node) override { fail(); }
+    void visitClosureExpr(ClosureExpr* node) override { fail(); }
+    void visitStatement(Statement* node) override { fail(); }
+    void visitForEachStmt(ForEachStmt* node) override { fail(); }
+    void visitMatchStmt(MatchStmt* node) override { fail(); }
+
+    void visitBoolExpr(BoolExpr* node) override {
+        as.loadImm(node->literal ? 1 : 0);
+        type = NativeType::Bool;
+    }
+
+    void visitIntExpr(IntExpr* node) override {
+        as.loadImm(node->literal);
+        type = NativeType::Int;
+    }
+
+    void visitNameExpr(NameExpr* node) override {
+        auto iter = vars.find(node->identName);
+        if (iter == vars.end()) {
+            fail();
+            return;
+        }
+        as.load32(RAX, RBP, local(iter->second.index));
+        type = iter->second.type;
+    }
+
+    void visitBinaryExpr(BinaryExpr* node) override {
+        if (node->lhs == nullptr) {
+            fail();
+            return;
+        }
+        if (node->rhs == nullptr) {
+            compileUnary(node);
+            return;
+        }
+        node->lhs->visit(this);
+        if (failed) {
+            return;
+        }
+        NativeType lhsType = type;
+        as.push(RAX);
+        node->rhs->visit(this);
+        if (failed) {
+            return;
+        }
+        NativeType rhsType = type;
+        as.mov(RCX, RAX);
+        as.pop(RAX);
+        bool ints = lhsType == NativeType::Int && rhsType == NativeType::Int;
+        bool bools =
+            lhsType == NativeType::Bool && rhsType == NativeType::Bool;
+        switch (node->opt) {
+            case TK_PLUS:
+            case TK_MINUS:
+            case TK_TIMES:
+            case TK_DIV:
+            case TK_MOD:
+            case TK_BITAND:
+            case TK_BITOR:
+                if (!ints) {
+                    fail();
+                    return;
+                }
+                arithmetic(node->opt);
+                type = NativeType::Int;
+                return;
+            case TK_LT:
+            case TK_LE:
+            case TK_GT:
+            case TK_GE:
+                if (!ints) {
+                    fail();
+                    return;
+                }
+                as.compare(node->opt == TK_LT   ? CondL
+                           : node->opt == TK_LE ? CondLE
+                           : node->opt == TK_GT ? CondG
+                                                : CondGE);
+                type = NativeType::Bool;
+                return;
+            case TK_EQ:
+            case TK_NE:
+                if (!ints && !bools) {
+                    fail();
+                    return;
+                }
+                as.compare(node->opt == TK_EQ ? CondE : CondNE);
+                type = NativeType::Bool;
+                return;
+            case TK_LOGAND:
+            case TK_LOGOR:
+                // Both operands are always evaluated, as interpreter does
+                if (!bools) {
+                    fail();
+                    return;
+                }
+                node->opt == TK_LOGAND ? as.andOp() : as.orOp();
+                type = NativeType::Bool;
+                return;
+            default:
+                fail();
+        }
+    }
+
+    void compileUnary(BinaryExpr* node) {
+        node->lhs->visit(this);
+        if (failed) {
+            return;
+        }
+        if (node->opt == TK_LOGNOT && type == NativeType::Bool) {
+            as.xorOne();
+        } else if ((node->opt == TK_MINUS || node->opt == TK_BITNOT) &&
+                   type == NativeType::Int) {
+            // Value::operator~ negates its operand as well
+            as.neg();
+        } else {
+            fail();
+        }
+    }
+
+    // Apply arithmetic operator to eax and ecx
+    void arithmetic(Token opt) {
+        switch (opt) {
+            case TK_PLUS:
+            case TK_PLUS_AGN:
+                as.add();
+                break;
+            case TK_MINUS:
+            case TK_MINUS_AGN:
+                as.sub();
+                break;
+            case TK_TIMES:
+            case TK_TIMES_AGN:
+                as.imul();
+                break;
+            case TK_DIV:
+            case TK_DIV_AGN:
+                as.idiv(bailout);
+                break;
+            case TK_MOD:
+            case TK_MOD_AGN:
+                as.idiv(bailout);
+                as.movEaxEdx();
+                break;
+            case TK_BITAND:
+                as.andOp();
+                break;
+            case TK_BITOR:
+                as.orOp();
+                break;
+            default:
+                fail();
+        }
+    }
+
+    void visitAssignExpr(AssignExpr* node) override {
+        auto* lhs = dynamic_cast<NameExpr*>(node->lhs);
+        if (lhs == nullptr) {
+            fail();
+            return;
+        }
+        node->rhs->visit(this);
+        if (failed) {
+            return;
+        }
+        auto iter = vars.find(lhs->identName);
+        if (node->opt == TK_ASSIGN) {
+            if (iter == vars.end()) {
+                // Variable created by unconditionally executed statement
+                // is visible to all statements that follow
+                if (depth > 0) {
+                    fail();
+                    return;
+                }
+                as.store32(RBP, local(define(lhs->identName, type)), RAX);
+                return;
+            }
+            if (iter->second.type != type) {
+                fail();
+                return;
+            }
+            as.store32(RBP, local(iter->second.index), RAX);
+            return;
+        }
+        if (iter == vars.end() || iter->second.type != NativeType::Int ||
+            type != NativeType::Int) {
+            fail();
+            return;
+        }
+        // Assignment expression evaluates to its rhs
+        as.mov(RCX, RAX);
+        as.load32(RAX, RBP, local(iter->second.index));
+        arithmetic(node->opt);
+        as.store32(RBP, local(iter->second.index), RAX);
+        as.mov(RAX, RCX);
+    }
+
+    void visitFunCallExpr(FunCallExpr* node) override {
+        if (node->receiver != nullptr ||
+            rt->getBuiltinFunction(node->funcName) != nullptr) {
+            fail();
+            return;
+        }
+        Func* callee = rt->getFunction(node->funcName);
+        if (callee == nullptr || callee->params.size() != node->args.size() ||
+            callee->params.size() > MaxNativeParams) {
+            fail();
+            return;
+        }
+        NativeType calleeReturnType = returnType;
+        void* calleeEntry = nullptr;
+        if (callee != f) {
+            NativeCode* code = callee->native;
+            if (background && code->state != NativeState::Compiled) {
+                // Callee would be compiled from its live tree, which is
+                // only safe on interpreter thread, wait until it's hot
+                deferred = true;
+                fail();
+                return;
+            }
+            code = compileFunc(rt, callee, background);
+            calleeEntry = code->entry;
+            if (calleeEntry == nullptr) {
+                fail();
+                return;
+            }
+            calleeReturnType = code->returnType;
+        }
+        for (auto* arg : node->args) {
+            if (!expect(arg, NativeType::Int)) {
+                fail();
+                return;
+            }
+            as.push(RAX);
+        }
+        static const Reg argRegs[MaxNativeParams] = {RDI, RSI, RDX,
+                                                     RCX, R8,  R9};
+        for (int i = (int)node->args.size() - 1; i >= 0; i--) {
+            as.pop(argRegs[i]);
+        }
+        makesCalls = true;
+        if (callee == f) {
+            as.call(entry);
+        } else {
+            as.call(calleeEntry);
+        }
+        // Propagate bailout to the outermost native frame
+        as.testRdx();
+        as.jump(bailout, CondNE);
+        type = calleeReturnType;
+    }
+
+    void visitSimpleStmt(SimpleStmt* node) override { node->expr->visit(this); }
+
+    // Tail call to itself reassigns parameters and starts over, which runs in
+    // constant native stack
+    bool selfTailCall(FunCallExpr* node) {
+        if (rt->getBuiltinFunction(node->funcName) != nullptr ||
+            rt->getFunction(node->funcName) != f ||
+            node->args.size() != f->params.size()) {
+            return false;
+        }
+        for (auto* arg : node->args) {
+            if (!expect(arg, NativeType::Int)) {
+                fail();
+                return true;
+            }
+            as.push(RAX);
+        }
+        for (int i = (int)node->args.size() - 1; i >= 0; i--) {
+            const Slot& param = vars.find(f->params[i])->second;
+            if (param.type != NativeType::Int) {
+                fail();
+                return true;
+            }
+            as.pop(RAX);
+            as.store32(RBP, local(param.index), RAX);
+        }
+        as.jump(start);
+        return true;
+    }
+
+    void visitReturnStmt(ReturnStmt* node) override {
+        if (node->ret == nullptr) {
+            fail();
+            return;
+        }
+        if (node->tailCall != nullptr && selfTailCall(node->tailCall)) {
+            returns++;
+            return;
+        }
+        node->ret->visit(this);
+        if (failed) {
+            return;
+        }
+        if (type != returnType) {
+            returnTypeMismatch = true;
+            fail();
+            return;
+        }
+        leave(false);
+        returns++;
+    }
+
+    void visitBreakStmt(BreakStmt* node) override {
+        if (loops.empty()) {
+            fail();
+            return;
+        }
+        as.jump(loops.back().breakTarget);
+    }
+
+    void visitContinueStmt(ContinueStmt* node) override {
+        if (loops.empty()) {
+            fail();
+            return;
+        }
+        as.jump(loops.back().continueTarget);
+    }
+
+    void visitIfStmt(IfStmt* node) override {
+        if (!expect(node->cond, NativeType::Bool)) {
+            fail();
+            return;
+        }
+        Assembler::Label elseLabel = as.newLabel();
+        Assembler::Label end = as.newLabel();
+        as.testEax();
+        as.jump(elseLabel, CondE);
+        nested(node->block);
+        as.jump(end);
+        as.bind(elseLabel);
+        if (node->elseBlock != nullptr) {
+            nested(node->elseBlock);
+        }
+        as.bind(end);
+    }
+
+    void visitWhileStmt(WhileStmt* node) override {
+        Assembler::Label top = as.newLabel();
+        Assembler::Label end = as.newLabel();
+        as.bind(top);
+        depth++;
+        bool isBool = expect(node->cond, NativeType::Bool);
+        depth--;
+        if (!isBool) {
+            fail();
+            return;
+        }
+        as.testEax();
+        as.jump(end, CondE);
+        loops.push_back(Loop{end, top});
+        nested(node->block);
+        loops.pop_back();
+        as.jump(top);
+        as.bind(end);
+    }
+
+    void visitForStmt(ForStmt* node) override {
+        if (node->init == nullptr || node->cond == nullptr ||
+            node->post == nullptr) {
+            fail();
+            return;
+        }
+        node->init->visit(this);
+        if (failed) {
+            return;
+        }
+        Assembler::Label top = as.newLabel();
+        Assembler::Label post = as.newLabel();
+        Assembler::Label end = as.newLabel();
+        as.bind(top);
+        depth++;
+        bool isBool = expect(node->cond, NativeType::Bool);
+        depth--;
+        if (!isBool) {
+            fail();
+            return;
+        }
+        as.testEax();
+        as.jump(end, CondE);
+        loops.push_back(Loop{end, post});
+        nested(node->block);
+        loops.pop_back();
+        if (failed) {
+            return;
+        }
+        as.bind(post);
+        depth++;
+        node->post->visit(this);
+        depth--;
+        as.jump(top);
+        as.bind(end);
+    }
+
+    Runtime* rt;
+    Func* f;
+    Block* body;
+    NativeType returnType;
+    bool background;
+    Assembler as;
+    Assembler::Label entry{};
+    // Function body right after parameters are stored
+    Assembler::Label start{};
+    Assembler::Label bailout{};
+    std::unordered_map<Symbol, Slot> vars;
+    std::vector<Loop> loops;
+    // Nesting level of current statement, zero means function body itself
+    int depth{};
+    int returns{};
+    NativeType type{};
+    bool failed{};
+};
+
+#endif
+
+// Serializes compilations of the compiler thread and those requested by other
+// compilers of interpreter thread
+static std::mutex compileLock;
+
+// Compile f from its private copy of body if compiler thread got one, callees
+// are compiled on demand unless it's compiling in background
+static NativeCode* compileFunc(Runtime* rt, Func* f, bool background) {
+    NativeCode* code = f->native;
+    if (code->compiling) {
+        // Mutual recursion is not supported yet
+        static NativeCode unavailable;
+        return &unavailable;
+    }
+    if (code->state == NativeState::Compiled) {
+        return code;
+    }
+#if NYX_JIT_SUPPORTED
+    if (f->params.size() <= MaxNativeParams) {
+        code->compiling = true;
+        Block* body = code->body != nullptr ? code->body : f->block;
+        // Return type of recursive calls is unknown until the whole function
+        // is compiled, try int first and then bool
+        for (NativeType t : {NativeType::Int, NativeType::Bool}) {
+            NativeCompiler compiler(rt, f, body, t, background);
+            void* entry = compiler.compile();
+            if (entry != nullptr) {
+                code->returnType = t;
+                code->makesCalls = compiler.makesCalls;
+                code->entry.store(entry, std::memory_order_release);
+                break;
+            }
+            if (compiler.deferred) {
+                // Let interpreter queue it again after another round of calls
+                code->compiling = false;
+                code->state = NativeState::Cold;
+                return code;
+            }
+            if (!compiler.returnTypeMismatch) {
+                break;
+            }
+        }
+        code->compiling = false;
+    }
+#endif
+    code->state = NativeState::Compiled;
+    return code;
+}
+
+//===----------------------------------------------------------------------===//
+// Compile queued functions one after another in background. Interpreter keeps
+// quickening the trees it executes meanwhile, so every queued function comes
+// with a copy of its body that only compiler thread reads
+//===----------------------------------------------------------------------===//
+class CompilerThread {
+public:
+    ~CompilerThread() {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            stopping = true;
+        }
+        available.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    void enqueue(Runtime* rt, Func* f) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            queue.emplace_back(rt, f);
+            if (!thread.joinable()) {
+                thread = std::thread(&CompilerThread::run, this);
+            }
+        }
+        available.notify_one();
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::unique_lock<std::mutex> guard(mutex);
+            available.wait(guard,
+                           [this] { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+            auto [rt, f] = queue.front();
+            queue.pop_front();
+            guard.unlock();
+
+            std::lock_guard<std::mutex> compiling(compileLock);
+            compileFunc(rt, f, true);
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<std::pair<Runtime*, Func*>> queue;
+    std::thread thread;
+    bool stopping{};
+};
+
+static CompilerThread compilerThread;
+
+// Give every named function its NativeCode before compiler thread starts, so
+// that the pointers are never written again while both threads read them
+static void prepare(Runtime* rt) {
+    static bool prepared = false;
+    if (prepared) {
+        return;
+    }
+    for (auto& [name, f] : rt->getFunctions()) {
+        f->native = new NativeCode;
+    }
+    prepared = true;
+}
+
+NativeCode* Jit::compile(Runtime* rt, Func* f) {
+    prepare(rt);
+    std::lock_guard<std::mutex> guard(compileLock);
+    return compileFunc(rt, f, false);
+}
+
+Value Jit::invoke(Runtime* rt, Func* f, const Context* ctx) {
+    if (threshold <= 0 || f->name.empty() ||
+        f->params.size() > MaxNativeParams) {
+        return nullptr;
+    }
+    Value args[MaxNativeParams];
+    for (int i = 0; i < (int)f->params.size(); i++) {
+        args[i] = ctx->getVariable(i)->value;
+    }
+    return invoke(rt, f, args);
+}
+
+Value Jit::invoke(Runtime* rt, Func* f, Value* args, bool leafOnly) {
+    if (threshold <= 0 || f->name.empty()) {
+        return nullptr;
+    }
+    prepare(rt);
+    NativeCode* code = f->native;
+    auto entry = (NativeEntry)code->entry.load(std::memory_order_acquire);
+    if (entry == nullptr) {
+        // Keep interpreting it until compiler thread is done
+        NativeState cold = NativeState::Cold;
+        if (++f->calls >= threshold &&
+            code->state.compare_exchange_strong(cold, NativeState::Queued)) {
+            f->calls = 0;
+            if (code->body == nullptr) {
+                code->body = AstCloner().clone(f->block);
+            }
+            compilerThread.enqueue(rt, f);
+        }
+        return nullptr;
+    }
+    if (leafOnly && code->makesCalls) {
+        return nullptr;
+    }
+    int64_t values[MaxNativeParams] = {};
+    for (int i = 0; i < (int)f->params.size(); i++) {
+        // Guard on argument types, compiled code expects int values only
+        if (!args[i].isInt()) {
+            return nullptr;
+        }
+        values[i] = args[i].asInt();
+    }
+    NativeResult result = entry(values[0], values[1], values[2], values[3],
+                                values[4], values[5]);
+    if (result.status != 0) {
+        if (++code->bailouts >= MaxBailouts) {
+            code->entry = nullptr;
+        }
+        return nullptr;
+    }
+    if (code->returnType == NativeType::Bool) {
+        return rt->newObject(result.value != 0);
+    }
+    return rt->newObject((int)result.value);
+}
@@ -0,0 +1,89 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_JIT_H
+#define NYX_JIT_H
+
+#include <atomic>
+#include "Object.hpp"
+#include "Runtime.hpp"
+
+enum class NativeType { Int, Double, Bool };
+
+enum class NativeState { Cold, Queued, Compiled };
+
+// Every named function owns one before anything is compiled, interpreter and
+// compiler thread coordinate through its atomic fields
+struct NativeCode {
+    // Entry of compiled machine code, it's null if function is not compiled
+    // yet, can not be compiled or it bailed out too many times. Compiler
+    // publishes it along with return type once it's done
+    std::atomic<void*> entry{};
+    NativeType returnType{};
+    // Compiled code calls functions natively, its native stack grows as deep
+    // as they recurse
+    bool makesCalls{};
+    std::atomic<NativeState> state{NativeState::Cold};
+    // Copy of function body made before it's queued, compiler thread reads
+    // it instead of the tree that interpreter keeps rewriting
+    Block* body{};
+    bool compiling{};
+    int bailouts{};
+};
+
+//===----------------------------------------------------------------------===//
+// Baseline JIT compiler which translates hot user defined functions to x86-64
+// machine code. Only functions that operate on int and bool values and call
+// nothing but such functions are compiled, they have no observable side effect
+// so that native code can give up anytime and let interpreter execute the call
+// from scratch.
+//
+// Hot functions are compiled by a background thread while interpreter keeps
+// executing them, and switch to native code at the first call after it's
+// published. Native code deoptimizes a call by bailing out to interpreter
+// whenever its type assumptions fail, and is discarded after failing too often
+//===----------------------------------------------------------------------===//
+class Jit {
+public:
+    // Execute f natively with evaluated arguments once it's hot and compiled,
+    // return nullptr if it's not or arguments don't pass the guards. Callers
+    // that must not grow native stack pass leafOnly to skip native code that
+    // calls functions
+    static Value invoke(Runtime* rt,
+                        Func* f,
+                        Value* args,
+                        bool leafOnly = false);
+
+    // Same as above, arguments are those bound to parameters in context of
+    // the call
+    static Value invoke(Runtime* rt, Func* f, const Context* ctx);
+
+    // Compile f right away if it's not yet, for other compilers that need its
+    // native code
+    static NativeCode* compile(Runtime* rt, Func* f);
+
+    // Calls before compiling a function, zero disables JIT compiler
+    static int threshold;
+};
+
+#endif  // NYX_JIT_H
@@ -21,24 +21,75 @@
 // THE SOFTWARE.
 //
 
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "ClosureCompiler.h"
 #include "Debug.hpp"
+#include "Gc.h"
 #include "Interpreter.h"
+#include "Jit.h"
+#include "Resolver.h"
+#include "Rewriter.h"
 #include "Utils.hpp"
+#include "VM.h"
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
+    const char* fileName = nullptr;
+    std::string engine = "ast";
+    bool gcStats = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--engine=", 9) == 0) {
+            engine = argv[i] + 9;
+        } else if (strncmp(argv[i], "--jit-threshold=", 16) == 0) {
+            Jit::threshold = atoi(argv[i] + 16);
+        } else if (strncmp(argv[i], "--inline-threshold=", 19) == 0) {
+            Inliner::threshold = atoi(argv[i] + 19);
+        } else if (strncmp(argv[i], "--max-depth=", 12) == 0) {
+            VM::maxDepth = atoi(argv[i] + 12);
+        } else if (strncmp(argv[i], "--gc-nursery=", 13) == 0) {
+            Gc::nurserySize = (size_t)atoi(argv[i] + 13) * 1024;
+        } else if (strncmp(argv[i], "--gc-min-heap=", 14) == 0) {
+            Gc::minHeapSize = (size_t)atoi(argv[i] + 14) * 1024;
+        } else if (strncmp(argv[i], "--gc-growth=", 12) == 0) {
+            Gc::growth = atoi(argv[i] + 12);
+        } else if (strncmp(argv[i], "--gc-max-pause-us=", 18) == 0) {
+            Gc::maxPauseUs = atoi(argv[i] + 18);
+        } else if (strcmp(argv[i], "--gc-stats") == 0) {
+            gcStats = true;
+        } else {
+            fileName = argv[i];
+        }
+    }
+    if (fileName == nullptr) {
         panic("Feed your *.nyx source file to interpreter!\n");
     }
 
     auto* rt = new Runtime;
 
-    Parser parser(argv[1]);
+    Parser parser(fileName);
 #if NYX_DEBUG
-    printLex(argv[1]);
+    printLex(fileName);
 #endif
     parser.parse(rt);
-    Interpreter nyx;
-    nyx.execute(rt);
+    Resolver resolver(rt);
+    resolver.resolveAll();
+    if (engine == "ast") {
+        Interpreter nyx;
+        nyx.execute(rt);
+    } else if (engine == "vm") {
+        VM vm(rt);
+        vm.execute();
+    } else if (engine == "closure") {
+        ClosureCompiler compiler(rt);
+        compiler.execute();
+    } else {
+        panic("unknown engine %s, expects ast, vm or closure\n",
+              engine.c_str());
+    }
+    if (gcStats) {
+        Gc::printStats();
+    }
 
     return 0;
 }
@@ -0,0 +1,106 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "Parser.h"
+#include "Resolver.h"
+#include "Transpiler.h"
+#include "Utils.hpp"
+
+// Where generated code finds nyx headers and runtime library, they are given
+// by build system
+#ifndef NYXC_CXX
+#define NYXC_CXX "c++"
+#endif
+#ifndef NYXC_INCLUDE_DIR
+#define NYXC_INCLUDE_DIR "."
+#endif
+#ifndef NYXC_RUNTIME
+#define NYXC_RUNTIME "libnyxrt.a"
+#endif
+
+int main(int argc, char* argv[]) {
+    const char* fileName = nullptr;
+    std::string output;
+    bool emitSource = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--emit-cpp") == 0) {
+            emitSource = true;
+        } else {
+            fileName = argv[i];
+        }
+    }
+    if (fileName == nullptr) {
+        panic(
+            "usage: nyxc [-o <executable>] [--emit-cpp] "
+            "<your_source_file.nyx>\n");
+    }
+
+    auto* rt = new Runtime;
+    Parser parser(fileName);
+    parser.parse(rt);
+    Resolver resolver(rt);
+    resolver.resolveAll();
+    Transpiler transpiler(rt);
+    std::string source = transpiler.transpile(fileName);
+    if (emitSource) {
+        std::cout << source;
+        return 0;
+    }
+
+    if (output.empty()) {
+        output = fileName;
+        if (auto dot = output.rfind(".nyx"); dot != std::string::npos) {
+            output.erase(dot);
+        } else {
+            output += ".out";
+        }
+    }
+    std::string sourceName = output + ".cpp";
+    {
+        std::ofstream fs(sourceName);
+        fs << source;
+        if (!fs) {
+            panic("can not write %s\n", sourceName.c_str());
+        }
+    }
+    // Signed overflow wraps around as it does in interpreter
+    std::string command = NYXC_CXX " -std=c++17 -O2 -fwrapv";
+    command += " -I\"" NYXC_INCLUDE_DIR "\"";
+    command += " \"" + sourceName + "\"";
+    command += " \"" NYXC_RUNTIME "\" -pthread";
+    command += " -o \"" + output + "\"";
+    int status = std::system(command.c_str());
+    std::remove(sourceName.c_str());
+    if (status != 0) {
+        panic("failed to compile %s\n", fileName);
+    }
+    return 0;
+}
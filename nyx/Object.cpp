@@ -22,35 +22,38 @@
 //
 
 #include "Object.hpp"
+#include <array>
+#include <functional>
+#include <utility>
 #include "Builtin.h"
 #include "Runtime.hpp"
 #include "Utils.hpp"
 
-bool Object::equalsDeep(Object* b) const {
-    if (type != b->type) {
+bool Value::equalsDeep(Value b) const {
+    if (getType() != b.getType()) {
         return false;
     }
-    switch (type) {
+    switch (getType()) {
         case Bool:
-            return asBool() == b->asBool();
+            return asBool() == b.asBool();
         case Double:
-            return asDouble() == b->asDouble();
+            return asDouble() == b.asDouble();
         case Int:
-            return asInt() == b->asInt();
+            return asInt() == b.asInt();
         case Null:
             return true;
         case String:
-            return asString() == b->asString();
+            return asString() == b.asString();
         case Char:
-            return asChar() == b->asChar();
+            return asChar() == b.asChar();
         case Array: {
-            auto elements1 = asArray();
-            auto elements2 = b->asArray();
+            const auto& elements1 = asArray();
+            const auto& elements2 = b.asArray();
             if (elements1.size() != elements2.size()) {
                 return false;
             }
             for (int i = 0; i < elements1.size(); i++) {
-                if (!elements1[i]->equalsDeep(elements2[i])) {
+                if (!elements1[i].equalsDeep(elements2[i])) {
                     return false;
                 }
             }
@@ -60,8 +63,8 @@ bool Object::equalsDeep(Object* b) const {
     return false;
 }
 
-std::string Object::toString() const {
-    switch (type) {
+std::string Value::toString() const {
+    switch (getType()) {
         case Bool:
             return asBool() ? "true" : "false";
         case Double:
@@ -71,7 +74,7 @@ std::string Object::toString() const {
         case Null:
             return "null";
         case String:
-            return asString();
+            return asString().str();
         case Char: {
             std::string str;
             str += asChar();
@@ -79,9 +82,9 @@ std::string Object::toString() const {
         }
         case Array: {
             std::string str = "[";
-            auto elements = asArray();
+            const auto& elements = asArray();
             for (int i = 0; i < elements.size(); i++) {
-                str += elements[i]->toString();
+                str += elements[i].toString();
 
                 if (i != elements.size() - 1) {
                     str += ",";
@@ -97,349 +100,302 @@ std::string Object::toString() const {
     return "<unknown>";
 }
 
-bool Object::isPrimitive() const {
-    if (anyone(type, Int, Double, String, Bool, Char)) {
+bool Value::isPrimitive() const {
+    // Strings are immutable and therefore shared rather than copied
+    if (anyone(getType(), Int, Double, Bool, Char)) {
         return true;
     }
     return false;
 }
 
-Object* Object::operator+(Object* rhs) const {
-    // Basic
-    if (isInt() && rhs->isInt()) {
-        int result = asInt() + rhs->asInt();
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isDouble()) {
-        double result = asDouble() + rhs->asDouble();
-        return runtime->newObject(result);
-    } else if (isInt() && rhs->isDouble()) {
-        double result = asInt() + rhs->asDouble();
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isInt()) {
-        double result = asDouble() + rhs->asInt();
-        return runtime->newObject(result);
-    } else if (isChar() && rhs->isInt()) {
-        char result = static_cast<char>(asChar() + rhs->asInt());
-        return runtime->newObject(result);
-    } else if (isInt() && rhs->isChar()) {
-        char result = static_cast<char>(asInt() + rhs->asChar());
-        return runtime->newObject(result);
-    } else if (isChar() && rhs->isChar()) {
-        char result = static_cast<char>(asChar() + rhs->asChar());
-        return runtime->newObject(result);
+//===----------------------------------------------------------------------===//
+// Binary operators are dispatched through tables indexed by types of both
+// operands. Each table is generated at compile time from a template telling
+// how the operator works on a given pair of types, an operation therefore
+// costs one indirect call and never tests type tags of its operands
+//===----------------------------------------------------------------------===//
+namespace {
+template <ValueType T>
+struct Payload {};
+
+template <>
+struct Payload<Int> {
+    static int get(Value object) { return object.asInt(); }
+};
+
+template <>
+struct Payload<Double> {
+    static double get(Value object) { return object.asDouble(); }
+};
+
+template <>
+struct Payload<String> {
+    static const ObjectString& get(Value object) {
+        return object.asString();
     }
-    // String
-    // One of operands has string type, we say the result value was a string
-    else if (isString() || rhs->isString()) {
-        std::string result = this->toString() + rhs->toString();
-        return runtime->newObject(result);
+};
+
+template <>
+struct Payload<Bool> {
+    static bool get(Value object) { return object.asBool(); }
+};
+
+template <>
+struct Payload<Char> {
+    static char get(Value object) { return object.asChar(); }
+};
+
+template <ValueType L, ValueType R>
+constexpr bool isNumeric =
+    (L == Int || L == Double) && (R == Int || R == Double);
+
+// Arithmetic of chars and ints produces chars
+template <ValueType L, ValueType R>
+constexpr bool isCharacter = (L == Char || R == Char) &&
+                              (L == Char || L == Int) &&
+                              (R == Char || R == Int);
+
+template <ValueType L, ValueType R>
+constexpr bool isOrdered =
+    L == R && (L == Int || L == Double || L == String || L == Char);
+
+template <ValueType L, ValueType R>
+struct Add {
+    static Value apply(Value lhs, Value rhs) {
+        if constexpr (isNumeric<L, R>) {
+            return runtime->newObject(Payload<L>::get(lhs) +
+                                      Payload<R>::get(rhs));
+        } else if constexpr (isCharacter<L, R>) {
+            return runtime->newObject(
+                static_cast<char>(Payload<L>::get(lhs) + Payload<R>::get(rhs)));
+        } else if constexpr (L == String && R == String) {
+            return runtime->newObject(
+                concatString(Payload<L>::get(lhs), Payload<R>::get(rhs)));
+        } else if constexpr (L == String || R == String) {
+            // One of operands has string type, we say the result value was a
+            // string. The string operand is not flattened if it's a rope
+            if constexpr (L == String) {
+                return runtime->newObject(concatString(
+                    Payload<L>::get(lhs), ObjectString(rhs.toString())));
+            } else {
+                return runtime->newObject(concatString(
+                    ObjectString(lhs.toString()), Payload<R>::get(rhs)));
+            }
+        } else if constexpr (L == Array) {
+            auto result = lhs.asArray();
+            result.push_back(rhs);
+            return runtime->newObject(std::move(result));
+        } else if constexpr (R == Array) {
+            auto result = rhs.asArray();
+            result.push_back(lhs);
+            return runtime->newObject(std::move(result));
+        } else {
+            panic("unexpected arguments of operator +");
+        }
     }
-    // Array
-    else if (isArray()) {
-        auto result = this->asArray();
-        result.push_back(rhs);
-        return runtime->newObject(result);
-    } else if (rhs->isArray()) {
-        auto result = rhs->asArray();
-        result.push_back(const_cast<Object*>(this));
-        return runtime->newObject(result);
+};
+
+template <ValueType L, ValueType R>
+struct Sub {
+    static Value apply(Value lhs, Value rhs) {
+        if constexpr (isNumeric<L, R>) {
+            return runtime->newObject(Payload<L>::get(lhs) -
+                                      Payload<R>::get(rhs));
+        } else if constexpr (isCharacter<L, R>) {
+            return runtime->newObject(
+                static_cast<char>(Payload<L>::get(lhs) - Payload<R>::get(rhs)));
+        } else {
+            panic("unexpected arguments of operator -");
+        }
     }
-    // Invalid
-    else {
-        panic("unexpected arguments of operator +");
+};
+
+template <ValueType L, ValueType R>
+struct Mul {
+    static Value apply(Value lhs, Value rhs) {
+        if constexpr (isNumeric<L, R>) {
+            return runtime->newObject(Payload<L>::get(lhs) *
+                                      Payload<R>::get(rhs));
+        } else if constexpr (L == String && R == Int) {
+            return runtime->newObject(
+                repeatString(rhs.asInt(), lhs.asString()));
+        } else if constexpr (L == Int && R == String) {
+            return runtime->newObject(
+                repeatString(lhs.asInt(), rhs.asString()));
+        } else {
+            panic("unexpected arguments of operator *");
+        }
     }
-    return nullptr;
-}
+};
 
-Object* Object::operator-(Object* rhs) const {
-    if (isInt() && rhs->isInt()) {
-        int result = asInt() - rhs->asInt();
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isDouble()) {
-        double result = asDouble() - rhs->asDouble();
-        return runtime->newObject(result);
-    } else if (isInt() && rhs->isDouble()) {
-        double result = asInt() - rhs->asDouble();
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isInt()) {
-        double result = asDouble() - rhs->asInt();
-        return runtime->newObject(result);
-    } else if (isChar() && rhs->isInt()) {
-        char result = static_cast<char>(asChar() - rhs->asInt());
-        return runtime->newObject(result);
-    } else if (isInt() && rhs->isChar()) {
-        char result = static_cast<char>(asInt() - rhs->asChar());
-        return runtime->newObject(result);
-    } else if (isChar() && rhs->isChar()) {
-        char result = static_cast<char>(asChar() - rhs->asChar());
-        return runtime->newObject(result);
-    } else {
-        panic("unexpected arguments of operator -");
+template <ValueType L, ValueType R>
+struct Div {
+    static Value apply(Value lhs, Value rhs) {
+        if constexpr (isNumeric<L, R>) {
+            return runtime->newObject(Payload<L>::get(lhs) /
+                                      Payload<R>::get(rhs));
+        } else {
+            panic("unexpected arguments of operator /");
+        }
     }
+};
 
-    return nullptr;
+// Operators that are only defined on a single type T
+template <ValueType T, typename Operation>
+struct Homogeneous {
+    template <ValueType L, ValueType R>
+    struct Op {
+        static Value apply(Value lhs, Value rhs) {
+            if constexpr (L == T && R == T) {
+                return runtime->newObject(
+                    Operation()(Payload<L>::get(lhs), Payload<R>::get(rhs)));
+            } else {
+                checkObjectType(lhs, T);
+                checkObjectType(rhs, T);
+                return nullptr;
+            }
+        }
+    };
+};
+
+template <bool Negated>
+struct Equality {
+    template <ValueType L, ValueType R>
+    struct Op {
+        static Value apply(Value lhs, Value rhs) {
+            bool result = false;
+            if constexpr (L != R) {
+                panic("unexpected arguments of operator %s",
+                      Negated ? "!=" : "==");
+            } else if constexpr (L == Null) {
+                result = true;
+            } else if constexpr (L == Array) {
+                result = lhs.equalsDeep(rhs);
+            } else if constexpr (L == Closure) {
+                panic("unexpected arguments of operator %s",
+                      Negated ? "!=" : "==");
+            } else {
+                result = Payload<L>::get(lhs) == Payload<R>::get(rhs);
+            }
+            return runtime->newObject(result != Negated);
+        }
+    };
+};
+
+template <typename Compare>
+struct Relation {
+    template <ValueType L, ValueType R>
+    struct Op {
+        static Value apply(Value lhs, Value rhs) {
+            if constexpr (isOrdered<L, R>) {
+                bool result =
+                    Compare()(Payload<L>::get(lhs), Payload<R>::get(rhs));
+                return runtime->newObject(std::move(result));
+            } else {
+                panic("unexpected arguments of relational operator");
+            }
+        }
+    };
+};
+
+using BinaryOperation = Value (*)(Value, Value);
+
+template <template <ValueType, ValueType> class Operation, size_t... Index>
+constexpr std::array<BinaryOperation, sizeof...(Index)> makeDispatchTable(
+    std::index_sequence<Index...>) {
+    return {&Operation<ValueType(Index / NumValueTypes),
+                       ValueType(Index % NumValueTypes)>::apply...};
 }
 
-Object* Object::operator*(Object* rhs) const {
-    // Basic
-    if (isInt() && rhs->isInt()) {
-        int result = asInt() * rhs->asInt();
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isDouble()) {
-        double result = asDouble() * rhs->asDouble();
-        return runtime->newObject(result);
-    } else if (isInt() && rhs->isDouble()) {
-        double result = asInt() * rhs->asDouble();
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isInt()) {
-        double result = asDouble() * rhs->asInt();
-        return runtime->newObject(result);
-    }
-    // String
-    else if (isString() && rhs->isInt()) {
-        std::string result = repeatString(rhs->asInt(), asString());
-        return runtime->newObject(result);
-    } else if (isInt() && rhs->isString()) {
-        std::string result = repeatString(asInt(), rhs->asString());
-        return runtime->newObject(result);
-    }
-    // Invalid
-    else {
-        panic("unexpected arguments of operator *");
-    }
-    return nullptr;
+template <template <ValueType, ValueType> class Operation>
+constexpr auto dispatchTable = makeDispatchTable<Operation>(
+    std::make_index_sequence<NumValueTypes * NumValueTypes>());
+
+template <template <ValueType, ValueType> class Operation>
+Value dispatch(Value lhs, Value rhs) {
+    return dispatchTable<Operation>[lhs.getType() * NumValueTypes +
+                                    rhs.getType()](lhs, rhs);
 }
+}  // namespace
 
-Object* Object::operator/(Object* rhs) const {
-    if (isInt() && rhs->isInt()) {
-        int result = asInt() / rhs->asInt();
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isDouble()) {
-        double result = asDouble() / rhs->asDouble();
-        return runtime->newObject(result);
-    } else if (isInt() && rhs->isDouble()) {
-        double result = asInt() / rhs->asDouble();
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isInt()) {
-        double result = asDouble() / rhs->asInt();
-        return runtime->newObject(result);
-    } else {
-        panic("unexpected arguments of operator /");
-    }
-    return nullptr;
+Value Value::operator+(Value rhs) const {
+    return dispatch<Add>(*this, rhs);
 }
 
-Object* Object::operator%(Object* rhs) const {
-    checkObjectType(this, Int);
-    checkObjectType(rhs, Int);
-    int result = (int)asInt() % rhs->asInt();
-    return runtime->newObject(result);
+Value Value::operator-(Value rhs) const {
+    return dispatch<Sub>(*this, rhs);
 }
 
-Object* Object::operator&&(Object* rhs) const {
-    checkObjectType(this, Bool);
-    checkObjectType(rhs, Bool);
-    bool result = (asBool() && rhs->asBool());
-    return runtime->newObject(result);
+Value Value::operator*(Value rhs) const {
+    return dispatch<Mul>(*this, rhs);
 }
 
-Object* Object::operator||(Object* rhs) const {
-    checkObjectType(this, Bool);
-    checkObjectType(rhs, Bool);
-    bool result = (asBool() || rhs->asBool());
-    return runtime->newObject(result);
+Value Value::operator/(Value rhs) const {
+    return dispatch<Div>(*this, rhs);
 }
 
-Object* Object::operator==(Object* rhs) const {
-    bool result = false;
-    if (isInt() && rhs->isInt()) {
-        result = (asInt() == rhs->asInt());
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isDouble()) {
-        result = (asDouble() == rhs->asDouble());
-        return runtime->newObject(result);
-    } else if (isString() && rhs->isString()) {
-        std::string lhsStr, rhsStr;
-        lhsStr = this->toString();
-        rhsStr = rhs->toString();
-        result = (lhsStr == rhsStr);
-        return runtime->newObject(result);
-    } else if (isBool() && rhs->isBool()) {
-        result = (asBool() == rhs->asBool());
-        return runtime->newObject(result);
-    } else if (this->type == Null && rhs->type == Null) {
-        result = true;
-        return runtime->newObject(result);
-    } else if (isChar() && rhs->isChar()) {
-        result = (asChar() == rhs->asChar());
-        return runtime->newObject(result);
-    } else if (isArray() && rhs->isArray()) {
-        result = this->equalsDeep(rhs);
-        return runtime->newObject(result);
-    } else {
-        panic("unexpected arguments of operator ==");
-    }
-    return nullptr;
+Value Value::operator%(Value rhs) const {
+    return dispatch<Homogeneous<Int, std::modulus<>>::Op>(*this, rhs);
 }
 
-Object* Object::operator!=(Object* rhs) const {
-    bool result = false;
-    if (isInt() && rhs->isInt()) {
-        result = (asInt() != rhs->asInt());
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isDouble()) {
-        result = (asDouble() != rhs->asDouble());
-        return runtime->newObject(result);
-    } else if (isString() && rhs->isString()) {
-        std::string lhsStr, rhsStr;
-        lhsStr = this->toString();
-        rhsStr = rhs->toString();
-        result = (lhsStr != rhsStr);
-        return runtime->newObject(result);
-    } else if (isBool() && rhs->isBool()) {
-        result = (asBool() != rhs->asBool());
-        return runtime->newObject(result);
-    } else if (this->type == Null && rhs->type == Null) {
-        result = false;
-        return runtime->newObject(result);
-    } else if (isChar() && rhs->isChar()) {
-        result = (asChar() != rhs->asChar());
-        return runtime->newObject(result);
-    } else if (isArray() && rhs->isArray()) {
-        result = !this->equalsDeep(rhs);
-        return runtime->newObject(result);
-    } else {
-        panic("unexpected arguments of operator !=");
-    }
-    return nullptr;
+Value Value::operator&&(Value rhs) const {
+    return dispatch<Homogeneous<Bool, std::logical_and<>>::Op>(*this, rhs);
 }
 
-Object* Object::operator>(Object* rhs) const {
-    bool result = false;
-    if (isInt() && rhs->isInt()) {
-        result = (asInt() > rhs->asInt());
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isDouble()) {
-        result = (asDouble() > rhs->asDouble());
-        return runtime->newObject(result);
-    } else if (isString() && rhs->isString()) {
-        std::string lhsStr, rhsStr;
-        lhsStr = this->toString();
-        rhsStr = rhs->toString();
-        result = (lhsStr > rhsStr);
-        return runtime->newObject(result);
-    } else if (isChar() && rhs->isChar()) {
-        result = (asChar() > rhs->asChar());
-        return runtime->newObject(result);
-    } else {
-        panic("unexpected arguments of operator <=");
-    }
-    return nullptr;
+Value Value::operator||(Value rhs) const {
+    return dispatch<Homogeneous<Bool, std::logical_or<>>::Op>(*this, rhs);
 }
 
-Object* Object::operator>=(Object* rhs) const {
-    bool result = false;
-    if (isInt() && rhs->isInt()) {
-        result = (asInt() >= rhs->asInt());
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isDouble()) {
-        result = (asDouble() >= rhs->asDouble());
-        return runtime->newObject(result);
-    } else if (isString() && rhs->isString()) {
-        std::string lhsStr, rhsStr;
-        lhsStr = this->toString();
-        rhsStr = rhs->toString();
-        result = (lhsStr >= rhsStr);
-        return runtime->newObject(result);
-    } else if (isChar() && rhs->isChar()) {
-        result = (asChar() >= rhs->asChar());
-        return runtime->newObject(result);
-    } else {
-        panic("unexpected arguments of operator <=");
-    }
-    return nullptr;
+Value Value::operator==(Value rhs) const {
+    return dispatch<Equality<false>::Op>(*this, rhs);
 }
 
-Object* Object::operator<(Object* rhs) const {
-    bool result = false;
-    if (isInt() && rhs->isInt()) {
-        result = (asInt() < rhs->asInt());
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isDouble()) {
-        result = (asDouble() < rhs->asDouble());
-        return runtime->newObject(result);
-    } else if (isString() && rhs->isString()) {
-        std::string lhsStr, rhsStr;
-        lhsStr = this->toString();
-        rhsStr = rhs->toString();
-        result = (lhsStr < rhsStr);
-        return runtime->newObject(result);
-    } else if (isChar() && rhs->isChar()) {
-        result = (asChar() < rhs->asChar());
-        return runtime->newObject(result);
-    } else {
-        panic("unexpected arguments of operator <=");
-    }
-    return nullptr;
+Value Value::operator!=(Value rhs) const {
+    return dispatch<Equality<true>::Op>(*this, rhs);
 }
 
-Object* Object::operator<=(Object* rhs) const {
-    bool result = false;
-    if (isInt() && rhs->isInt()) {
-        result = (asInt() <= rhs->asInt());
-        return runtime->newObject(result);
-    } else if (isDouble() && rhs->isDouble()) {
-        result = (asDouble() <= rhs->asDouble());
-        return runtime->newObject(result);
-    } else if (isString() && rhs->isString()) {
-        std::string lhsStr, rhsStr;
-        lhsStr = this->toString();
-        rhsStr = rhs->toString();
-        result = (lhsStr <= rhsStr);
-        return runtime->newObject(result);
-    } else if (isChar() && rhs->isChar()) {
-        result = (asChar() <= rhs->asChar());
-        return runtime->newObject(result);
-    } else {
-        panic("unexpected arguments of operator <=");
-    }
-    return nullptr;
+Value Value::operator>(Value rhs) const {
+    return dispatch<Relation<std::greater<>>::Op>(*this, rhs);
+}
+
+Value Value::operator>=(Value rhs) const {
+    return dispatch<Relation<std::greater_equal<>>::Op>(*this, rhs);
 }
 
-Object* Object::operator&(Object* rhs) const {
-    checkObjectType(this, Int);
-    checkObjectType(rhs, Int);
+Value Value::operator<(Value rhs) const {
+    return dispatch<Relation<std::less<>>::Op>(*this, rhs);
+}
 
-    int result = (asInt() & rhs->asInt());
-    return runtime->newObject(result);
+Value Value::operator<=(Value rhs) const {
+    return dispatch<Relation<std::less_equal<>>::Op>(*this, rhs);
 }
 
-Object* Object::operator|(Object* rhs) const {
-    checkObjectType(this, Int);
-    checkObjectType(rhs, Int);
+Value Value::operator&(Value rhs) const {
+    return dispatch<Homogeneous<Int, std::bit_and<>>::Op>(*this, rhs);
+}
 
-    int result = (asInt() | rhs->asInt());
-    return runtime->newObject(result);
+Value Value::operator|(Value rhs) const {
+    return dispatch<Homogeneous<Int, std::bit_or<>>::Op>(*this, rhs);
 }
 
-Object* Object::operator-() const {
-    switch (type) {
+Value Value::operator-() const {
+    switch (getType()) {
         case Int:
-            return runtime->newObject(-(*(int*)data));
+            return runtime->newObject(-asInt());
         case Double:
-            return runtime->newObject(-(*(double*)data));
+            return runtime->newObject(-asDouble());
         default:
             panic("invalid operand type for operator -(negative)");
     }
     return nullptr;
 }
 
-Object* Object::operator!() const {
-    checkObjectType(this, Bool);
-    return runtime->newObject(!(*(bool*)data));
+Value Value::operator!() const {
+    checkObjectType(*this, Bool);
+    return runtime->newObject(!asBool());
 }
 
-Object* Object::operator~() const {
-    checkObjectType(this, Int);
-    return runtime->newObject(-(*(int*)data));
+Value Value::operator~() const {
+    checkObjectType(*this, Int);
+    return runtime->newObject(-asInt());
 }
\ No newline at end of file
@@ -25,99 +25,259 @@
 #define NYX_OBJECT_HPP
 
 enum ValueType { Int, Double, String, Bool, Char, Null, Array, Closure };
+// Operator dispatch tables cover every type up to the last one
+constexpr int NumValueTypes = Closure + 1;
 
-#include <deque>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
-#include <unordered_map>
+#include <utility>
 #include <vector>
-
-#include "Runtime.hpp"
-
-struct Statement;
-struct Context;
+#include "ObjectString.h"
+
+class Object;
+class Value;
+struct Func;
+struct Variable;
+
+using ObjectArray = std::vector<Value>;
+
+// Function as a value, i.e. a closure or a named function referred to by name.
+// Closures created by the same expression share one function and differ only
+// in variables they captured, which line up with Func::freeVars and are shared
+// with the scope that created them
+struct BoundFunc {
+    Func* func{};
+    std::vector<Variable*> upvalues;
+};
 
 //===----------------------------------------------------------------------===//
-// Runtime object
+// Runtime value, which fits in 64 bits by NaN-boxing. Doubles are stored as
+// they are while ints, bools, chars and null are encoded into payloads of
+// negative quiet NaNs, which no double produces once its NaN is canonicalized.
+// Only strings, arrays and closures are allocated as objects on heap
 //===----------------------------------------------------------------------===//
-class Object {
+class Value {
     friend class Runtime;
+    friend class Gc;
 
 public:
-    int asInt() const { return *(int*)(data); }
-    double asDouble() const { return *(double*)(data); }
-    std::string asString() const { return *(std::string*)(data); }
-    bool asBool() const { return *(bool*)(data); }
-    char asChar() const { return *(char*)(data); }
+    // No value at all, e.g. what a function without return statement returns,
+    // it's seen as null
+    Value() = default;
+    Value(std::nullptr_t) {}
+    explicit Value(int data) : bits(IntTag | (uint32_t)data) {}
+    explicit Value(double data) {
+        if (data != data) {
+            bits = CanonicalNaN;
+        } else {
+            memcpy(&bits, &data, sizeof(double));
+        }
+    }
+    explicit Value(bool data) : bits(BoolTag | (uint64_t)data) {}
+    explicit Value(char data) : bits(CharTag | (uint8_t)data) {}
+    explicit Value(Object* object) : bits(HeapTag | (uintptr_t)object) {}
+
+    static Value null() {
+        Value value;
+        value.bits = NullTag;
+        return value;
+    }
+
+    int asInt() const { return (int)(uint32_t)bits; }
+    double asDouble() const {
+        double data;
+        memcpy(&data, &bits, sizeof(double));
+        return data;
+    }
+    const ObjectString& asString() const;
+    bool asBool() const { return (bits & 1) != 0; }
+    char asChar() const { return (char)(uint8_t)bits; }
     std::nullptr_t asNull() const { return nullptr; }
-    ObjectArray asArray() const { return *(ObjectArray*)(data); }
-    Func asClosure() const { return *(Func*)(data); }
+    const ObjectArray& asArray() const;
+    BoundFunc* asClosure() const;
+
+    bool isInt() const { return tag() == IntTag; }
+    bool isDouble() const { return (bits & BoxMask) != BoxMask; }
+    bool isString() const { return isObject(String); }
+    bool isBool() const { return tag() == BoolTag; }
+    bool isChar() const { return tag() == CharTag; }
+    bool isNull() const { return tag() == NullTag || tag() == EmptyTag; }
+    bool isArray() const { return isObject(Array); }
+    bool isClosure() const { return isObject(Closure); }
+    bool isType(ValueType t) const { return t == getType(); }
+    bool isHeapObject() const { return tag() == HeapTag; }
 
-    bool isInt() const { return type == Int; }
-    bool isDouble() const { return type == Double; }
-    bool isString() const { return type == String; }
-    bool isBool() const { return type == Bool; }
-    bool isChar() const { return type == Char; }
-    bool isNull() const { return type == Null; }
-    bool isArray() const { return type == Array; }
-    bool isClosure() const { return type == Closure; }
-    bool isType(ValueType t) const { return t == type; }
+    Value operator+(Value rhs) const;
 
-    Object* operator+(Object* rhs) const;
+    Value operator-(Value rhs) const;
 
-    Object* operator-(Object* rhs) const;
+    Value operator*(Value rhs) const;
 
-    Object* operator*(Object* rhs) const;
+    Value operator/(Value rhs) const;
 
-    Object* operator/(Object* rhs) const;
+    Value operator%(Value rhs) const;
 
-    Object* operator%(Object* rhs) const;
+    Value operator&&(Value rhs) const;
 
-    Object* operator&&(Object* rhs) const;
+    Value operator||(Value rhs) const;
 
-    Object* operator||(Object* rhs) const;
+    Value operator==(Value rhs) const;
 
-    Object* operator==(Object* rhs) const;
+    Value operator!=(Value rhs) const;
 
-    Object* operator!=(Object* rhs) const;
+    Value operator>(Value rhs) const;
 
-    Object* operator>(Object* rhs) const;
+    Value operator>=(Value rhs) const;
 
-    Object* operator>=(Object* rhs) const;
+    Value operator<(Value rhs) const;
 
-    Object* operator<(Object* rhs) const;
+    Value operator<=(Value rhs) const;
 
-    Object* operator<=(Object* rhs) const;
+    Value operator&(Value rhs) const;
 
-    Object* operator&(Object* rhs) const;
+    Value operator|(Value rhs) const;
 
-    Object* operator|(Object* rhs) const;
+    Value operator-() const;
 
-    Object* operator-() const;
+    Value operator!() const;
 
-    Object* operator!() const;
+    Value operator~() const;
 
-    Object* operator~() const;
+    // Whether it's no value, which is not the same as null
+    bool operator==(std::nullptr_t) const { return bits == EmptyTag; }
+    bool operator!=(std::nullptr_t) const { return bits != EmptyTag; }
 
-    bool equalsDeep(Object* b) const;
+    bool equalsDeep(Value b) const;
 
     std::string toString() const;
 
     bool isPrimitive() const;
 
-    ValueType getType() const { return type; }
+    ValueType getType() const;
 
     template <typename T>
-    void resetObject(T data) {
-        *(T*)(this->data) = data;
+    void resetObject(T data);
+
+private:
+    static constexpr uint64_t BoxMask = 0xFFF8000000000000;
+    static constexpr uint64_t TagMask = 0xFFFF000000000000;
+    static constexpr uint64_t EmptyTag = 0xFFF8000000000000;
+    static constexpr uint64_t IntTag = 0xFFF9000000000000;
+    static constexpr uint64_t BoolTag = 0xFFFA000000000000;
+    static constexpr uint64_t CharTag = 0xFFFB000000000000;
+    static constexpr uint64_t NullTag = 0xFFFC000000000000;
+    static constexpr uint64_t HeapTag = 0xFFFD000000000000;
+    static constexpr uint64_t CanonicalNaN = 0x7FF8000000000000;
+
+    uint64_t tag() const { return bits & TagMask; }
+
+    Object* object() const { return (Object*)(uintptr_t)(bits & ~TagMask); }
+
+    bool isObject(ValueType t) const;
+
+    uint64_t bits{EmptyTag};
+};
+
+//===----------------------------------------------------------------------===//
+// Heap object, i.e. a string, an array or a closure. Its payload lives within
+// the object itself so that it's allocated at once and reached by one load
+//===----------------------------------------------------------------------===//
+class Object {
+    friend class Runtime;
+    friend class Value;
+    friend class Gc;
+
+public:
+    ~Object() {
+        if (!forwarded) {
+            release();
+        }
     }
 
 private:
-    explicit Object() = default;
+    explicit Object(ObjectString data) : type(String), str(std::move(data)) {}
+    explicit Object(ObjectArray data) : type(Array), array(std::move(data)) {}
+    explicit Object(BoundFunc data) : type(Closure), closure(std::move(data)) {}
+
+    // Strings are immutable and never reset
+    void reset(ObjectArray data) { array = std::move(data); }
+
+    void release() {
+        switch (type) {
+            case String:
+                str.~ObjectString();
+                break;
+            case Array:
+                array.~vector();
+                break;
+            default:
+                closure.~BoundFunc();
+                break;
+        }
+    }
 
-    explicit Object(ValueType type, void* data) : type(type), data(data) {}
+    // Payload was moved to its copy in old generation, which takes its place
+    void forward(Object* copy) {
+        release();
+        forwarded = true;
+        forwardee = copy;
+    }
 
     ValueType type;
-    void* data;
+    bool marked{};
+    // It's allocated in nursery, see Gc
+    bool young{};
+    bool forwarded{};
+    // It's in remembered set of Gc
+    bool remembered{};
+    union {
+        // Immutable, its bytes may be shared with other strings
+        ObjectString str;
+        ObjectArray array;
+        BoundFunc closure;
+        Object* forwardee;
+    };
 };
 
+inline const ObjectString& Value::asString() const {
+    return object()->str;
+}
+
+inline const ObjectArray& Value::asArray() const {
+    return object()->array;
+}
+
+inline BoundFunc* Value::asClosure() const {
+    return &object()->closure;
+}
+
+inline bool Value::isObject(ValueType t) const {
+    return tag() == HeapTag && object()->type == t;
+}
+
+inline ValueType Value::getType() const {
+    switch (tag()) {
+        case IntTag:
+            return Int;
+        case BoolTag:
+            return Bool;
+        case CharTag:
+            return Char;
+        case NullTag:
+        case EmptyTag:
+            return Null;
+        case HeapTag:
+            return object()->type;
+        default:
+            return Double;
+    }
+}
+
+template <typename T>
+void Value::resetObject(T data) {
+    object()->reset(std::move(data));
+}
+
 #endif  // NYX_OBJECT_HPP
@@ -0,0 +1,147 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "ObjectString.h"
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <vector>
+
+ObjectString::ObjectString(std::string_view data) {
+    if (!data.empty()) {
+        rep = allocate(data.size());
+        memcpy(rep->data, data.data(), data.size());
+    }
+}
+
+ObjectString ObjectString::concat(std::string_view lhs, std::string_view rhs) {
+    ObjectString result;
+    if (lhs.size() + rhs.size() != 0) {
+        result.rep = allocate(lhs.size() + rhs.size());
+        memcpy(result.rep->data, lhs.data(), lhs.size());
+        memcpy(result.rep->data + lhs.size(), rhs.data(), rhs.size());
+    }
+    return result;
+}
+
+ObjectString ObjectString::concat(const ObjectString& lhs,
+                                  const ObjectString& rhs) {
+    if (rhs.empty()) {
+        return lhs;
+    }
+    if (lhs.empty()) {
+        return rhs;
+    }
+    if (lhs.length() + rhs.length() <= MaxShortLength) {
+        return concat(lhs.view(), rhs.view());
+    }
+    // A short piece appended to a rope ending with a short leaf is merged
+    // into that leaf, which keeps ropes built by appending short pieces from
+    // growing a node per piece
+    const Rep* last = lhs.rep->data == nullptr ? lhs.rep->right : nullptr;
+    if (last != nullptr && last->left == nullptr &&
+        last->length + rhs.length() <= MaxShortLength) {
+        ObjectString leaf =
+            concat(std::string_view(last->data, last->length), rhs.view());
+        return ObjectString(makeRope(lhs.rep->left, leaf.rep));
+    }
+    return ObjectString(makeRope(lhs.rep, rhs.rep));
+}
+
+ObjectString::Rep* ObjectString::allocate(size_t length) {
+    void* block = ::operator new(sizeof(Rep) + length);
+    Rep* rep = new (block) Rep{1, length, 0, nullptr, nullptr, nullptr};
+    rep->data = reinterpret_cast<char*>(rep + 1);
+    return rep;
+}
+
+ObjectString::Rep* ObjectString::makeRope(Rep* left, Rep* right) {
+    left->refs++;
+    right->refs++;
+    return new Rep{1, left->length + right->length, 0, nullptr, left, right};
+}
+
+void ObjectString::flatten(const Rep* rope) {
+    char* data = static_cast<char*>(::operator new(rope->length));
+    char* cursor = data;
+    // Leaves are visited from left to right, halves of ropes that are
+    // flattened already are skipped
+    std::vector<const Rep*> worklist{rope};
+    while (!worklist.empty()) {
+        const Rep* node = worklist.back();
+        worklist.pop_back();
+        if (node->data != nullptr) {
+            memcpy(cursor, node->data, node->length);
+            cursor += node->length;
+        } else {
+            worklist.push_back(node->right);
+            worklist.push_back(node->left);
+        }
+    }
+    rope->data = data;
+    release(rope->left);
+    release(rope->right);
+    rope->left = nullptr;
+    rope->right = nullptr;
+}
+
+void ObjectString::destroy(Rep* rep) {
+    std::vector<Rep*> worklist{rep};
+    while (!worklist.empty()) {
+        Rep* node = worklist.back();
+        worklist.pop_back();
+        for (Rep* half : {node->left, node->right}) {
+            if (half != nullptr && --half->refs == 0) {
+                worklist.push_back(half);
+            }
+        }
+        if (node->data == reinterpret_cast<char*>(node + 1)) {
+            // Bytes follow the header in the same block
+            node->~Rep();
+            ::operator delete(node);
+        } else {
+            ::operator delete(node->data);
+            delete node;
+        }
+    }
+}
+
+size_t ObjectString::hash() const {
+    if (rep == nullptr) {
+        return 0;
+    }
+    if (rep->hash == 0) {
+        // FNV-1a, where zero is taken to mean the hash is not computed yet
+        uint64_t hash = 14695981039346656037ULL;
+        for (char c : view()) {
+            hash = (hash ^ (uint8_t)c) * 1099511628211ULL;
+        }
+        rep->hash = hash != 0 ? (size_t)hash : 1;
+    }
+    return rep->hash;
+}
+
+std::ostream& operator<<(std::ostream& os, const ObjectString& str) {
+    return os.write(str.view().data(), (std::streamsize)str.length());
+}
@@ -0,0 +1,177 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#ifndef NYX_OBJECT_STRING_H
+#define NYX_OBJECT_STRING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+//===----------------------------------------------------------------------===//
+// Immutable string shared by reference counting. Bytes are allocated once in
+// a block following a header that keeps the count, the length and the hash,
+// which is computed on first use and cached. Copying a string, e.g. passing it
+// to a function or assigning it to a variable, only bumps the count.
+//
+// Concatenating long strings makes a rope, i.e. a node referring to both of
+// them, instead of copying their bytes. A rope is flattened into a block of
+// its own the first time its bytes are asked for, e.g. when it's compared or
+// printed, so that building a string piece by piece takes linear time
+//===----------------------------------------------------------------------===//
+class ObjectString {
+public:
+    // Strings up to this length are always flat, so are leaves of ropes that
+    // short pieces are appended to
+    static constexpr size_t MaxShortLength = 256;
+
+    // The empty string, which owns no block at all
+    ObjectString() = default;
+    explicit ObjectString(std::string_view data);
+    ObjectString(const ObjectString& other) : rep(other.rep) { retain(); }
+    ObjectString(ObjectString&& other) noexcept : rep(other.rep) {
+        other.rep = nullptr;
+    }
+    ~ObjectString() { release(rep); }
+
+    ObjectString& operator=(ObjectString other) noexcept {
+        std::swap(rep, other.rep);
+        return *this;
+    }
+
+    // String whose bytes are lhs followed by rhs, built in a single allocation
+    static ObjectString concat(std::string_view lhs, std::string_view rhs);
+
+    // Same as above but it makes a rope when the result is long, either side
+    // is returned as it is when the other one is empty
+    static ObjectString concat(const ObjectString& lhs,
+                               const ObjectString& rhs);
+
+    std::string_view view() const {
+        return rep ? std::string_view(bytes(), rep->length)
+                   : std::string_view();
+    }
+
+    size_t length() const { return rep ? rep->length : 0; }
+
+    bool empty() const { return length() == 0; }
+
+    // Bytes allocated for this string, which leave out halves of a rope
+    size_t footprint() const {
+        return rep ? sizeof(Rep) + (rep->data ? rep->length : 0) : 0;
+    }
+
+    size_t hash() const;
+
+    std::string str() const { return std::string(view()); }
+
+    // Strings sharing a block are equal without looking at bytes, the ones
+    // whose lengths or cached hashes differ are not
+    bool operator==(const ObjectString& rhs) const {
+        if (rep == rhs.rep) {
+            return true;
+        }
+        if (length() != rhs.length() ||
+            (rep->hash != 0 && rhs.rep->hash != 0 &&
+             rep->hash != rhs.rep->hash)) {
+            return false;
+        }
+        return view() == rhs.view();
+    }
+
+    bool operator!=(const ObjectString& rhs) const { return !(*this == rhs); }
+
+    bool operator<(const ObjectString& rhs) const {
+        return rep != rhs.rep && view() < rhs.view();
+    }
+
+    bool operator>(const ObjectString& rhs) const { return rhs < *this; }
+
+    bool operator<=(const ObjectString& rhs) const { return !(rhs < *this); }
+
+    bool operator>=(const ObjectString& rhs) const { return !(*this < rhs); }
+
+private:
+    struct Rep {
+        size_t refs;
+        size_t length;
+        // Zero until it's computed
+        mutable size_t hash;
+        // Bytes, which follow the header of a flat string. They are null for
+        // a rope until it's flattened into a block of its own
+        mutable char* data;
+        // Halves of a rope, which are released once it's flattened
+        mutable Rep* left;
+        mutable Rep* right;
+    };
+
+    explicit ObjectString(Rep* rep) : rep(rep) {}
+
+    static Rep* allocate(size_t length);
+
+    static Rep* makeRope(Rep* left, Rep* right);
+
+    static void flatten(const Rep* rope);
+
+    // Drop a reference to rep, ropes are released without recursion since
+    // they might be as deep as the number of pieces they were built from
+    static void release(Rep* rep) {
+        if (rep != nullptr && --rep->refs == 0) {
+            destroy(rep);
+        }
+    }
+
+    static void destroy(Rep* rep);
+
+    const char* bytes() const {
+        if (rep->data == nullptr) {
+            flatten(rep);
+        }
+        return rep->data;
+    }
+
+    void retain() {
+        if (rep != nullptr) {
+            rep->refs++;
+        }
+    }
+
+    Rep* rep{};
+};
+
+std::ostream& operator<<(std::ostream& os, const ObjectString& str);
+
+namespace std {
+template <>
+struct hash<ObjectString> {
+    size_t operator()(const ObjectString& str) const noexcept {
+        return str.hash();
+    }
+};
+}  // namespace std
+
+#endif  // NYX_OBJECT_STRING_H
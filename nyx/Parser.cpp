@@ -49,7 +49,7 @@ Parser::~Parser() {
 Expression* Parser::parsePrimaryExpr() {
     switch (getCurrentToken()) {
         case TK_IDENT: {
-            auto ident = getCurrentLexeme();
+            auto ident = getCurrentSymbol();
             currentToken = next();
             switch (getCurrentToken()) {
                 case TK_LPAREN: {
@@ -106,6 +106,7 @@ Expression* Parser::parsePrimaryExpr() {
             currentToken = next();
             assert(getCurrentToken() == TK_LPAREN);
             auto* ret = new ClosureExpr(line, column);
+            hasClosure = true;
             ret->params = parseParameterList();
             if (getCurrentToken() == TK_LBRACE) {
                 ret->block = parseBlock();
@@ -136,7 +137,7 @@ Expression* Parser::parsePrimaryExpr() {
             auto val = getCurrentLexeme();
             currentToken = next();
             auto* ret = new StringExpr(line, column);
-            ret->literal = val;
+            ret->literal = ObjectString(val);
             return ret;
         }
         case LIT_CHAR: {
@@ -328,7 +329,7 @@ MatchStmt* Parser::parseMatchStmt() {
             }
 
             if (typeid(*theCase) == typeid(NameExpr) &&
-                dynamic_cast<NameExpr*>(theCase)->identName == "_") {
+                dynamic_cast<NameExpr*>(theCase)->identName.str() == "_") {
                 node->matches.emplace_back(theCase, block, true);
             } else {
                 node->matches.emplace_back(theCase, block, false);
@@ -342,6 +343,11 @@ MatchStmt* Parser::parseMatchStmt() {
 ReturnStmt* Parser::parseReturnStmt() {
     auto* node = new ReturnStmt(line, column);
     node->ret = parseExpression();
+    if (tailCalls != nullptr && node->ret != nullptr &&
+        typeid(*node->ret) == typeid(FunCallExpr) &&
+        dynamic_cast<FunCallExpr*>(node->ret)->receiver == nullptr) {
+        tailCalls->push_back(node);
+    }
     return node;
 }
 
@@ -401,8 +407,8 @@ Block* Parser::parseBlock() {
     return node;
 }
 
-std::vector<std::string> Parser::parseParameterList() {
-    std::vector<std::string> node;
+std::vector<Symbol> Parser::parseParameterList() {
+    std::vector<Symbol> node;
     currentToken = next();
     if (getCurrentToken() == TK_RPAREN) {
         currentToken = next();
@@ -411,7 +417,7 @@ std::vector<std::string> Parser::parseParameterList() {
 
     while (getCurrentToken() != TK_RPAREN) {
         if (getCurrentToken() == TK_IDENT) {
-            node.push_back(getCurrentLexeme());
+            node.push_back(getCurrentSymbol());
         } else {
             assert(getCurrentToken() == TK_COMMA);
         }
@@ -427,18 +433,29 @@ Func* Parser::parseFuncDef(Context* context) {
     currentToken = next();
 
     // Check if function was already be defined
-    if (context->hasFunction(getCurrentLexeme())) {
+    if (context->hasFunction(getCurrentSymbol())) {
         panic("multiply function definitions of %s found",
               getCurrentLexeme().c_str());
     }
 
     auto* node = new Func;
-    node->name = getCurrentLexeme();
+    node->name = getCurrentSymbol();
     currentToken = next();
     assert(getCurrentToken() == TK_LPAREN);
     node->params = parseParameterList();
+    std::vector<ReturnStmt*> returns;
+    tailCalls = &returns;
+    hasClosure = false;
     node->block = parseBlock();
+    tailCalls = nullptr;
 
+    // Frame of a function is freed once it makes a tail call, which is not
+    // possible if closures might have captured it
+    if (!hasClosure) {
+        for (auto* ret : returns) {
+            ret->tailCall = dynamic_cast<FunCallExpr*>(ret->ret);
+        }
+    }
     return node;
 }
 
@@ -522,10 +539,11 @@ std::tuple<Token, std::string> Parser::next() {
             lexeme += c;
             cn = peekNextChar();
         }
-        auto result = KEYWORDS.find(lexeme);
-        return result != KEYWORDS.end()
-                   ? std::make_tuple(result->second, lexeme)
-                   : std::make_tuple(TK_IDENT, lexeme);
+        if (auto result = KEYWORDS.find(lexeme); result != KEYWORDS.end()) {
+            return std::make_tuple(result->second, lexeme);
+        }
+        currentSymbol = Symbol(lexeme);
+        return std::make_tuple(TK_IDENT, lexeme);
     }
 
     switch (c) {
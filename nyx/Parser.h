@@ -72,7 +72,7 @@ private:
 
     Block* parseBlock();
 
-    std::vector<std::string> parseParameterList();
+    std::vector<Symbol> parseParameterList();
 
     Func* parseFuncDef(Context* context);
 
@@ -94,12 +94,23 @@ private:
         return std::get<std::string>(currentToken);
     }
 
+    // Symbol of current token, which must be an identifier
+    inline Symbol getCurrentSymbol() const { return currentSymbol; }
+
 private:
     std::tuple<Token, std::string> currentToken;
 
+    // Identifiers are interned by lexer, this is the last one it has seen
+    Symbol currentSymbol;
+
     std::fstream fs;
 
     int line = 1;
 
     int column = 0;
+
+    // Return statements of the named function being parsed that return
+    // results of calls, and whether it creates closures
+    std::vector<ReturnStmt*>* tailCalls{};
+    bool hasClosure{};
 };
@@ -0,0 +1,297 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Resolver.h"
+#include <algorithm>
+#include <typeinfo>
+#include "Rewriter.h"
+#include "Utils.hpp"
+
+// Names that a loop assigns at its own level, that is, neither within blocks
+// nested in it nor within closures
+class LoopLocals : public AstRewriter {
+public:
+    std::vector<Symbol> names;
+
+private:
+    void assigned(Symbol name) {
+        if (std::find(names.begin(), names.end(), name) == names.end()) {
+            names.push_back(name);
+        }
+    }
+
+    void visitAssignExpr(AssignExpr* node) override {
+        if (typeid(*node->lhs) == typeid(NameExpr)) {
+            assigned(static_cast<NameExpr*>(node->lhs)->identName);
+        } else if (typeid(*node->lhs) == typeid(IndexExpr)) {
+            assigned(static_cast<IndexExpr*>(node->lhs)->identName);
+        }
+        AstRewriter::visitAssignExpr(node);
+    }
+
+    void visitClosureExpr(ClosureExpr* node) override {}
+
+    void visitIfStmt(IfStmt* node) override { rewriteExpr(node->cond); }
+
+    void visitWhileStmt(WhileStmt* node) override {}
+
+    void visitForStmt(ForStmt* node) override {}
+
+    void visitForEachStmt(ForEachStmt* node) override {}
+
+    void visitMatchStmt(MatchStmt* node) override {
+        rewriteExpr(node->cond);
+        for (auto& [theCase, block, isAny] : node->matches) {
+            if (!isAny) {
+                rewriteExpr(theCase);
+            }
+        }
+    }
+};
+
+void Resolver::resolveAll() {
+    scopes.emplace_back();
+    for (auto* stmt : rt->getStatements()) {
+        stmt->visit(this);
+    }
+    scopes.clear();
+    for (auto& [name, f] : rt->getFunctions()) {
+        resolveFunc(f, f->params, f->block);
+    }
+}
+
+void Resolver::resolve(Expression* node) {
+    if (node != nullptr) {
+        node->visit(this);
+    }
+}
+
+void Resolver::resolve(Block* block) {
+    for (auto* stmt : block->stmts) {
+        stmt->visit(this);
+    }
+}
+
+void Resolver::resolveFunc(Func* f,
+                           std::vector<Symbol> base,
+                           Block* block) {
+    // Function sees nothing of scopes it's created in but what it captured
+    std::vector<std::vector<Symbol>> outer = std::move(scopes);
+    Func* enclosing = func;
+    scopes.clear();
+    scopes.push_back(std::move(base));
+    func = f;
+    resolve(block);
+    f->frameSize = (int)scopes.front().size();
+    f->captured.resize(f->frameSize);
+    scopes = std::move(outer);
+    func = enclosing;
+}
+
+void Resolver::hoist(const std::vector<Expression*>& exprs, Block* block) {
+    LoopLocals locals;
+    for (auto* e : exprs) {
+        locals.rewriteExpr(e);
+    }
+    locals.rewriteBlock(block);
+    for (const auto& name : locals.names) {
+        if (!lookup(name).isResolved()) {
+            define(name);
+        }
+    }
+}
+
+Address Resolver::lookup(Symbol name) const {
+    for (int i = (int)scopes.size() - 1; i >= 0; i--) {
+        const auto& scope = scopes[i];
+        if (auto iter = std::find(scope.begin(), scope.end(), name);
+            iter != scope.end()) {
+            return Address{(int)scopes.size() - 1 - i,
+                           (int)(iter - scope.begin())};
+        }
+    }
+    return Address{};
+}
+
+Address Resolver::define(Symbol name) {
+    scopes.back().push_back(name);
+    return Address{0, (int)scopes.back().size() - 1};
+}
+
+void Resolver::capture(Address addr) {
+    if (func == nullptr || addr.depth != (int)scopes.size() - 1) {
+        return;
+    }
+    if (addr.slot >= (int)func->captured.size()) {
+        func->captured.resize(addr.slot + 1);
+    }
+    func->captured[addr.slot] = true;
+}
+
+void Resolver::visitArrayExpr(ArrayExpr* node) {
+    for (auto* e : node->literal) {
+        resolve(e);
+    }
+}
+
+void Resolver::visitNameExpr(NameExpr* node) {
+    node->addr = lookup(node->identName);
+    if (!node->addr.isResolved() && !rt->hasFunction(node->identName)) {
+        panic(
+            "use of undefined variable \"%s\" at line %d, col "
+            "%d\n",
+            node->identName.c_str(), node->line, node->column);
+    }
+}
+
+void Resolver::visitIndexExpr(IndexExpr* node) {
+    node->addr = lookup(node->identName);
+    if (!node->addr.isResolved()) {
+        panic(
+            "use of undefined variable \"%s\" at line %d, col "
+            "%d\n",
+            node->identName.c_str(), node->line, node->column);
+    }
+    resolve(node->index);
+}
+
+void Resolver::visitBinaryExpr(BinaryExpr* node) {
+    resolve(node->lhs);
+    resolve(node->rhs);
+}
+
+void Resolver::visitFunCallExpr(FunCallExpr* node) {
+    resolve(node->receiver);
+    for (auto* arg : node->args) {
+        resolve(arg);
+    }
+    // Builtin and named functions take precedence over closure variables
+    if (rt->hasBuiltinFunction(node->funcName) ||
+        rt->hasFunction(node->funcName)) {
+        return;
+    }
+    node->addr = lookup(node->funcName);
+    if (!node->addr.isResolved()) {
+        panic("can not find function %s at line %d, col %d",
+              node->funcName.c_str(), node->line, node->column);
+    }
+}
+
+void Resolver::visitAssignExpr(AssignExpr* node) {
+    resolve(node->rhs);
+    if (typeid(*node->lhs) == typeid(NameExpr)) {
+        auto* lhs = static_cast<NameExpr*>(node->lhs);
+        lhs->addr = lookup(lhs->identName);
+        if (!lhs->addr.isResolved()) {
+            lhs->addr = define(lhs->identName);
+        }
+    } else if (typeid(*node->lhs) == typeid(IndexExpr)) {
+        auto* lhs = static_cast<IndexExpr*>(node->lhs);
+        resolve(lhs->index);
+        lhs->addr = lookup(lhs->identName);
+        if (!lhs->addr.isResolved()) {
+            lhs->addr = define(lhs->identName);
+        }
+    }
+}
+
+void Resolver::visitClosureExpr(ClosureExpr* node) {
+    Func* f = ClosureConverter::prototype(node);
+    std::vector<Symbol> base = f->params;
+    for (auto& freeVar : f->freeVars) {
+        freeVar.capture = lookup(freeVar.name);
+        if (!freeVar.capture.isResolved() && !freeVar.assigned &&
+            !rt->hasBuiltinFunction(freeVar.name) &&
+            !rt->hasFunction(freeVar.name)) {
+            // It's referred to before being defined, which is done once the
+            // closure is created, see Interpreter::newClosure
+            freeVar.capture = define(freeVar.name);
+        }
+        if (freeVar.capture.isResolved()) {
+            capture(freeVar.capture);
+            freeVar.slot = (int)base.size();
+            base.push_back(freeVar.name);
+        }
+    }
+    resolveFunc(f, std::move(base), node->block);
+}
+
+void Resolver::visitSimpleStmt(SimpleStmt* node) {
+    resolve(node->expr);
+}
+
+void Resolver::visitReturnStmt(ReturnStmt* node) {
+    resolve(node->ret);
+}
+
+void Resolver::visitIfStmt(IfStmt* node) {
+    resolve(node->cond);
+    scopes.emplace_back();
+    resolve(node->block);
+    scopes.pop_back();
+    if (node->elseBlock != nullptr) {
+        scopes.emplace_back();
+        resolve(node->elseBlock);
+        scopes.pop_back();
+    }
+}
+
+void Resolver::visitWhileStmt(WhileStmt* node) {
+    scopes.emplace_back();
+    hoist({node->cond}, node->block);
+    resolve(node->cond);
+    resolve(node->block);
+    scopes.pop_back();
+}
+
+void Resolver::visitForStmt(ForStmt* node) {
+    scopes.emplace_back();
+    resolve(node->init);
+    hoist({node->cond, node->post}, node->block);
+    resolve(node->cond);
+    resolve(node->block);
+    resolve(node->post);
+    scopes.pop_back();
+}
+
+void Resolver::visitForEachStmt(ForEachStmt* node) {
+    scopes.emplace_back();
+    node->addr = define(node->identName);
+    resolve(node->list);
+    hoist({}, node->block);
+    resolve(node->block);
+    scopes.pop_back();
+}
+
+void Resolver::visitMatchStmt(MatchStmt* node) {
+    resolve(node->cond);
+    for (auto& [theCase, block, isAny] : node->matches) {
+        // Any(_) case is never evaluated
+        if (!isAny) {
+            resolve(theCase);
+        }
+        scopes.emplace_back();
+        resolve(block);
+        scopes.pop_back();
+    }
+}
@@ -0,0 +1,88 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_RESOLVER_H
+#define NYX_RESOLVER_H
+
+#include <vector>
+#include "Ast.h"
+#include "Runtime.hpp"
+
+//===----------------------------------------------------------------------===//
+// Resolve every variable the program refers to into its address before it
+// runs, so that engines index into contexts instead of looking names up. Scopes
+// are exactly the contexts that engines push, a variable is defined in the
+// innermost one by the first assignment to it, or in the context of a loop if
+// it's assigned there so that later iterations see it. Names that are neither
+// variables nor functions are reported here rather than once they are reached
+//===----------------------------------------------------------------------===//
+class Resolver : public AstVisitor {
+public:
+    explicit Resolver(Runtime* rt) : rt(rt) {}
+
+    // Resolve top-level statements and bodies of all named functions
+    void resolveAll();
+
+private:
+    void visitArrayExpr(ArrayExpr* node) override;
+    void visitNameExpr(NameExpr* node) override;
+    void visitIndexExpr(IndexExpr* node) override;
+    void visitBinaryExpr(BinaryExpr* node) override;
+    void visitFunCallExpr(FunCallExpr* node) override;
+    void visitAssignExpr(AssignExpr* node) override;
+    void visitClosureExpr(ClosureExpr* node) override;
+    void visitSimpleStmt(SimpleStmt* node) override;
+    void visitReturnStmt(ReturnStmt* node) override;
+    void visitIfStmt(IfStmt* node) override;
+    void visitWhileStmt(WhileStmt* node) override;
+    void visitForStmt(ForStmt* node) override;
+    void visitForEachStmt(ForEachStmt* node) override;
+    void visitMatchStmt(MatchStmt* node) override;
+
+    void resolve(Expression* node);
+
+    void resolve(Block* block);
+
+    // Resolve body of f whose context starts with the given variables
+    void resolveFunc(Func* f, std::vector<Symbol> base, Block* block);
+
+    // Define variables that loop assigns at its own level in its context
+    void hoist(const std::vector<Expression*>& exprs, Block* block);
+
+    Address lookup(Symbol name) const;
+
+    Address define(Symbol name);
+
+    // Variable at addr is captured by a closure, it's kept on heap if it's one
+    // of current function's own
+    void capture(Address addr);
+
+    Runtime* rt;
+    // Variables of scopes of current function in the order of their slots,
+    // the innermost scope comes last
+    std::vector<std::vector<Symbol>> scopes;
+    // Function whose body is being resolved, nullptr for top-level statements
+    Func* func{};
+};
+
+#endif  // NYX_RESOLVER_H
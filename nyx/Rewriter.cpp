@@ -0,0 +1,711 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Rewriter.h"
+#include <algorithm>
+#include <typeinfo>
+#include <unordered_set>
+
+void AstRewriter::rewriteAll(Runtime* rt) {
+    for (auto& stmt : rt->getStatements()) {
+        rewriteStmt(stmt);
+    }
+    for (auto& [name, f] : rt->getFunctions()) {
+        rewriteBlock(f->block);
+    }
+}
+
+void AstRewriter::rewriteExpr(Expression*& slot) {
+    if (slot != nullptr) {
+        slot->visit(this);
+    }
+}
+
+void AstRewriter::rewriteStmt(Statement*& slot) {
+    if (slot != nullptr) {
+        slot->visit(this);
+    }
+}
+
+void AstRewriter::rewriteBlock(Block* block) {
+    if (block == nullptr) {
+        return;
+    }
+    for (auto& stmt : block->stmts) {
+        rewriteStmt(stmt);
+    }
+}
+
+void AstRewriter::visitArrayExpr(ArrayExpr* node) {
+    for (auto& e : node->literal) {
+        rewriteExpr(e);
+    }
+}
+
+void AstRewriter::visitIndexExpr(IndexExpr* node) {
+    rewriteExpr(node->index);
+}
+
+void AstRewriter::visitBinaryExpr(BinaryExpr* node) {
+    rewriteExpr(node->lhs);
+    rewriteExpr(node->rhs);
+}
+
+void AstRewriter::visitFunCallExpr(FunCallExpr* node) {
+    rewriteExpr(node->receiver);
+    for (auto& arg : node->args) {
+        rewriteExpr(arg);
+    }
+}
+
+void AstRewriter::visitAssignExpr(AssignExpr* node) {
+    rewriteExpr(node->lhs);
+    rewriteExpr(node->rhs);
+}
+
+void AstRewriter::visitClosureExpr(ClosureExpr* node) {
+    rewriteBlock(node->block);
+}
+
+void AstRewriter::visitInlinedCallExpr(InlinedCallExpr* node) {
+    visitFunCallExpr(node->call);
+    rewriteBlock(node->block);
+}
+
+void AstRewriter::visitSimpleStmt(SimpleStmt* node) {
+    rewriteExpr(node->expr);
+}
+
+void AstRewriter::visitReturnStmt(ReturnStmt* node) {
+    rewriteExpr(node->ret);
+}
+
+void AstRewriter::visitIfStmt(IfStmt* node) {
+    rewriteExpr(node->cond);
+    rewriteBlock(node->block);
+    rewriteBlock(node->elseBlock);
+}
+
+void AstRewriter::visitWhileStmt(WhileStmt* node) {
+    rewriteExpr(node->cond);
+    rewriteBlock(node->block);
+}
+
+void AstRewriter::visitForStmt(ForStmt* node) {
+    rewriteExpr(node->init);
+    rewriteExpr(node->cond);
+    rewriteExpr(node->post);
+    rewriteBlock(node->block);
+}
+
+void AstRewriter::visitForEachStmt(ForEachStmt* node) {
+    rewriteExpr(node->list);
+    rewriteBlock(node->block);
+}
+
+void AstRewriter::visitMatchStmt(MatchStmt* node) {
+    rewriteExpr(node->cond);
+    for (auto& [theCase, block, isAny] : node->matches) {
+        rewriteExpr(theCase);
+        rewriteBlock(block);
+    }
+}
+
+void BinaryExprQuickener::rewriteExpr(Expression*& slot) {
+    AstRewriter::rewriteExpr(slot);
+    if (slot != nullptr && typeid(*slot) == typeid(BinaryExpr)) {
+        dynamic_cast<BinaryExpr*>(slot)->slot = &slot;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Inliner
+//===----------------------------------------------------------------------===//
+int Inliner::threshold = 32;
+
+// Size and names of a function body that decide whether it can be inlined
+class BodySummary : public AstRewriter {
+public:
+    void rewriteExpr(Expression*& slot) override {
+        size += slot != nullptr;
+        AstRewriter::rewriteExpr(slot);
+    }
+
+    void rewriteStmt(Statement*& slot) override {
+        size += slot != nullptr;
+        AstRewriter::rewriteStmt(slot);
+    }
+
+    int size{};
+    bool hasClosure{};
+    std::unordered_set<Symbol> used;
+    std::unordered_set<Symbol> defined;
+    std::vector<FunCallExpr*> calls;
+
+private:
+    void visitNameExpr(NameExpr* node) override {
+        used.insert(node->identName);
+    }
+
+    void visitIndexExpr(IndexExpr* node) override {
+        used.insert(node->identName);
+        AstRewriter::visitIndexExpr(node);
+    }
+
+    void visitAssignExpr(AssignExpr* node) override {
+        if (typeid(*node->lhs) == typeid(NameExpr)) {
+            defined.insert(static_cast<NameExpr*>(node->lhs)->identName);
+        }
+        AstRewriter::visitAssignExpr(node);
+    }
+
+    void visitForEachStmt(ForEachStmt* node) override {
+        defined.insert(node->identName);
+        AstRewriter::visitForEachStmt(node);
+    }
+
+    void visitFunCallExpr(FunCallExpr* node) override {
+        calls.push_back(node);
+        AstRewriter::visitFunCallExpr(node);
+    }
+
+    void visitClosureExpr(ClosureExpr* node) override { hasClosure = true; }
+
+    // It's copied as the original call
+    void visitInlinedCallExpr(InlinedCallExpr* node) override {
+        visitFunCallExpr(node->call);
+    }
+};
+
+// Rename variables of an inlined body, tail calls within it are turned into
+// plain calls since there is no frame of its own
+class VariableRenamer : public AstRewriter {
+public:
+    explicit VariableRenamer(std::unordered_map<Symbol, Symbol> names)
+        : names(std::move(names)) {}
+
+private:
+    void rename(Symbol& name) {
+        if (auto iter = names.find(name); iter != names.end()) {
+            name = iter->second;
+        }
+    }
+
+    void visitNameExpr(NameExpr* node) override { rename(node->identName); }
+
+    void visitIndexExpr(IndexExpr* node) override {
+        rename(node->identName);
+        AstRewriter::visitIndexExpr(node);
+    }
+
+    void visitForEachStmt(ForEachStmt* node) override {
+        rename(node->identName);
+        AstRewriter::visitForEachStmt(node);
+    }
+
+    void visitReturnStmt(ReturnStmt* node) override {
+        node->tailCall = nullptr;
+        AstRewriter::visitReturnStmt(node);
+    }
+
+    std::unordered_map<Symbol, Symbol> names;
+};
+
+bool Inliner::inlinable(Func* f) {
+    if (auto iter = verdicts.find(f); iter != verdicts.end()) {
+        return iter->second;
+    }
+    BodySummary summary;
+    summary.rewriteBlock(f->block);
+    bool verdict = !summary.hasClosure && summary.size <= threshold;
+    summary.defined.insert(f->params.begin(), f->params.end());
+    for (const auto& name : summary.used) {
+        // Anything else is looked up from context chain of its caller
+        verdict = verdict && summary.defined.count(name) != 0;
+    }
+    for (auto* call : summary.calls) {
+        if (call->receiver != nullptr &&
+            call->funcName == Runtime::LengthMethod) {
+            continue;
+        }
+        // Closures are only known at runtime, calling itself never ends
+        // inlining
+        verdict = verdict && call->funcName != f->name &&
+                  (rt->hasBuiltinFunction(call->funcName) ||
+                   rt->hasFunction(call->funcName));
+    }
+    verdicts.emplace(f, verdict);
+    return verdict;
+}
+
+void Inliner::rewriteExpr(Expression*& slot) {
+    AstRewriter::rewriteExpr(slot);
+    if (threshold <= 0 || slot == nullptr ||
+        typeid(*slot) != typeid(FunCallExpr)) {
+        return;
+    }
+    auto* call = static_cast<FunCallExpr*>(slot);
+    // Builtin functions take precedence over user defined ones
+    if (call->receiver != nullptr || rt->hasBuiltinFunction(call->funcName)) {
+        return;
+    }
+    Func* f = rt->getFunction(call->funcName);
+    if (f == nullptr || f->params.size() != call->args.size() ||
+        !inlinable(f)) {
+        return;
+    }
+
+    BodySummary summary;
+    summary.rewriteBlock(f->block);
+    summary.defined.insert(f->params.begin(), f->params.end());
+    std::unordered_map<Symbol, Symbol> names;
+    std::string suffix = "$" + std::to_string(sites++);
+    for (const auto& name : summary.defined) {
+        names.emplace(name, Symbol(name.str() + suffix));
+    }
+    std::vector<Symbol> params;
+    for (const auto& param : f->params) {
+        params.push_back(names[param]);
+    }
+    Block* block = AstCloner().clone(f->block);
+    VariableRenamer(std::move(names)).rewriteBlock(block);
+    slot = new InlinedCallExpr(call, std::move(params), block);
+}
+
+//===----------------------------------------------------------------------===//
+// Idioms recognized by SuperinstructionFuser
+//===----------------------------------------------------------------------===//
+enum FusionSite {
+    AnyExpr,    // wherever an expression is
+    MatchCase,  // case of match statement
+};
+
+struct Idiom {
+    FusionSite site;
+    FusedExpr* (*fuse)(Expression* node);
+};
+
+static bool isName(Expression* node) {
+    return node != nullptr && typeid(*node) == typeid(NameExpr);
+}
+
+static bool isNameOrInt(Expression* node) {
+    return isName(node) ||
+           (node != nullptr && typeid(*node) == typeid(IntExpr));
+}
+
+static bool isLiteral(Expression* node) {
+    return node != nullptr &&
+           (typeid(*node) == typeid(BoolExpr) ||
+            typeid(*node) == typeid(CharExpr) ||
+            typeid(*node) == typeid(IntExpr) ||
+            typeid(*node) == typeid(DoubleExpr) ||
+            typeid(*node) == typeid(StringExpr));
+}
+
+static bool isComparison(Token opt) {
+    return opt == TK_LT || opt == TK_LE || opt == TK_GT || opt == TK_GE ||
+           opt == TK_EQ || opt == TK_NE;
+}
+
+static FusedExpr* fuseIncrement(Expression* node) {
+    if (typeid(*node) != typeid(AssignExpr)) {
+        return nullptr;
+    }
+    auto* assign = static_cast<AssignExpr*>(node);
+    if (!isName(assign->lhs) || typeid(*assign->rhs) != typeid(IntExpr)) {
+        return nullptr;
+    }
+    int literal = static_cast<IntExpr*>(assign->rhs)->literal;
+    if (assign->opt == TK_PLUS_AGN) {
+        return new IncrementExpr(assign, literal);
+    }
+    if (assign->opt == TK_MINUS_AGN) {
+        return new IncrementExpr(assign, -literal);
+    }
+    return nullptr;
+}
+
+static FusedExpr* fuseAppend(Expression* node) {
+    if (typeid(*node) != typeid(AssignExpr)) {
+        return nullptr;
+    }
+    auto* assign = static_cast<AssignExpr*>(node);
+    if (assign->opt != TK_ASSIGN || !isName(assign->lhs) ||
+        typeid(*assign->rhs) != typeid(BinaryExpr)) {
+        return nullptr;
+    }
+    auto* concat = static_cast<BinaryExpr*>(assign->rhs);
+    if (concat->opt != TK_PLUS || !isName(concat->lhs) ||
+        concat->rhs == nullptr ||
+        static_cast<NameExpr*>(concat->lhs)->identName !=
+            static_cast<NameExpr*>(assign->lhs)->identName) {
+        return nullptr;
+    }
+    return new AppendExpr(assign, concat);
+}
+
+static FusedExpr* fuseCompare(Expression* node) {
+    if (typeid(*node) != typeid(BinaryExpr)) {
+        return nullptr;
+    }
+    auto* binary = static_cast<BinaryExpr*>(node);
+    if (!isComparison(binary->opt) || !isName(binary->lhs) ||
+        !isNameOrInt(binary->rhs)) {
+        return nullptr;
+    }
+    return new CompareExpr(binary);
+}
+
+static FusedExpr* fuseEqualsLiteral(Expression* node) {
+    if (typeid(*node) != typeid(BinaryExpr)) {
+        return nullptr;
+    }
+    auto* binary = static_cast<BinaryExpr*>(node);
+    if ((binary->opt != TK_EQ && binary->opt != TK_NE) ||
+        !isName(binary->lhs) || !isLiteral(binary->rhs)) {
+        return nullptr;
+    }
+    return new EqualsLiteralExpr(binary);
+}
+
+static FusedExpr* fuseIndexBinary(Expression* node) {
+    if (typeid(*node) != typeid(BinaryExpr)) {
+        return nullptr;
+    }
+    auto* binary = static_cast<BinaryExpr*>(node);
+    auto isSimpleIndex = [](Expression* e) {
+        return e != nullptr && typeid(*e) == typeid(IndexExpr) &&
+               isNameOrInt(static_cast<IndexExpr*>(e)->index);
+    };
+    if (!isSimpleIndex(binary->lhs) || !isSimpleIndex(binary->rhs)) {
+        return nullptr;
+    }
+    return new IndexBinaryExpr(binary);
+}
+
+static FusedExpr* fuseCaseLiteral(Expression* node) {
+    return isLiteral(node) ? new CaseLiteralExpr(node) : nullptr;
+}
+
+static const Idiom idioms[] = {
+    {AnyExpr, fuseIncrement},
+    {AnyExpr, fuseAppend},
+    {AnyExpr, fuseCompare},
+    {AnyExpr, fuseEqualsLiteral},
+    {AnyExpr, fuseIndexBinary},
+    {MatchCase, fuseCaseLiteral},
+};
+
+static void fuse(Expression*& slot, FusionSite site) {
+    if (slot == nullptr) {
+        return;
+    }
+    for (const auto& idiom : idioms) {
+        if (idiom.site != site) {
+            continue;
+        }
+        if (FusedExpr* fused = idiom.fuse(slot); fused != nullptr) {
+            slot = fused;
+            return;
+        }
+    }
+}
+
+void SuperinstructionFuser::rewriteExpr(Expression*& slot) {
+    AstRewriter::rewriteExpr(slot);
+    fuse(slot, AnyExpr);
+}
+
+void SuperinstructionFuser::visitMatchStmt(MatchStmt* node) {
+    AstRewriter::visitMatchStmt(node);
+    for (auto& [theCase, block, isAny] : node->matches) {
+        if (!isAny) {
+            fuse(theCase, MatchCase);
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// ClosureConverter
+//===----------------------------------------------------------------------===//
+Func* ClosureConverter::prototype(ClosureExpr* node) {
+    if (node->func != nullptr) {
+        return node->func;
+    }
+    ClosureConverter converter;
+    converter.rewriteBlock(node->block);
+    auto* f = new Func;
+    f->params = node->params;
+    f->block = node->block;
+    for (auto& freeVar : converter.freeVars) {
+        if (std::find(f->params.begin(), f->params.end(), freeVar.name) ==
+            f->params.end()) {
+            f->freeVars.push_back(std::move(freeVar));
+        }
+    }
+    node->func = f;
+    return f;
+}
+
+void ClosureConverter::refer(Symbol name, bool assigned) {
+    for (auto& freeVar : freeVars) {
+        if (freeVar.name == name) {
+            freeVar.assigned = freeVar.assigned || assigned;
+            return;
+        }
+    }
+    freeVars.push_back(FreeVariable{name, assigned});
+}
+
+void ClosureConverter::visitNameExpr(NameExpr* node) {
+    refer(node->identName, false);
+}
+
+void ClosureConverter::visitIndexExpr(IndexExpr* node) {
+    refer(node->identName, false);
+    AstRewriter::visitIndexExpr(node);
+}
+
+void ClosureConverter::visitFunCallExpr(FunCallExpr* node) {
+    // Callee might be a closure variable, builtin and named functions are
+    // sorted out when closure is created
+    if (node->receiver == nullptr) {
+        refer(node->funcName, false);
+    }
+    AstRewriter::visitFunCallExpr(node);
+}
+
+void ClosureConverter::visitAssignExpr(AssignExpr* node) {
+    if (typeid(*node->lhs) == typeid(NameExpr)) {
+        refer(static_cast<NameExpr*>(node->lhs)->identName, true);
+    }
+    AstRewriter::visitAssignExpr(node);
+}
+
+void ClosureConverter::visitClosureExpr(ClosureExpr* node) {
+    // Inner closure captures its free variables from the outer one
+    for (const auto& freeVar : prototype(node)->freeVars) {
+        refer(freeVar.name, freeVar.assigned);
+    }
+}
+
+void ClosureConverter::visitInlinedCallExpr(InlinedCallExpr* node) {
+    for (const auto& param : node->params) {
+        refer(param, true);
+    }
+    AstRewriter::visitInlinedCallExpr(node);
+}
+
+void ClosureConverter::visitForEachStmt(ForEachStmt* node) {
+    refer(node->identName, true);
+    AstRewriter::visitForEachStmt(node);
+}
+
+Expression* AstCloner::clone(Expression* node) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+    node->visit(this);
+    return expr;
+}
+
+Statement* AstCloner::clone(Statement* node) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+    node->visit(this);
+    return stmt;
+}
+
+Block* AstCloner::clone(Block* block) {
+    if (block == nullptr) {
+        return nullptr;
+    }
+    auto* copy = new Block;
+    for (auto* s : block->stmts) {
+        copy->stmts.push_back(clone(s));
+    }
+    return copy;
+}
+
+void AstCloner::visitBoolExpr(BoolExpr* node) {
+    auto* copy = new BoolExpr(node->line, node->column);
+    copy->literal = node->literal;
+    expr = copy;
+}
+
+void AstCloner::visitCharExpr(CharExpr* node) {
+    auto* copy = new CharExpr(node->line, node->column);
+    copy->literal = node->literal;
+    expr = copy;
+}
+
+void AstCloner::visitNullExpr(NullExpr* node) {
+    expr = new NullExpr(node->line, node->column);
+}
+
+void AstCloner::visitIntExpr(IntExpr* node) {
+    auto* copy = new IntExpr(node->line, node->column);
+    copy->literal = node->literal;
+    expr = copy;
+}
+
+void AstCloner::visitDoubleExpr(DoubleExpr* node) {
+    auto* copy = new DoubleExpr(node->line, node->column);
+    copy->literal = node->literal;
+    expr = copy;
+}
+
+void AstCloner::visitStringExpr(StringExpr* node) {
+    auto* copy = new StringExpr(node->line, node->column);
+    copy->literal = node->literal;
+    expr = copy;
+}
+
+void AstCloner::visitArrayExpr(ArrayExpr* node) {
+    auto* copy = new ArrayExpr(node->line, node->column);
+    for (auto* e : node->literal) {
+        copy->literal.push_back(clone(e));
+    }
+    expr = copy;
+}
+
+void AstCloner::visitNameExpr(NameExpr* node) {
+    auto* copy = new NameExpr(node->line, node->column);
+    copy->identName = node->identName;
+    copy->addr = node->addr;
+    expr = copy;
+}
+
+void AstCloner::visitIndexExpr(IndexExpr* node) {
+    auto* copy = new IndexExpr(node->line, node->column);
+    copy->identName = node->identName;
+    copy->addr = node->addr;
+    copy->index = clone(node->index);
+    expr = copy;
+}
+
+void AstCloner::visitBinaryExpr(BinaryExpr* node) {
+    auto* copy = new BinaryExpr(node->line, node->column);
+    copy->lhs = clone(node->lhs);
+    copy->opt = node->opt;
+    copy->rhs = clone(node->rhs);
+    expr = copy;
+}
+
+void AstCloner::visitFunCallExpr(FunCallExpr* node) {
+    auto* copy = new FunCallExpr(node->line, node->column);
+    copy->receiver = clone(node->receiver);
+    copy->funcName = node->funcName;
+    copy->addr = node->addr;
+    for (auto* arg : node->args) {
+        copy->args.push_back(clone(arg));
+    }
+    expr = copy;
+}
+
+void AstCloner::visitAssignExpr(AssignExpr* node) {
+    auto* copy = new AssignExpr(node->line, node->column);
+    copy->lhs = clone(node->lhs);
+    copy->opt = node->opt;
+    copy->rhs = clone(node->rhs);
+    expr = copy;
+}
+
+void AstCloner::visitClosureExpr(ClosureExpr* node) {
+    auto* copy = new ClosureExpr(node->line, node->column);
+    copy->params = node->params;
+    copy->block = clone(node->block);
+    if (node->func != nullptr) {
+        // Free variables are captured from where the original ones are
+        copy->func = new Func(*node->func);
+        copy->func->block = copy->block;
+    }
+    expr = copy;
+}
+
+void AstCloner::visitBreakStmt(BreakStmt* node) {
+    stmt = new BreakStmt(node->line, node->column);
+}
+
+void AstCloner::visitContinueStmt(ContinueStmt* node) {
+    stmt = new ContinueStmt(node->line, node->column);
+}
+
+void AstCloner::visitSimpleStmt(SimpleStmt* node) {
+    auto* copy = new SimpleStmt(node->line, node->column);
+    copy->expr = clone(node->expr);
+    stmt = copy;
+}
+
+void AstCloner::visitReturnStmt(ReturnStmt* node) {
+    auto* copy = new ReturnStmt(node->line, node->column);
+    copy->ret = clone(node->ret);
+    if (node->tailCall != nullptr) {
+        copy->tailCall = dynamic_cast<FunCallExpr*>(copy->ret);
+    }
+    stmt = copy;
+}
+
+void AstCloner::visitIfStmt(IfStmt* node) {
+    auto* copy = new IfStmt(node->line, node->column);
+    copy->cond = clone(node->cond);
+    copy->block = clone(node->block);
+    copy->elseBlock = clone(node->elseBlock);
+    stmt = copy;
+}
+
+void AstCloner::visitWhileStmt(WhileStmt* node) {
+    auto* copy = new WhileStmt(node->line, node->column);
+    copy->cond = clone(node->cond);
+    copy->block = clone(node->block);
+    stmt = copy;
+}
+
+void AstCloner::visitForStmt(ForStmt* node) {
+    auto* copy = new ForStmt(node->line, node->column);
+    copy->init = clone(node->init);
+    copy->cond = clone(node->cond);
+    copy->post = clone(node->post);
+    copy->block = clone(node->block);
+    stmt = copy;
+}
+
+void AstCloner::visitForEachStmt(ForEachStmt* node) {
+    auto* copy = new ForEachStmt(node->line, node->column);
+    copy->identName = node->identName;
+    copy->addr = node->addr;
+    copy->list = clone(node->list);
+    copy->block = clone(node->block);
+    stmt = copy;
+}
+
+void AstCloner::visitMatchStmt(MatchStmt* node) {
+    auto* copy = new MatchStmt(node->line, node->column);
+    copy->cond = clone(node->cond);
+    for (const auto& [theCase, block, isAny] : node->matches) {
+        copy->matches.emplace_back(clone(theCase), clone(block), isAny);
+    }
+    stmt = copy;
+}
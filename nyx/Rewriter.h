@@ -0,0 +1,176 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_REWRITER_H
+#define NYX_REWRITER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Ast.h"
+#include "Runtime.hpp"
+
+//===----------------------------------------------------------------------===//
+// Walk over the whole program and hand out every expression and statement by
+// reference to the slot that holds it, so that subclasses can replace nodes in
+// place. By default nothing is replaced and children are visited recursively
+//===----------------------------------------------------------------------===//
+class AstRewriter : public AstVisitor {
+public:
+    // Rewrite top-level statements and bodies of all named functions
+    void rewriteAll(Runtime* rt);
+
+    virtual void rewriteExpr(Expression*& slot);
+
+    virtual void rewriteStmt(Statement*& slot);
+
+    void rewriteBlock(Block* block);
+
+protected:
+    void visitArrayExpr(ArrayExpr* node) override;
+    void visitIndexExpr(IndexExpr* node) override;
+    void visitBinaryExpr(BinaryExpr* node) override;
+    void visitFunCallExpr(FunCallExpr* node) override;
+    void visitAssignExpr(AssignExpr* node) override;
+    void visitClosureExpr(ClosureExpr* node) override;
+    void visitInlinedCallExpr(InlinedCallExpr* node) override;
+    void visitSimpleStmt(SimpleStmt* node) override;
+    void visitReturnStmt(ReturnStmt* node) override;
+    void visitIfStmt(IfStmt* node) override;
+    void visitWhileStmt(WhileStmt* node) override;
+    void visitForStmt(ForStmt* node) override;
+    void visitForEachStmt(ForEachStmt* node) override;
+    void visitMatchStmt(MatchStmt* node) override;
+};
+
+//===----------------------------------------------------------------------===//
+// Tell every binary expression where it's held so that it can rewrite itself
+// into a node specialized for its operand types when it's first evaluated
+//===----------------------------------------------------------------------===//
+class BinaryExprQuickener : public AstRewriter {
+public:
+    void rewriteExpr(Expression*& slot) override;
+};
+
+//===----------------------------------------------------------------------===//
+// Copy bodies of small named functions into their call sites. Only functions
+// that neither recurse nor create or call closures, and that refer to nothing
+// but their parameters and local variables, are inlined
+//===----------------------------------------------------------------------===//
+class Inliner : public AstRewriter {
+public:
+    explicit Inliner(Runtime* rt) : rt(rt) {}
+
+    void rewriteExpr(Expression*& slot) override;
+
+    // Functions whose bodies consist of more AST nodes are never inlined, 0
+    // disables inlining
+    static int threshold;
+
+private:
+    bool inlinable(Func* f);
+
+    Runtime* rt;
+    std::unordered_map<Func*, bool> verdicts;
+    // Distinguish variables of different call sites
+    int sites{};
+};
+
+//===----------------------------------------------------------------------===//
+// Replace common idioms with fused nodes that perform them in one evaluation.
+// Idioms are listed in a table and tried in order, the first one that matches
+// the expression wins
+//===----------------------------------------------------------------------===//
+class SuperinstructionFuser : public AstRewriter {
+public:
+    void rewriteExpr(Expression*& slot) override;
+
+protected:
+    void visitMatchStmt(MatchStmt* node) override;
+};
+
+//===----------------------------------------------------------------------===//
+// Convert closure expressions into functions shared by all closures they
+// create. Names that a closure refers to but does not take as parameters are
+// its free variables, they are all it captures when it's created
+//===----------------------------------------------------------------------===//
+class ClosureConverter : public AstRewriter {
+public:
+    static Func* prototype(ClosureExpr* node);
+
+private:
+    void refer(Symbol name, bool assigned);
+
+    void visitNameExpr(NameExpr* node) override;
+    void visitIndexExpr(IndexExpr* node) override;
+    void visitFunCallExpr(FunCallExpr* node) override;
+    void visitAssignExpr(AssignExpr* node) override;
+    void visitClosureExpr(ClosureExpr* node) override;
+    void visitInlinedCallExpr(InlinedCallExpr* node) override;
+    void visitForEachStmt(ForEachStmt* node) override;
+
+    // In the order they are referred to
+    std::vector<FreeVariable> freeVars;
+};
+
+//===----------------------------------------------------------------------===//
+// Deep copy AST nodes. Quickened nodes are copied as their original generic
+// ones and copies carry no runtime state such as caches or traces
+//===----------------------------------------------------------------------===//
+class AstCloner : public AstVisitor {
+public:
+    Expression* clone(Expression* node);
+
+    Statement* clone(Statement* node);
+
+    Block* clone(Block* block);
+
+private:
+    void visitBoolExpr(BoolExpr* node) override;
+    void visitCharExpr(CharExpr* node) override;
+    void visitNullExpr(NullExpr* node) override;
+    void visitIntExpr(IntExpr* node) override;
+    void visitDoubleExpr(DoubleExpr* node) override;
+    void visitStringExpr(StringExpr* node) override;
+    void visitArrayExpr(ArrayExpr* node) override;
+    void visitNameExpr(NameExpr* node) override;
+    void visitIndexExpr(IndexExpr* node) override;
+    void visitBinaryExpr(BinaryExpr* node) override;
+    void visitFunCallExpr(FunCallExpr* node) override;
+    void visitAssignExpr(AssignExpr* node) override;
+    void visitClosureExpr(ClosureExpr* node) override;
+    void visitBreakStmt(BreakStmt* node) override;
+    void visitContinueStmt(ContinueStmt* node) override;
+    void visitSimpleStmt(SimpleStmt* node) override;
+    void visitReturnStmt(ReturnStmt* node) override;
+    void visitIfStmt(IfStmt* node) override;
+    void visitWhileStmt(WhileStmt* node) override;
+    void visitForStmt(ForStmt* node) override;
+    void visitForEachStmt(ForEachStmt* node) override;
+    void visitMatchStmt(MatchStmt* node) override;
+
+    Expression* expr{};
+    Statement* stmt{};
+};
+
+#endif  // NYX_REWRITER_H
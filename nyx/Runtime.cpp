@@ -23,39 +23,55 @@
 
 #include "Runtime.hpp"
 
+#include <algorithm>
 #include <utility>
 #include "Builtin.h"
+#include "Gc.h"
 #include "Object.hpp"
 #include "Utils.hpp"
 
+const Symbol Runtime::LengthMethod("length");
+
 Runtime* runtime = new Runtime();
 
 Context::~Context() {
-    for (const auto& v : vars) {
-        delete v.second;
+    clear();
+}
+
+void Context::clear() {
+    for (auto* var : slots) {
+        // Captured variables might outlive their contexts, Gc deletes them,
+        // those on frame are released along with it
+        if (var != nullptr && !var->captured && !isOnFrame(var)) {
+            delete var;
+        }
     }
+    slots.clear();
+    funcs.clear();
+    frame = nullptr;
+    func = nullptr;
 }
 
 Runtime::Runtime() {
-    builtin["print"] = &nyx_builtin_print;
-    builtin["println"] = &nyx_builtin_println;
-    builtin["typeof"] = &nyx_builtin_typeof;
-    builtin["input"] = &nyx_builtin_input;
-    builtin["length"] = &nyx_builtin_length;
-    builtin["to_int"] = &nyx_builtin_to_int;
-    builtin["to_double"] = &nyx_builtin_to_double;
-    builtin["range"] = &nyx_builtin_range;
-    builtin["assert"] = &nyx_builtin_assert;
-    builtin["dump_ast"] = &nyx_builtin_dump_ast;
+    builtin[Symbol("print")] = &nyx_builtin_print;
+    builtin[Symbol("println")] = &nyx_builtin_println;
+    builtin[Symbol("typeof")] = &nyx_builtin_typeof;
+    builtin[Symbol("input")] = &nyx_builtin_input;
+    builtin[Symbol("length")] = &nyx_builtin_length;
+    builtin[Symbol("to_int")] = &nyx_builtin_to_int;
+    builtin[Symbol("to_double")] = &nyx_builtin_to_double;
+    builtin[Symbol("range")] = &nyx_builtin_range;
+    builtin[Symbol("assert")] = &nyx_builtin_assert;
+    builtin[Symbol("dump_ast")] = &nyx_builtin_dump_ast;
 }
 
-bool Runtime::hasBuiltinFunction(const std::string& name) {
-    return builtin.count(name) == 1;
+bool Runtime::hasBuiltinFunction(Symbol name) const {
+    return builtin.contains(name);
 }
 
-Runtime::BuiltinFuncType Runtime::getBuiltinFunction(const std::string& name) {
-    if (auto res = builtin.find(name); res != builtin.end()) {
-        return res->second;
+Runtime::BuiltinFuncType Runtime::getBuiltinFunction(Symbol name) const {
+    if (auto* res = builtin.find(name); res != nullptr) {
+        return *res;
     }
     return nullptr;
 }
@@ -68,119 +84,122 @@ std::vector<Statement*>& Runtime::getStatements() {
     return stmts;
 }
 
-Object* Runtime::newObject() {
-    auto* object = new Object(Null, nullptr);
-    heap.push_back(object);
-    return object;
-}
-
-Object* Runtime::newObject(int data) {
-    int* mem = new int;
-    *mem = data;
-    auto* object = new Object(Int, mem);
-    heap.push_back(object);
-    return object;
-}
-Object* Runtime::newObject(double data) {
-    auto* mem = new double;
-    *mem = data;
-    auto* object = new Object(Double, mem);
-    heap.push_back(object);
-    return object;
-}
-
-Object* Runtime::newObject(std::string data) {
-    auto* mem = new std::string;
-    *mem = std::move(data);
-    auto* object = new Object(String, mem);
-    heap.push_back(object);
-    return object;
-}
-
-Object* Runtime::newObject(bool data) {
-    bool* mem = new bool;
-    *mem = data;
-    auto* object = new Object(Bool, mem);
-    heap.push_back(object);
-    return object;
-}
-
-Object* Runtime::newObject(char data) {
-    char* mem = new char;
-    *mem = data;
-    auto* object = new Object(Char, mem);
-    heap.push_back(object);
-    return object;
-}
-Object* Runtime::newObject(ObjectArray data) {
-    auto* mem = new ObjectArray;
-    *mem = data;
-    auto* object = new Object(Array, mem);
-    heap.push_back(object);
-    return object;
-}
-Object* Runtime::newObject(Func data) {
-    auto* mem = new Func;
-    mem[0] = data;
-    auto* object = new Object(Closure, mem);
-    heap.push_back(object);
-    return object;
-}
-Object* Runtime::cloneObject(Object* object) {
-    switch (object->getType()) {
+Value Runtime::newObject(std::string data) {
+    return Value(Gc::allocate(ObjectString(data)));
+}
+
+Value Runtime::newObject(ObjectString data) {
+    return Value(Gc::allocate(std::move(data)));
+}
+
+Value Runtime::newObject(ObjectArray data) {
+    return Value(Gc::allocate(std::move(data)));
+}
+
+Value Runtime::newObject(BoundFunc data) {
+    return Value(Gc::allocate(std::move(data)));
+}
+
+Value Runtime::cloneObject(Value object) {
+    switch (object.getType()) {
         case Int:
-            return newObject(object->asInt());
         case Double:
-            return newObject(object->asDouble());
-        case String:
-            return newObject(object->asString());
         case Bool:
-            return newObject(object->asBool());
         case Char:
-            return newObject(object->asChar());
+            // Scalars are copied along with values themselves
+            return object;
+        case String:
+            // Strings are immutable so the same one is shared
+            return object;
         case Array:
-            return newObject(object->asArray());
+            return newObject(object.asArray());
         case Closure:
-            return newObject(object->asClosure());
+            return newObject(*object.asClosure());
         default:
-            panic("unknown object type (%p)", object->type, object->data);
+            panic("unknown object type %d", object.getType());
     }
 }
 
-bool Context::hasVariable(const std::string& identName) {
-    return vars.count(identName) == 1;
+Variable* Context::createVariable(int slot, Value value) {
+    if (slot >= (int)slots.size()) {
+        slots.resize(slot + 1);
+    }
+    Variable* var;
+    if (frame != nullptr && slot < func->frameSize && !func->captured[slot]) {
+        var = &frame[slot];
+    } else {
+        var = new Variable();
+    }
+    var->value = value;
+    slots[slot] = var;
+    return var;
 }
 
-void Context::createVariable(const std::string& identName, Object* value) {
-    auto* var = new Variable();
-    var->name = identName;
-    var->value = value;
-    vars.emplace(identName, var);
+void Context::shareVariable(int slot, Variable* var) {
+    if (slot >= (int)slots.size()) {
+        slots.resize(slot + 1);
+    }
+    slots[slot] = var;
 }
 
-Variable* Context::getVariable(const std::string& identName) {
-    if (auto res = vars.find(identName); res != vars.end()) {
-        return res->second;
+FrameStack::~FrameStack() {
+    for (auto& chunk : chunks) {
+        delete[] chunk.vars;
     }
-    return nullptr;
 }
 
-void Context::addFunction(const std::string& name, Func* f) {
-    funcs.insert(std::make_pair(name, f));
+Variable* FrameStack::push(int size) {
+    if (size == 0) {
+        return nullptr;
+    }
+    if (current < 0 || chunks[current].top + size > chunks[current].size) {
+        // Frame never spans two chunks, the rest of current one is left unused
+        // until frames below it are popped
+        current++;
+        if (current == (int)chunks.size() || chunks[current].size < size) {
+            int chunkSize = std::max(size, ChunkVariables);
+            if (current < (int)chunks.size()) {
+                delete[] chunks[current].vars;
+                chunks[current] = Chunk{new Variable[chunkSize], chunkSize, 0};
+            } else {
+                chunks.push_back(Chunk{new Variable[chunkSize], chunkSize, 0});
+            }
+        }
+    }
+    Chunk& chunk = chunks[current];
+    Variable* frame = chunk.vars + chunk.top;
+    chunk.top += size;
+    return frame;
+}
+
+void FrameStack::pop(Variable* frame) {
+    if (frame == nullptr) {
+        return;
+    }
+    while (frame < chunks[current].vars ||
+           frame > chunks[current].vars + chunks[current].top) {
+        chunks[current].top = 0;
+        current--;
+    }
+    chunks[current].top = (int)(frame - chunks[current].vars);
+}
+
+void Context::addFunction(Symbol name, Func* f) {
+    funcs.insert(name, f);
 }
 
-bool Context::hasFunction(const std::string& name) {
-    return funcs.count(name) == 1;
+bool Context::hasFunction(Symbol name) const {
+    return funcs.contains(name);
 }
 
-Func* Context::getFunction(const std::string& name) {
-    if (auto f = funcs.find(name); f != funcs.end()) {
-        return f->second;
+Func* Context::getFunction(Symbol name) const {
+    if (auto* f = funcs.find(name); f != nullptr) {
+        return *f;
     }
     return nullptr;
 }
 
 template <typename T>
-void Runtime::resetObject(Object* object, T data) {
-    *(T*)(object->data) = data;
+void Runtime::resetObject(Value object, T data) {
+    object.resetObject(data);
 }
@@ -27,13 +27,14 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include "Object.hpp"
+#include "Symbol.h"
 
 struct Statement;
 struct Expression;
 struct Context;
-class Object;
+class Runtime;
 
-using ObjectArray = std::vector<Object*>;
 using ContextChain = std::deque<Context*>;
 
 enum ExecutionResultType { ExecNormal, ExecReturn, ExecBreak, ExecContinue };
@@ -44,31 +45,78 @@ struct Block {
     std::vector<Statement*> stmts;
 };
 
+struct NativeCode;
+struct Func;
+
+// Function body compiled ahead of time by nyxc, see Aot
+using CompiledFunc = Value (*)(Runtime* rt,
+                               Func* f,
+                               const BoundFunc* closure,
+                               ObjectArray& args);
+
+// Where a variable lives, resolved by Resolver before the program runs. Depth
+// is how many contexts it's away from the innermost one of current frame, slot
+// is its index within that context
+struct Address {
+    int depth = -1;
+    int slot = -1;
+
+    bool isResolved() const { return slot >= 0; }
+};
+
+// Variable that closure refers to but does not take as parameter
+struct FreeVariable {
+    Symbol name;
+    // It's a local variable of closure unless it has been defined when closure
+    // is created
+    bool assigned;
+    // Where it's captured from when closure is created and the slot it takes
+    // in context of closure, both are unresolved if closure never captures it
+    Address capture{};
+    int slot = -1;
+};
+
 struct Func {
     explicit Func() = default;
 
-    std::string name;
-    ContextChain* outerContext{};
-    std::vector<std::string> params;
+    Symbol name;
+    std::vector<Symbol> params;
+    // Only closures have free variables, see ClosureConverter
+    std::vector<FreeVariable> freeVars;
     Block* block{};
+    // Slots of its own context, i.e. parameters, free variables and locals of
+    // its body, and whether closures created within it capture each of them.
+    // Both are set by Resolver
+    int frameSize{};
+    std::vector<bool> captured;
+    // Times it was called before being compiled to native code
+    int calls{};
+    NativeCode* native{};
+    // It takes place of block in programs compiled by nyxc
+    CompiledFunc compiled{};
 };
 
 struct ExecResult {
     explicit ExecResult(ExecutionResultType execType)
         : execType(execType), retValue(nullptr) {}
 
-    explicit ExecResult(ExecutionResultType execType, Object* retValue)
+    explicit ExecResult(ExecutionResultType execType, Value retValue)
         : execType(execType), retValue(retValue) {}
 
     ExecutionResultType execType;
-    Object* retValue;
+    Value retValue;
 };
 
 struct Variable {
     explicit Variable() = default;
 
-    std::string name;
-    Object* value;
+    Value value;
+    // It's captured by closures and managed by Gc from now on, contexts no
+    // longer delete it
+    bool captured{};
+    bool marked{};
+    // It's in remembered set of Gc
+    bool remembered{};
 };
 
 class Context {
@@ -77,56 +125,129 @@ public:
 
     virtual ~Context();
 
-    bool hasVariable(const std::string& identName);
+    // Drop variables and functions defined in it, so that it can be reused by
+    // another block
+    void clear();
 
-    void createVariable(const std::string& identName, Object* value);
+    bool isEmpty() const {
+        return slots.empty() && funcs.empty() && func == nullptr;
+    }
 
-    Variable* getVariable(const std::string& identName);
+    // Make it the context of a call to f, whose variables live in frame unless
+    // they are captured, see FrameStack
+    void bindFrame(Variable* frame, const Func* f) {
+        this->frame = frame;
+        this->func = f;
+    }
 
-    void addFunction(const std::string& name, Func* f);
+    Variable* getFrame() const { return frame; }
 
-    bool hasFunction(const std::string& name);
+    Variable* createVariable(int slot, Value value);
 
-    Func* getFunction(const std::string& name);
+    // Variable of slot, or nullptr if it has not been defined yet
+    Variable* getVariable(int slot) const {
+        return (size_t)slot < slots.size() ? slots[slot] : nullptr;
+    }
+
+    // Make captured variable of another context visible in this one
+    void shareVariable(int slot, Variable* var);
+
+    void addFunction(Symbol name, Func* f);
+
+    bool hasFunction(Symbol name) const;
+
+    Func* getFunction(Symbol name) const;
+
+    SymbolMap<Func*>& getFunctions() { return funcs; }
+
+    // Slots that have not been defined yet are nullptr
+    const std::vector<Variable*>& getVariables() const { return slots; }
 
 private:
-    std::unordered_map<std::string, Variable*> vars;
-    std::unordered_map<std::string, Func*> funcs;
+    bool isOnFrame(const Variable* var) const {
+        return frame != nullptr && var >= frame &&
+               var < frame + func->frameSize;
+    }
+
+    std::vector<Variable*> slots;
+    SymbolMap<Func*> funcs;
+    Variable* frame{};
+    const Func* func{};
 };
 
-class Runtime : public Context {
-    using BuiltinFuncType = Object* (*)(Runtime*, ContextChain*, ObjectArray);
+// Variables of calls in progress. Every call reserves a contiguous block of
+// them for its context, which is released once it returns, so that calls
+// allocate nothing once the stack has grown deep enough. Blocks are carved out
+// of chunks that never move, variables keep their addresses until released
+class FrameStack {
+public:
+    explicit FrameStack() = default;
+
+    ~FrameStack();
+
+    Variable* push(int size);
+
+    // Release frame and every frame pushed after it
+    void pop(Variable* frame);
+
+private:
+    struct Chunk {
+        Variable* vars;
+        int size;
+        int top;
+    };
+
+    static constexpr int ChunkVariables = 4096;
 
+    std::vector<Chunk> chunks;
+    // Index of the chunk that frames are pushed onto
+    int current = -1;
+};
+
+class Runtime : public Context {
 public:
+    using BuiltinFuncType = Value (*)(Runtime*, ContextChain*, ObjectArray);
+
+    // The only method there is, which arrays and strings have
+    static const Symbol LengthMethod;
+
     explicit Runtime();
 
-    bool hasBuiltinFunction(const std::string& name);
+    bool hasBuiltinFunction(Symbol name) const;
 
-    BuiltinFuncType getBuiltinFunction(const std::string& name);
+    BuiltinFuncType getBuiltinFunction(Symbol name) const;
 
     void addStatement(Statement* stmt);
 
     std::vector<Statement*>& getStatements();
 
-    Object* newObject(int data);
-    Object* newObject(double data);
-    Object* newObject(std::string data);
-    Object* newObject(bool data);
-    Object* newObject(char c);
-    Object* newObject(ObjectArray data);
-    Object* newObject(Func data);
-    Object* newObject();
-    Object* cloneObject(Object* object);
+    // Scalars are stored in values themselves, nothing is allocated
+    Value newObject(int data) { return Value(data); }
+    Value newObject(double data) { return Value(data); }
+    Value newObject(bool data) { return Value(data); }
+    Value newObject(char c) { return Value(c); }
+    Value newObject() { return Value::null(); }
+    Value newObject(std::string data);
+    Value newObject(ObjectString data);
+    Value newObject(ObjectArray data);
+    Value newObject(BoundFunc data);
+    Value cloneObject(Value object);
 
     template <typename T>
-    void resetObject(Object* object, T data);
+    void resetObject(Value object, T data);
 
 private:
-    std::unordered_map<std::string, BuiltinFuncType> builtin;
+    SymbolMap<BuiltinFuncType> builtin;
     std::vector<Statement*> stmts;
-    // TODO: create object in managed heap and support GC to make it a "real
-    // heap"
-    ObjectArray heap;
+};
+
+// Callee resolved by a call site. Builtin and named functions never change once
+// the program was parsed, closure variable is read from its address each time
+// it's called
+struct CallCache {
+    bool resolved{};
+    Runtime::BuiltinFuncType builtin{};
+    Func* func{};
 };
 
 extern Runtime* runtime;
\ No newline at end of file
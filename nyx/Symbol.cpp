@@ -0,0 +1,74 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "Symbol.h"
+
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+namespace {
+// Names are kept in a deque so that references to them stay valid while new
+// ones are added. Symbols are mostly created by the parser, but compiler thread
+// of Jit reads names as well, so the table is locked
+struct SymbolTable {
+    SymbolTable() {
+        names.emplace_back();
+        ids.emplace(std::string(), 0);
+    }
+
+    std::mutex lock;
+    std::deque<std::string> names;
+    std::unordered_map<std::string, uint32_t> ids;
+};
+
+// Constructed on first use, symbols are created by static initializers too
+SymbolTable& table() {
+    static SymbolTable symbols;
+    return symbols;
+}
+}  // namespace
+
+Symbol::Symbol(const std::string& name) {
+    SymbolTable& symbols = table();
+    std::lock_guard<std::mutex> guard(symbols.lock);
+    if (auto iter = symbols.ids.find(name); iter != symbols.ids.end()) {
+        id = iter->second;
+        return;
+    }
+    id = (uint32_t)symbols.names.size();
+    symbols.names.push_back(name);
+    symbols.ids.emplace(name, id);
+}
+
+const std::string& Symbol::str() const {
+    SymbolTable& symbols = table();
+    std::lock_guard<std::mutex> guard(symbols.lock);
+    return symbols.names[id];
+}
+
+std::ostream& operator<<(std::ostream& os, const Symbol& symbol) {
+    return os << symbol.str();
+}
@@ -0,0 +1,140 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#ifndef NYX_SYMBOL_H
+#define NYX_SYMBOL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+// Identifier interned into a table shared by the whole program, so that names
+// of variables and functions are compared and hashed as 32-bit ids. The empty
+// name takes id 0, names are never removed from the table
+//===----------------------------------------------------------------------===//
+class Symbol {
+public:
+    Symbol() = default;
+
+    // Symbol of name, which is added to the table unless it's there already
+    explicit Symbol(const std::string& name);
+
+    uint32_t getId() const { return id; }
+
+    const std::string& str() const;
+
+    const char* c_str() const { return str().c_str(); }
+
+    bool empty() const { return id == 0; }
+
+    bool operator==(const Symbol& rhs) const { return id == rhs.id; }
+
+    bool operator!=(const Symbol& rhs) const { return id != rhs.id; }
+
+    // Order of ids rather than names
+    bool operator<(const Symbol& rhs) const { return id < rhs.id; }
+
+private:
+    uint32_t id{};
+};
+
+std::ostream& operator<<(std::ostream& os, const Symbol& symbol);
+
+namespace std {
+template <>
+struct hash<Symbol> {
+    size_t operator()(const Symbol& symbol) const noexcept {
+        return symbol.getId();
+    }
+};
+}  // namespace std
+
+// Map keyed by symbols that is kept as a vector of entries sorted by id, which
+// beats hashing for the few entries that tables of functions have
+template <typename V>
+class SymbolMap {
+public:
+    using Entry = std::pair<Symbol, V>;
+    using iterator = typename std::vector<Entry>::iterator;
+    using const_iterator = typename std::vector<Entry>::const_iterator;
+
+    // Value of key, or nullptr if there is no such entry
+    V* find(Symbol key) {
+        auto iter = lowerBound(key);
+        return iter != entries.end() && iter->first == key ? &iter->second
+                                                           : nullptr;
+    }
+
+    const V* find(Symbol key) const {
+        return const_cast<SymbolMap*>(this)->find(key);
+    }
+
+    bool contains(Symbol key) const { return find(key) != nullptr; }
+
+    // Add entry unless key is there already
+    void insert(Symbol key, V value) {
+        auto iter = lowerBound(key);
+        if (iter == entries.end() || iter->first != key) {
+            entries.insert(iter, Entry{key, std::move(value)});
+        }
+    }
+
+    V& operator[](Symbol key) {
+        auto iter = lowerBound(key);
+        if (iter == entries.end() || iter->first != key) {
+            iter = entries.insert(iter, Entry{key, V{}});
+        }
+        return iter->second;
+    }
+
+    void clear() { entries.clear(); }
+
+    bool empty() const { return entries.empty(); }
+
+    size_t size() const { return entries.size(); }
+
+    iterator begin() { return entries.begin(); }
+
+    iterator end() { return entries.end(); }
+
+    const_iterator begin() const { return entries.begin(); }
+
+    const_iterator end() const { return entries.end(); }
+
+private:
+    iterator lowerBound(Symbol key) {
+        return std::lower_bound(
+            entries.begin(), entries.end(), key,
+            [](const Entry& entry, Symbol k) { return entry.first < k; });
+    }
+
+    std::vector<Entry> entries;
+};
+
+#endif  // NYX_SYMBOL_H
@@ -0,0 +1,634 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Trace.h"
+#include <map>
+#include "Assembler.h"
+
+Statement* Tracer::recording = nullptr;
+std::unordered_map<IfStmt*, bool> Tracer::branches;
+
+// Native trace is given up once its entry guards failed this many times
+static constexpr int MaxEntryFailures = 16;
+// Native trace is given up if it side exits more often than once every
+// MinIterationsPerExit iterations, after side exiting MinExits times
+static constexpr int MinExits = 32;
+static constexpr int MinIterationsPerExit = 8;
+
+// Native trace returns 1 if loop was finished and 0 if it side exited
+using TraceEntry = int64_t (*)(int64_t* live, int64_t* saved);
+
+static bool nativeTypeOf(Value value, NativeType* t) {
+    if (value.isInt()) {
+        *t = NativeType::Int;
+    } else if (value.isDouble()) {
+        *t = NativeType::Double;
+    } else if (value.isBool()) {
+        *t = NativeType::Bool;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#if NYX_JIT_SUPPORTED
+
+//===----------------------------------------------------------------------===//
+// Compile loop body along recorded path. Unboxed variables are addressed
+// relative to rbx and their snapshot relative to r14, any unsupported
+// construction makes the loop not traceable
+//===----------------------------------------------------------------------===//
+class TraceCompiler : public AstVisitor {
+public:
+    explicit TraceCompiler(Runtime* rt,
+                           ContextChain* ctxChain,
+                           const std::unordered_map<IfStmt*, bool>& branches)
+        : rt(rt), ctxChain(ctxChain), branches(branches) {}
+
+    LoopTrace* compile(Expression* cond, Expression* post, Block* block) {
+        trace = new LoopTrace;
+        exit = as.newLabel();
+        finished = as.newLabel();
+        snapshot = as.newLabel();
+        Assembler::Label loop = as.newLabel();
+
+        as.push(RBP);
+        as.mov(RBP, RSP);
+        as.push(RBX);
+        as.push(R14);
+        as.mov(RBX, RDI);
+        as.mov(R14, RSI);
+        as.jump(snapshot);
+
+        as.bind(loop);
+        if (post != nullptr) {
+            post->visit(this);
+        }
+        if (cond == nullptr || !expect(cond, NativeType::Bool) ||
+            !typesStable()) {
+            return trace;
+        }
+        as.testEax();
+        as.jump(finished, CondE);
+        compileBlock(block);
+        if (failed) {
+            return trace;
+        }
+        if (!terminated) {
+            if (!typesStable()) {
+                return trace;
+            }
+            as.jump(snapshot);
+        }
+
+        // Count iterations and save variables that might be written
+        int n = (int)trace->addresses.size();
+        as.bind(snapshot);
+        as.inc64(RBX, 8 * n);
+        for (int i = 0; i < n; i++) {
+            if (trace->written[i]) {
+                as.load64(RAX, RBX, 8 * i);
+                as.store64(R14, 8 * i, RAX);
+            }
+        }
+        as.jump(loop);
+
+        as.bind(exit);
+        for (int i = 0; i < n; i++) {
+            if (trace->written[i]) {
+                as.load64(RAX, R14, 8 * i);
+                as.store64(RBX, 8 * i, RAX);
+            }
+        }
+        as.loadImm(0);
+        epilogue();
+        as.bind(finished);
+        as.loadImm(1);
+        epilogue();
+
+        trace->vars.resize(n);
+        trace->live.resize(n + 1);
+        trace->saved.resize(n + 1);
+        trace->entry = as.finalize();
+        return trace;
+    }
+
+private:
+    void epilogue() {
+        // Side exits might happen while temporaries are still on stack
+        as.restoreStack(-16);
+        as.pop(R14);
+        as.pop(RBX);
+        as.pop(RBP);
+        as.ret();
+    }
+
+    void fail() { failed = true; }
+
+    bool expect(Expression* node, NativeType t) {
+        node->visit(this);
+        return !failed && type == t;
+    }
+
+    // Variables must have the same types whenever trace is left or reenters
+    // the loop, which are the types guarded upon entering
+    bool typesStable() {
+        if (types != trace->types) {
+            fail();
+        }
+        return !failed;
+    }
+
+    void compileBlock(Block* block) {
+        for (auto* stmt : block->stmts) {
+            if (terminated || failed) {
+                return;
+            }
+            stmt->visit(this);
+        }
+    }
+
+    // Find stack slot of variable, return -1 if it's not traceable
+    int slotOf(Address addr) {
+        // Variables of blocks within the loop are gone by its back-edge
+        Address fromLoop{addr.depth - nesting, addr.slot};
+        if (!addr.isResolved() || fromLoop.depth < 0) {
+            return -1;
+        }
+        auto key = std::make_pair(fromLoop.depth, fromLoop.slot);
+        if (auto iter = slots.find(key); iter != slots.end()) {
+            return iter->second;
+        }
+        auto* var = Interpreter::lookupVariable(ctxChain, fromLoop);
+        NativeType t;
+        if (var == nullptr || !nativeTypeOf(var->value, &t)) {
+            return -1;
+        }
+        int slot = (int)trace->addresses.size();
+        trace->addresses.push_back(fromLoop);
+        trace->types.push_back(t);
+        trace->written.push_back(false);
+        types.push_back(t);
+        slots.emplace(key, slot);
+        return slot;
+    }
+
+    void visitExpression(Expression* node) override { fail(); }
+    void visitCharExpr(CharExpr* node) override { fail(); }
+    void visitNullExpr(NullExpr* node) override { fail(); }
+    void visitStringExpr(StringExpr* node) override { fail(); }
+    void visitArrayExpr(ArrayExpr* node) override { fail(); }
+    void visitIndexExpr(IndexExpr* node) override { fail(); }
+    void visitClosureExpr(ClosureExpr* node) override { fail(); }
+    void visitStatement(Statement* node) override { fail(); }
+    void visitWhileStmt(WhileStmt* node) override { fail(); }
+    void visitForStmt(ForStmt* node) override { fail(); }
+    void visitForEachStmt(ForEachStmt* node) override { fail(); }
+    void visitMatchStmt(MatchStmt* node) override { fail(); }
+
+    void visitBoolExpr(BoolExpr* node) override {
+        as.loadImm(node->literal ? 1 : 0);
+        type = NativeType::Bool;
+    }
+
+    void visitIntExpr(IntExpr* node) override {
+        as.loadImm(node->literal);
+        type = NativeType::Int;
+    }
+
+    void visitDoubleExpr(DoubleExpr* node) override {
+        int64_t bits;
+        memcpy(&bits, &node->literal, sizeof(double));
+        as.loadImm64(bits);
+        type = NativeType::Double;
+    }
+
+    void visitNameExpr(NameExpr* node) override {
+        int slot = slotOf(node->addr);
+        if (slot == -1) {
+            fail();
+            return;
+        }
+        as.load64(RAX, RBX, 8 * slot);
+        type = types[slot];
+    }
+
+    void visitBinaryExpr(BinaryExpr* node) override {
+        if (node->lhs == nullptr) {
+            fail();
+            return;
+        }
+        node->lhs->visit(this);
+        if (failed) {
+            return;
+        }
+        if (node->rhs == nullptr) {
+            compileUnary(node->opt);
+            return;
+        }
+        NativeType lhsType = type;
+        as.push(RAX);
+        node->rhs->visit(this);
+        if (failed) {
+            return;
+        }
+        NativeType rhsType = type;
+        as.mov(RCX, RAX);
+        as.pop(RAX);
+        compileBinary(node->opt, lhsType, rhsType);
+    }
+
+    void compileUnary(Token opt) {
+        if (opt == TK_LOGNOT && type == NativeType::Bool) {
+            as.xorOne();
+        } else if (opt == TK_MINUS && type == NativeType::Double) {
+            as.flipSign();
+        } else if ((opt == TK_MINUS || opt == TK_BITNOT) &&
+                   type == NativeType::Int) {
+            // Value::operator~ negates its operand as well
+            as.neg();
+        } else {
+            fail();
+        }
+    }
+
+    // Apply operator to rax and rcx, operand types must be exactly what Object
+    // operators accept
+    void compileBinary(Token opt, NativeType lhsType, NativeType rhsType) {
+        bool ints = lhsType == NativeType::Int && rhsType == NativeType::Int;
+        bool doubles =
+            lhsType == NativeType::Double && rhsType == NativeType::Double;
+        bool bools = lhsType == NativeType::Bool && rhsType == NativeType::Bool;
+        bool numbers =
+            lhsType != NativeType::Bool && rhsType != NativeType::Bool;
+        switch (opt) {
+            case TK_PLUS:
+            case TK_PLUS_AGN:
+            case TK_MINUS:
+            case TK_MINUS_AGN:
+            case TK_TIMES:
+            case TK_TIMES_AGN:
+            case TK_DIV:
+            case TK_DIV_AGN:
+                if (ints) {
+                    intArithmetic(opt);
+                    type = NativeType::Int;
+                } else if (numbers) {
+                    as.toDouble(lhsType == NativeType::Int,
+                                rhsType == NativeType::Int);
+                    as.doubleOp(opt == TK_PLUS || opt == TK_PLUS_AGN ? 0x58
+                                : opt == TK_MINUS || opt == TK_MINUS_AGN
+                                    ? 0x5c
+                                : opt == TK_TIMES || opt == TK_TIMES_AGN
+                                    ? 0x59
+                                    : 0x5e);
+                    type = NativeType::Double;
+                } else {
+                    fail();
+                }
+                return;
+            case TK_MOD:
+            case TK_MOD_AGN:
+            case TK_BITAND:
+            case TK_BITOR:
+                if (!ints) {
+                    fail();
+                    return;
+                }
+                intArithmetic(opt);
+                type = NativeType::Int;
+                return;
+            case TK_LT:
+            case TK_LE:
+            case TK_GT:
+            case TK_GE:
+                if (ints) {
+                    as.compare(opt == TK_LT   ? CondL
+                               : opt == TK_LE ? CondLE
+                               : opt == TK_GT ? CondG
+                                              : CondGE);
+                } else if (doubles) {
+                    // a < b is computed as b > a so that unordered operands
+                    // yield false
+                    as.toDouble(false, false);
+                    as.compareDouble(
+                        opt == TK_LT || opt == TK_GT ? CondA : CondAE,
+                        opt == TK_LT || opt == TK_LE);
+                } else {
+                    fail();
+                    return;
+                }
+                type = NativeType::Bool;
+                return;
+            case TK_EQ:
+            case TK_NE:
+                if (ints || bools) {
+                    as.compare(opt == TK_EQ ? CondE : CondNE);
+                } else if (doubles) {
+                    as.toDouble(false, false);
+                    as.compareDouble(opt == TK_EQ ? CondE : CondNE, false);
+                } else {
+                    fail();
+                    return;
+                }
+                type = NativeType::Bool;
+                return;
+            case TK_LOGAND:
+            case TK_LOGOR:
+                if (!bools) {
+                    fail();
+                    return;
+                }
+                opt == TK_LOGAND ? as.andOp() : as.orOp();
+                type = NativeType::Bool;
+                return;
+            default:
+                fail();
+        }
+    }
+
+    void intArithmetic(Token opt) {
+        switch (opt) {
+            case TK_PLUS:
+            case TK_PLUS_AGN:
+                as.add();
+                break;
+            case TK_MINUS:
+            case TK_MINUS_AGN:
+                as.sub();
+                break;
+            case TK_TIMES:
+            case TK_TIMES_AGN:
+                as.imul();
+                break;
+            case TK_DIV:
+            case TK_DIV_AGN:
+                as.idiv(exit);
+                break;
+            case TK_MOD:
+            case TK_MOD_AGN:
+                as.idiv(exit);
+                as.movEaxEdx();
+                break;
+            case TK_BITAND:
+                as.andOp();
+                break;
+            case TK_BITOR:
+                as.orOp();
+                break;
+            default:
+                fail();
+        }
+    }
+
+    void visitAssignExpr(AssignExpr* node) override {
+        auto* lhs = dynamic_cast<NameExpr*>(node->lhs);
+        if (lhs == nullptr) {
+            fail();
+            return;
+        }
+        node->rhs->visit(this);
+        int slot = failed ? -1 : slotOf(lhs->addr);
+        if (slot == -1) {
+            fail();
+            return;
+        }
+        trace->written[slot] = true;
+        if (node->opt == TK_ASSIGN) {
+            as.store64(RBX, 8 * slot, RAX);
+            types[slot] = type;
+            return;
+        }
+        // Assignment expression evaluates to its rhs
+        NativeType rhsType = type;
+        as.mov(RCX, RAX);
+        as.load64(RAX, RBX, 8 * slot);
+        compileBinary(node->opt, types[slot], rhsType);
+        as.store64(RBX, 8 * slot, RAX);
+        as.mov(RAX, RCX);
+        types[slot] = type;
+        type = rhsType;
+    }
+
+    void visitFunCallExpr(FunCallExpr* node) override {
+        if (node->receiver != nullptr ||
+            rt->getBuiltinFunction(node->funcName) != nullptr) {
+            fail();
+            return;
+        }
+        // Only functions that baseline JIT compiler accepts are called, they
+        // have no side effect thus the iteration can still be redone
+        Func* callee = rt->getFunction(node->funcName);
+        if (callee == nullptr || callee->params.size() != node->args.size()) {
+            fail();
+            return;
+        }
+        NativeCode* code = Jit::compile(rt, callee);
+        if (code->entry == nullptr) {
+            fail();
+            return;
+        }
+        static const Reg argRegs[] = {RDI, RSI, RDX, RCX, R8, R9};
+        for (auto* arg : node->args) {
+            if (!expect(arg, NativeType::Int)) {
+                fail();
+                return;
+            }
+            as.push(RAX);
+        }
+        for (int i = (int)node->args.size() - 1; i >= 0; i--) {
+            as.pop(argRegs[i]);
+        }
+        as.call(code->entry);
+        as.testRdx();
+        as.jump(exit, CondNE);
+        type = code->returnType;
+    }
+
+    void visitSimpleStmt(SimpleStmt* node) override { node->expr->visit(this); }
+
+    void visitReturnStmt(ReturnStmt* node) override {
+        // Leave it to interpreter
+        as.jump(exit);
+        terminated = true;
+    }
+
+    void visitBreakStmt(BreakStmt* node) override {
+        if (typesStable()) {
+            as.jump(finished);
+            terminated = true;
+        }
+    }
+
+    void visitContinueStmt(ContinueStmt* node) override {
+        if (typesStable()) {
+            as.jump(snapshot);
+            terminated = true;
+        }
+    }
+
+    void visitIfStmt(IfStmt* node) override {
+        if (!expect(node->cond, NativeType::Bool)) {
+            fail();
+            return;
+        }
+        auto iter = branches.find(node);
+        if (iter == branches.end()) {
+            // Never reached while recording
+            as.jump(exit);
+            terminated = true;
+            return;
+        }
+        as.testEax();
+        as.jump(exit, iter->second ? CondE : CondNE);
+        nesting++;
+        if (iter->second) {
+            compileBlock(node->block);
+        } else if (node->elseBlock != nullptr) {
+            compileBlock(node->elseBlock);
+        }
+        nesting--;
+    }
+
+    Runtime* rt;
+    ContextChain* ctxChain;
+    const std::unordered_map<IfStmt*, bool>& branches;
+    Assembler as;
+    LoopTrace* trace{};
+    Assembler::Label exit{};
+    Assembler::Label finished{};
+    Assembler::Label snapshot{};
+    std::map<std::pair<int, int>, int> slots;
+    // Blocks within the loop that current point of trace is in
+    int nesting{};
+    // Types of variables at current point of trace
+    std::vector<NativeType> types;
+    NativeType type{};
+    bool failed{};
+    // Whether rest of current path is unreachable
+    bool terminated{};
+};
+
+#endif
+
+bool Tracer::onBackEdge(Runtime* rt, ContextChain* ctxChain, WhileStmt* loop) {
+    return backEdge(rt, ctxChain, loop, loop->cond, nullptr, loop->block,
+                    &loop->backEdges, &loop->trace);
+}
+
+bool Tracer::onBackEdge(Runtime* rt, ContextChain* ctxChain, ForStmt* loop) {
+    return backEdge(rt, ctxChain, loop, loop->cond, loop->post, loop->block,
+                    &loop->backEdges, &loop->trace);
+}
+
+bool Tracer::backEdge(Runtime* rt,
+                      ContextChain* ctxChain,
+                      Statement* loop,
+                      Expression* cond,
+                      Expression* post,
+                      Block* block,
+                      int* backEdges,
+                      LoopTrace** trace) {
+#if NYX_JIT_SUPPORTED
+    if (*trace != nullptr) {
+        return (*trace)->entry != nullptr && run(rt, ctxChain, *trace);
+    }
+    if (Jit::threshold <= 0) {
+        return false;
+    }
+    if (recording == loop) {
+        // Just finished recording an iteration
+        recording = nullptr;
+        TraceCompiler compiler(rt, ctxChain, branches);
+        *trace = compiler.compile(cond, post, block);
+        branches.clear();
+        return (*trace)->entry != nullptr && run(rt, ctxChain, *trace);
+    }
+    if (++*backEdges >= Jit::threshold) {
+        // Recording of other loop, if any, is abandoned
+        recording = loop;
+        branches.clear();
+    }
+#endif
+    return false;
+}
+
+bool Tracer::run(Runtime* rt, ContextChain* ctxChain, LoopTrace* trace) {
+    int n = (int)trace->addresses.size();
+    for (int i = 0; i < n; i++) {
+        auto* var = Interpreter::lookupVariable(ctxChain, trace->addresses[i]);
+        NativeType t;
+        if (var == nullptr || !nativeTypeOf(var->value, &t) ||
+            t != trace->types[i]) {
+            if (++trace->entryFailures >= MaxEntryFailures) {
+                trace->entry = nullptr;
+            }
+            return false;
+        }
+        trace->vars[i] = var;
+        switch (t) {
+            case NativeType::Int:
+                trace->live[i] = var->value.asInt();
+                break;
+            case NativeType::Double: {
+                double value = var->value.asDouble();
+                memcpy(&trace->live[i], &value, sizeof(double));
+                break;
+            }
+            case NativeType::Bool:
+                trace->live[i] = var->value.asBool();
+                break;
+        }
+    }
+    trace->live[n] = 0;
+
+    auto entry = (TraceEntry)trace->entry;
+    bool loopFinished = entry(trace->live.data(), trace->saved.data()) != 0;
+
+    // Box written variables back
+    for (int i = 0; i < n; i++) {
+        if (!trace->written[i]) {
+            continue;
+        }
+        switch (trace->types[i]) {
+            case NativeType::Int:
+                trace->vars[i]->value = rt->newObject((int)trace->live[i]);
+                break;
+            case NativeType::Double: {
+                double value;
+                memcpy(&value, &trace->live[i], sizeof(double));
+                trace->vars[i]->value = rt->newObject(value);
+                break;
+            }
+            case NativeType::Bool:
+                trace->vars[i]->value = rt->newObject(trace->live[i] != 0);
+                break;
+        }
+    }
+    trace->iterations += trace->live[n];
+    if (!loopFinished && ++trace->exits >= MinExits &&
+        trace->iterations < (int64_t)trace->exits * MinIterationsPerExit) {
+        trace->entry = nullptr;
+    }
+    return loopFinished;
+}
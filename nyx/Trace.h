@@ -0,0 +1,96 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_TRACE_H
+#define NYX_TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Ast.h"
+#include "Interpreter.h"
+#include "Jit.h"
+#include "Runtime.hpp"
+
+struct LoopTrace {
+    // Entry of compiled trace, it's null if loop can not be traced or native
+    // code was given up
+    void* entry{};
+    // Variables used by trace, addressed from context of the loop, and their
+    // types upon entering it
+    std::vector<Address> addresses;
+    std::vector<NativeType> types;
+    std::vector<bool> written;
+    std::vector<Variable*> vars;
+    // Unboxed variables followed by iteration counter, and their snapshot
+    // taken at the beginning of each iteration
+    std::vector<int64_t> live;
+    std::vector<int64_t> saved;
+    int64_t iterations{};
+    int exits{};
+    int entryFailures{};
+};
+
+//===----------------------------------------------------------------------===//
+// Tracing JIT compiler for hot loops. Once a loop back-edge gets hot, the
+// branches taken by its next iteration are recorded, then the loop body is
+// compiled along the recorded path with unboxed variables. Whenever a guard
+// fails, native code restores the variables saved at the beginning of current
+// iteration and leaves it to interpreter
+//===----------------------------------------------------------------------===//
+class Tracer {
+public:
+    // Called when back-edge of a loop is taken, return true if native trace
+    // has finished the whole loop
+    static bool onBackEdge(Runtime* rt,
+                           ContextChain* ctxChain,
+                           WhileStmt* loop);
+
+    static bool onBackEdge(Runtime* rt,
+                           ContextChain* ctxChain,
+                           ForStmt* loop);
+
+    static void recordBranch(IfStmt* node, bool taken) {
+        branches.emplace(node, taken);
+    }
+
+    // Loop whose iteration is being recorded, if any
+    static Statement* recording;
+
+private:
+    static bool backEdge(Runtime* rt,
+                         ContextChain* ctxChain,
+                         Statement* loop,
+                         Expression* cond,
+                         Expression* post,
+                         Block* block,
+                         int* backEdges,
+                         LoopTrace** trace);
+
+    static bool run(Runtime* rt, ContextChain* ctxChain, LoopTrace* trace);
+
+    static std::unordered_map<IfStmt*, bool> branches;
+};
+
+#endif  // NYX_TRACE_H
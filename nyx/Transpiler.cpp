@@ -0,0 +1,1172 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Transpiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include "Rewriter.h"
+#include "Utils.hpp"
+
+static std::string quote(const std::string& str) {
+    std::ostringstream os;
+    os << '"';
+    for (unsigned char c : str) {
+        switch (c) {
+            case '"':
+                os << "\\\"";
+                break;
+            case '\\':
+                os << "\\\\";
+                break;
+            case '\n':
+                os << "\\n";
+                break;
+            case '\t':
+                os << "\\t";
+                break;
+            default:
+                if (c < 0x20 || c >= 0x7f) {
+                    // Octal escape never swallows following digits
+                    os << '\\' << std::oct << std::setw(3) << std::setfill('0')
+                       << (int)c << std::dec;
+                } else {
+                    os << c;
+                }
+        }
+    }
+    os << '"';
+    return os.str();
+}
+
+static std::string tokenName(Token opt) {
+    switch (opt) {
+        case TK_BITAND:
+            return "TK_BITAND";
+        case TK_BITOR:
+            return "TK_BITOR";
+        case TK_BITNOT:
+            return "TK_BITNOT";
+        case TK_LOGAND:
+            return "TK_LOGAND";
+        case TK_LOGOR:
+            return "TK_LOGOR";
+        case TK_LOGNOT:
+            return "TK_LOGNOT";
+        case TK_PLUS:
+            return "TK_PLUS";
+        case TK_MINUS:
+            return "TK_MINUS";
+        case TK_TIMES:
+            return "TK_TIMES";
+        case TK_DIV:
+            return "TK_DIV";
+        case TK_MOD:
+            return "TK_MOD";
+        case TK_EQ:
+            return "TK_EQ";
+        case TK_NE:
+            return "TK_NE";
+        case TK_GT:
+            return "TK_GT";
+        case TK_GE:
+            return "TK_GE";
+        case TK_LT:
+            return "TK_LT";
+        case TK_LE:
+            return "TK_LE";
+        case TK_ASSIGN:
+            return "TK_ASSIGN";
+        case TK_PLUS_AGN:
+            return "TK_PLUS_AGN";
+        case TK_MINUS_AGN:
+            return "TK_MINUS_AGN";
+        case TK_TIMES_AGN:
+            return "TK_TIMES_AGN";
+        case TK_DIV_AGN:
+            return "TK_DIV_AGN";
+        case TK_MOD_AGN:
+            return "TK_MOD_AGN";
+        default:
+            return "(Token)" + std::to_string(opt);
+    }
+}
+
+static std::string position(AstNode* node) {
+    return std::to_string(node->line) + ", " + std::to_string(node->column);
+}
+
+enum class StaticType { Int, Bool };
+
+static const char* cType(StaticType t) {
+    return t == StaticType::Bool ? "bool" : "int";
+}
+
+//===----------------------------------------------------------------------===//
+// Translate named function to statically typed code, any unsupported
+// construction makes the whole function untyped. It accepts exactly what JIT
+// compiler accepts, every variable is a C++ local of fixed type. Typed code
+// throws Bailout wherever JIT compiled code bails out
+//===----------------------------------------------------------------------===//
+class TypedTranspiler : public AstVisitor {
+public:
+    explicit TypedTranspiler(Transpiler* transpiler,
+                             Runtime* rt,
+                             Func* f,
+                             StaticType returnType)
+        : transpiler(transpiler), rt(rt), f(f), returnType(returnType) {}
+
+    bool transpile() {
+        std::string params;
+        for (int i = 0; i < (int)f->params.size(); i++) {
+            if (vars.find(f->params[i]) != vars.end()) {
+                return false;
+            }
+            define(f->params[i], StaticType::Int);
+            params += (i > 0 ? ", int v" : "int v") + std::to_string(i);
+        }
+        for (auto* stmt : f->block->stmts) {
+            open("{");
+            stmt->visit(this);
+            close();
+            if (failed) {
+                return false;
+            }
+        }
+        // Falling off the end returns null, which is left to dynamic code
+        line("throw Bailout{};");
+        if (returns == 0) {
+            return false;
+        }
+        signature = std::string("static ") + cType(returnType) + " func" +
+                    std::to_string(transpiler->functionId(f)) + "_typed(" +
+                    params + ")";
+        // Locals are declared in advance so that jumps never cross them
+        std::vector<StaticType> types(vars.size());
+        for (const auto& [name, var] : vars) {
+            types[var.index] = var.type;
+        }
+        std::string locals;
+        for (int i = (int)f->params.size(); i < (int)types.size(); i++) {
+            locals += std::string("    ") + cType(types[i]) + " v" +
+                      std::to_string(i) + "{};\n";
+        }
+        code = signature + " {\n" + locals + "start:;\n" + body + "}\n";
+        return true;
+    }
+
+    std::string signature;
+    std::string code;
+    // Whether any return statement disagrees with the assumed return type
+    bool returnTypeMismatch{};
+
+private:
+    struct Var {
+        int index;
+        StaticType type;
+    };
+
+    struct Loop {
+        std::string breakLabel;
+        std::string continueLabel;
+    };
+
+    void line(const std::string& text) {
+        body += std::string(4 * indent, ' ') + text + "\n";
+    }
+
+    void open(const std::string& text) {
+        line(text);
+        indent++;
+    }
+
+    void close() {
+        indent--;
+        line("}");
+    }
+
+    std::string temp() { return "t" + std::to_string(temps++); }
+
+    std::string label() { return "L" + std::to_string(labels++); }
+
+    int define(Symbol name, StaticType t) {
+        int index = (int)vars.size();
+        vars.emplace(name, Var{index, t});
+        return index;
+    }
+
+    void fail() { failed = true; }
+
+    // Emit expression, return false if it's not of expected type
+    bool expect(Expression* node, StaticType t) {
+        node->visit(this);
+        return !failed && type == t;
+    }
+
+    void nested(Block* block) {
+        depth++;
+        for (auto* stmt : block->stmts) {
+            open("{");
+            stmt->visit(this);
+            close();
+            if (failed) {
+                break;
+            }
+        }
+        depth--;
+    }
+
+    // Emit value of expression, it's of current type
+    void result(const std::string& expr) {
+        value = temp();
+        line(std::string(cType(type)) + " " + value + " = " + expr + ";");
+    }
+
+    void visitExpression(Expression* node) override { fail(); }
+    void visitCharExpr(CharExpr* node) override { fail(); }
+    void visitNullExpr(NullExpr* node) override { fail(); }
+    void visitDoubleExpr(DoubleExpr* node) override { fail(); }
+    void visitStringExpr(StringExpr* node) override { fail(); }
+    void visitArrayExpr(ArrayExpr* node) override { fail(); }
+    void visitIndexExpr(IndexExpr* node) override { fail(); }
+    void visitClosureExpr(ClosureExpr* node) override { fail(); }
+    void visitStatement(Statement* node) override { fail(); }
+    void visitForEachStmt(ForEachStmt* node) override { fail(); }
+    void visitMatchStmt(MatchStmt* node) override { fail(); }
+
+    void visitBoolExpr(BoolExpr* node) override {
+        value = node->literal ? "true" : "false";
+        type = StaticType::Bool;
+    }
+
+    void visitIntExpr(IntExpr* node) override {
+        value = std::to_string(node->literal);
+        type = StaticType::Int;
+    }
+
+    void visitNameExpr(NameExpr* node) override {
+        auto iter = vars.find(node->identName);
+        if (iter == vars.end()) {
+            fail();
+            return;
+        }
+        value = "v" + std::to_string(iter->second.index);
+        type = iter->second.type;
+    }
+
+    void visitBinaryExpr(BinaryExpr* node) override {
+        if (node->lhs == nullptr) {
+            fail();
+            return;
+        }
+        if (node->rhs == nullptr) {
+            emitUnary(node);
+            return;
+        }
+        node->lhs->visit(this);
+        if (failed) {
+            return;
+        }
+        // Variables might be assigned by rhs, so take a copy of lhs
+        StaticType lhsType = type;
+        std::string lhs = temp();
+        line(std::string(cType(lhsType)) + " " + lhs + " = " + value + ";");
+        node->rhs->visit(this);
+        if (failed) {
+            return;
+        }
+        StaticType rhsType = type;
+        std::string rhs = value;
+        bool ints = lhsType == StaticType::Int && rhsType == StaticType::Int;
+        bool bools =
+            lhsType == StaticType::Bool && rhsType == StaticType::Bool;
+        switch (node->opt) {
+            case TK_PLUS:
+            case TK_MINUS:
+            case TK_TIMES:
+            case TK_DIV:
+            case TK_MOD:
+            case TK_BITAND:
+            case TK_BITOR:
+                if (!ints) {
+                    fail();
+                    return;
+                }
+                type = StaticType::Int;
+                result(arithmetic(node->opt, lhs, rhs));
+                return;
+            case TK_LT:
+            case TK_LE:
+            case TK_GT:
+            case TK_GE:
+                if (!ints) {
+                    fail();
+                    return;
+                }
+                type = StaticType::Bool;
+                result(lhs + (node->opt == TK_LT   ? " < "
+                              : node->opt == TK_LE ? " <= "
+                              : node->opt == TK_GT ? " > "
+                                                   : " >= ") +
+                       rhs);
+                return;
+            case TK_EQ:
+            case TK_NE:
+                if (!ints && !bools) {
+                    fail();
+                    return;
+                }
+                type = StaticType::Bool;
+                result(lhs + (node->opt == TK_EQ ? " == " : " != ") + rhs);
+                return;
+            case TK_LOGAND:
+            case TK_LOGOR:
+                // Both operands were evaluated already, as interpreter does
+                if (!bools) {
+                    fail();
+                    return;
+                }
+                type = StaticType::Bool;
+                result(lhs + (node->opt == TK_LOGAND ? " && " : " || ") +
+                       rhs);
+                return;
+            default:
+                fail();
+        }
+    }
+
+    void emitUnary(BinaryExpr* node) {
+        node->lhs->visit(this);
+        if (failed) {
+            return;
+        }
+        if (node->opt == TK_LOGNOT && type == StaticType::Bool) {
+            result("!" + value);
+        } else if ((node->opt == TK_MINUS || node->opt == TK_BITNOT) &&
+                   type == StaticType::Int) {
+            // Value::operator~ negates its operand as well
+            result("-" + value);
+        } else {
+            fail();
+        }
+    }
+
+    // Apply arithmetic operator to int operands
+    std::string arithmetic(Token opt, const std::string& lhs,
+                           const std::string& rhs) {
+        switch (opt) {
+            case TK_PLUS:
+            case TK_PLUS_AGN:
+                return lhs + " + " + rhs;
+            case TK_MINUS:
+            case TK_MINUS_AGN:
+                return lhs + " - " + rhs;
+            case TK_TIMES:
+            case TK_TIMES_AGN:
+                return lhs + " * " + rhs;
+            case TK_DIV:
+            case TK_DIV_AGN:
+                line("if (" + rhs + " == 0) throw Bailout{};");
+                return lhs + " / " + rhs;
+            case TK_MOD:
+            case TK_MOD_AGN:
+                line("if (" + rhs + " == 0) throw Bailout{};");
+                return lhs + " % " + rhs;
+            case TK_BITAND:
+                return lhs + " & " + rhs;
+            case TK_BITOR:
+                return lhs + " | " + rhs;
+            default:
+                fail();
+                return "";
+        }
+    }
+
+    void visitAssignExpr(AssignExpr* node) override {
+        auto* lhs = dynamic_cast<NameExpr*>(node->lhs);
+        if (lhs == nullptr) {
+            fail();
+            return;
+        }
+        node->rhs->visit(this);
+        if (failed) {
+            return;
+        }
+        auto iter = vars.find(lhs->identName);
+        if (node->opt == TK_ASSIGN) {
+            if (iter == vars.end()) {
+                // Variable created by unconditionally executed statement
+                // is visible to all statements that follow
+                if (depth > 0) {
+                    fail();
+                    return;
+                }
+                int index = define(lhs->identName, type);
+                line("v" + std::to_string(index) + " = " + value + ";");
+                return;
+            }
+            if (iter->second.type != type) {
+                fail();
+                return;
+            }
+            line("v" + std::to_string(iter->second.index) + " = " + value +
+                 ";");
+            return;
+        }
+        if (iter == vars.end() || iter->second.type != StaticType::Int ||
+            type != StaticType::Int) {
+            fail();
+            return;
+        }
+        // Assignment expression evaluates to its rhs
+        std::string rhs = value;
+        std::string var = "v" + std::to_string(iter->second.index);
+        line(var + " = " + arithmetic(node->opt, var, rhs) + ";");
+        value = rhs;
+    }
+
+    void visitFunCallExpr(FunCallExpr* node) override {
+        if (node->receiver != nullptr ||
+            rt->getBuiltinFunction(node->funcName) != nullptr) {
+            fail();
+            return;
+        }
+        Func* callee = rt->getFunction(node->funcName);
+        if (callee == nullptr || callee->params.size() != node->args.size()) {
+            fail();
+            return;
+        }
+        StaticType calleeReturnType = returnType;
+        if (callee != f) {
+            const Transpiler::TypedFunc* typed = transpiler->typedFunc(callee);
+            if (typed == nullptr) {
+                fail();
+                return;
+            }
+            calleeReturnType =
+                typed->returnsBool ? StaticType::Bool : StaticType::Int;
+        }
+        std::string args;
+        for (auto* arg : node->args) {
+            if (!expect(arg, StaticType::Int)) {
+                fail();
+                return;
+            }
+            std::string copy = temp();
+            line("int " + copy + " = " + value + ";");
+            args += (args.empty() ? "" : ", ") + copy;
+        }
+        // Bailout of callee propagates to the outermost typed frame
+        type = calleeReturnType;
+        result("func" + std::to_string(transpiler->functionId(callee)) +
+               "_typed(" + args + ")");
+    }
+
+    void visitSimpleStmt(SimpleStmt* node) override { node->expr->visit(this); }
+
+    // Tail call to itself reassigns parameters and starts over, which runs in
+    // constant native stack
+    bool selfTailCall(FunCallExpr* node) {
+        if (rt->getBuiltinFunction(node->funcName) != nullptr ||
+            rt->getFunction(node->funcName) != f ||
+            node->args.size() != f->params.size()) {
+            return false;
+        }
+        std::vector<std::string> args;
+        for (auto* arg : node->args) {
+            if (!expect(arg, StaticType::Int)) {
+                fail();
+                return true;
+            }
+            args.push_back(temp());
+            line("int " + args.back() + " = " + value + ";");
+        }
+        for (int i = 0; i < (int)args.size(); i++) {
+            if (vars.find(f->params[i])->second.type != StaticType::Int) {
+                fail();
+                return true;
+            }
+            line("v" + std::to_string(i) + " = " + args[i] + ";");
+        }
+        line("goto start;");
+        return true;
+    }
+
+    void visitReturnStmt(ReturnStmt* node) override {
+        if (node->ret == nullptr) {
+            fail();
+            return;
+        }
+        if (node->tailCall != nullptr && selfTailCall(node->tailCall)) {
+            returns++;
+            return;
+        }
+        node->ret->visit(this);
+        if (failed) {
+            return;
+        }
+        if (type != returnType) {
+            returnTypeMismatch = true;
+            fail();
+            return;
+        }
+        line("return " + value + ";");
+        returns++;
+    }
+
+    void visitBreakStmt(BreakStmt* node) override {
+        if (loops.empty()) {
+            fail();
+            return;
+        }
+        line("goto " + loops.back().breakLabel + ";");
+    }
+
+    void visitContinueStmt(ContinueStmt* node) override {
+        if (loops.empty()) {
+            fail();
+            return;
+        }
+        line("goto " + loops.back().continueLabel + ";");
+    }
+
+    void visitIfStmt(IfStmt* node) override {
+        if (!expect(node->cond, StaticType::Bool)) {
+            fail();
+            return;
+        }
+        open("if (" + value + ") {");
+        nested(node->block);
+        if (node->elseBlock != nullptr) {
+            indent--;
+            open("} else {");
+            nested(node->elseBlock);
+        }
+        close();
+    }
+
+    // Emit loop whose condition is checked at top and whose post expression,
+    // if any, runs after continue
+    void emitLoop(Expression* cond, Block* block, Expression* post) {
+        Loop loop{label(), label()};
+        open("for (;;) {");
+        depth++;
+        bool isBool = expect(cond, StaticType::Bool);
+        depth--;
+        if (!isBool) {
+            fail();
+            return;
+        }
+        line("if (!" + value + ") goto " + loop.breakLabel + ";");
+        loops.push_back(loop);
+        open("{");
+        nested(block);
+        close();
+        loops.pop_back();
+        if (failed) {
+            return;
+        }
+        line(loop.continueLabel + ":;");
+        if (post != nullptr) {
+            depth++;
+            post->visit(this);
+            depth--;
+        }
+        close();
+        line(loop.breakLabel + ":;");
+    }
+
+    void visitWhileStmt(WhileStmt* node) override {
+        emitLoop(node->cond, node->block, nullptr);
+    }
+
+    void visitForStmt(ForStmt* node) override {
+        if (node->init == nullptr || node->cond == nullptr ||
+            node->post == nullptr) {
+            fail();
+            return;
+        }
+        node->init->visit(this);
+        if (failed) {
+            return;
+        }
+        emitLoop(node->cond, node->block, node->post);
+    }
+
+    Transpiler* transpiler;
+    Runtime* rt;
+    Func* f;
+    StaticType returnType;
+    std::string body;
+    int indent{1};
+    int temps{};
+    int labels{};
+    std::unordered_map<Symbol, Var> vars;
+    std::vector<Loop> loops;
+    // Nesting level of current statement, zero means function body itself
+    int depth{};
+    int returns{};
+    // Temporary or literal that holds value of the latest expression
+    std::string value;
+    StaticType type{};
+    bool failed{};
+};
+
+std::string Transpiler::transpile(const std::string& fileName) {
+    std::vector<Func*> funcs;
+    for (auto& [name, f] : rt->getFunctions()) {
+        funcs.push_back(f);
+    }
+    // Keep generated code stable across runs
+    std::sort(funcs.begin(), funcs.end(),
+              [](Func* a, Func* b) { return a->name.str() < b->name.str(); });
+    for (int i = 0; i < (int)funcs.size(); i++) {
+        funcIds.emplace(funcs[i], i);
+    }
+    for (auto* f : funcs) {
+        emitNamedFunc(f);
+    }
+    Function main;
+    main.isTopLevel = true;
+    func = &main;
+    emitBody(rt->getStatements());
+    func = nullptr;
+
+    std::ostringstream os;
+    os << "// Generated by nyxc from " << fileName << ", do not edit\n"
+       << "#include \"Aot.h\"\n\n"
+       << "static Value k[" << std::max<size_t>(1, constants.size())
+       << "];\n"
+       << "static Symbol s[" << std::max<size_t>(1, symbols.size()) << "];\n";
+    for (int i = 0; i < (int)funcs.size(); i++) {
+        os << "static Func func" << i << ";  // " << funcs[i]->name << "\n";
+    }
+    os << "\n";
+    for (const auto& p : prototypes) {
+        os << p << ";\n";
+    }
+    for (const auto& d : definitions) {
+        os << "\n" << d;
+    }
+    os << "\nint main() {\n"
+       << "    auto* rt = new Runtime;\n";
+    for (int i = 0; i < (int)symbols.size(); i++) {
+        os << "    s[" << i << "] = Symbol(" << quote(symbols[i].str())
+           << ");\n";
+    }
+    for (int i = 0; i < (int)constants.size(); i++) {
+        os << "    k[" << i << "] = " << constants[i] << ";\n";
+    }
+    for (int i = 0; i < (int)funcs.size(); i++) {
+        std::string params;
+        for (const auto& param : funcs[i]->params) {
+            params += (params.empty() ? "" : ", ") + symbol(param);
+        }
+        os << "    func" << i << ".name = " << symbol(funcs[i]->name) << ";\n"
+           << "    func" << i << ".params = {" << params << "};\n"
+           << "    func" << i << ".frameSize = " << funcs[i]->frameSize
+           << ";\n"
+           << "    func" << i << ".captured = " << captured(funcs[i]->captured)
+           << ";\n"
+           << "    func" << i << ".compiled = &func" << i << "_dynamic;\n"
+           << "    rt->addFunction(func" << i << ".name, &func" << i
+           << ");\n";
+    }
+    os << "    auto* ctxChain = new ContextChain;\n"
+       << "    Interpreter::newContext(ctxChain);\n"
+       << main.code << "    return 0;\n"
+       << "}\n";
+    return os.str();
+}
+
+const Transpiler::TypedFunc* Transpiler::typedFunc(Func* f) {
+    if (auto iter = typedFuncs.find(f); iter != typedFuncs.end()) {
+        return iter->second;
+    }
+    if (std::find(typing.begin(), typing.end(), f) != typing.end()) {
+        // Mutual recursion is not supported yet
+        return nullptr;
+    }
+    typing.push_back(f);
+    TypedFunc* typed = nullptr;
+    // Return type of recursive calls is unknown until the whole function is
+    // translated, try int first and then bool
+    for (StaticType t : {StaticType::Int, StaticType::Bool}) {
+        TypedTranspiler transpiler(this, rt, f, t);
+        if (transpiler.transpile()) {
+            typed = new TypedFunc{funcIds.at(f), t == StaticType::Bool};
+            prototypes.push_back(transpiler.signature);
+            definitions.push_back(transpiler.code);
+            break;
+        }
+        if (!transpiler.returnTypeMismatch) {
+            break;
+        }
+    }
+    typing.pop_back();
+    typedFuncs.emplace(f, typed);
+    return typed;
+}
+
+void Transpiler::emitNamedFunc(Func* f) {
+    std::string id = std::to_string(funcIds.at(f));
+    Function fn;
+    fn.isNamed = true;
+    func = &fn;
+    if (const TypedFunc* typed = typedFunc(f); typed != nullptr) {
+        // Guard on argument types, typed code expects int values only
+        std::string guard;
+        std::string args;
+        for (int i = 0; i < (int)f->params.size(); i++) {
+            std::string arg = "args[" + std::to_string(i) + "]";
+            guard += (i > 0 ? " && " : "") + arg + ".isInt()";
+            args += (i > 0 ? ", " : "") + arg + ".asInt()";
+        }
+        open("if (" + (guard.empty() ? "true" : guard) + ") {");
+        open("try {");
+        line("return rt->newObject(func" + id + "_typed(" + args + "));");
+        func->indent--;
+        open("} catch (const Bailout&) {");
+        close();
+        close();
+    }
+    line("ContextChain* ctxChain = Aot::enter(rt, f, closure, args);");
+    emitBody(f->block->stmts);
+    line("return Aot::leave(ctxChain, nullptr);");
+    std::string signature =
+        "static Value func" + id +
+        "_dynamic(Runtime* rt, Func* f, const BoundFunc* closure, "
+        "ObjectArray& args)";
+    prototypes.push_back(signature);
+    definitions.push_back(signature + " {\n" + fn.code + "}\n");
+    func = nullptr;
+}
+
+//===----------------------------------------------------------------------===//
+// Emit dynamically typed code, every expression is evaluated to a temporary
+// in order, so that side effects happen exactly as interpreter makes them
+//===----------------------------------------------------------------------===//
+std::string Transpiler::emit(Expression* node) {
+    node->visit(this);
+    return value;
+}
+
+void Transpiler::emitBlock(Block* block) {
+    for (auto* stmt : block->stmts) {
+        open("{");
+        stmt->visit(this);
+        close();
+    }
+}
+
+void Transpiler::emitBody(const std::vector<Statement*>& stmts) {
+    for (auto* stmt : stmts) {
+        func->stmtEnd = label();
+        open("{");
+        stmt->visit(this);
+        close();
+        line(func->stmtEnd + ":;");
+    }
+}
+
+std::string Transpiler::emitArguments(const std::vector<Expression*>& args) {
+    std::string values;
+    for (auto* arg : args) {
+        values += (values.empty() ? "" : ", ") + emit(arg);
+    }
+    return "ObjectArray{" + values + "}";
+}
+
+void Transpiler::line(const std::string& text) {
+    func->code += std::string(4 * func->indent, ' ') + text + "\n";
+}
+
+void Transpiler::open(const std::string& text) {
+    line(text);
+    func->indent++;
+}
+
+void Transpiler::close(const std::string& text) {
+    func->indent--;
+    line(text);
+}
+
+std::string Transpiler::temp() {
+    return "t" + std::to_string(temps++);
+}
+
+std::string Transpiler::label() {
+    return "L" + std::to_string(labels++);
+}
+
+std::string Transpiler::constant(const std::string& init) {
+    constants.push_back(init);
+    return "k[" + std::to_string(constants.size() - 1) + "]";
+}
+
+std::string Transpiler::symbol(Symbol name) {
+    auto iter = std::find(symbols.begin(), symbols.end(), name);
+    if (iter == symbols.end()) {
+        iter = symbols.insert(iter, name);
+    }
+    return "s[" + std::to_string(iter - symbols.begin()) + "]";
+}
+
+std::string Transpiler::address(Address addr) {
+    return "Address{" + std::to_string(addr.depth) + ", " +
+           std::to_string(addr.slot) + "}";
+}
+
+std::string Transpiler::captured(const std::vector<bool>& slots) {
+    std::string init;
+    for (bool slot : slots) {
+        init += init.empty() ? "" : ", ";
+        init += slot ? "true" : "false";
+    }
+    return "{" + init + "}";
+}
+
+void Transpiler::visitExpression(Expression* node) {
+    panic("abstract expression at line %d, col %d\n", node->line,
+          node->column);
+}
+
+void Transpiler::visitBoolExpr(BoolExpr* node) {
+    value = constant(node->literal ? "rt->newObject(true)"
+                                   : "rt->newObject(false)");
+}
+
+void Transpiler::visitCharExpr(CharExpr* node) {
+    value = constant("rt->newObject((char)" +
+                     std::to_string((int)node->literal) + ")");
+}
+
+void Transpiler::visitNullExpr(NullExpr* node) {
+    value = constant("rt->newObject()");
+}
+
+void Transpiler::visitIntExpr(IntExpr* node) {
+    value = constant("rt->newObject(" + std::to_string(node->literal) + ")");
+}
+
+void Transpiler::visitDoubleExpr(DoubleExpr* node) {
+    std::ostringstream os;
+    os << std::setprecision(17) << node->literal;
+    std::string literal = os.str();
+    if (literal.find_first_of(".e") == std::string::npos) {
+        literal += ".0";
+    }
+    value = constant("rt->newObject(" + literal + ")");
+}
+
+void Transpiler::visitStringExpr(StringExpr* node) {
+    value = constant("rt->newObject(std::string(" + quote(node->literal.str()) +
+                     ", " + std::to_string(node->literal.length()) + "))");
+}
+
+void Transpiler::visitArrayExpr(ArrayExpr* node) {
+    std::string elements = emitArguments(node->literal);
+    value = temp();
+    line("Value " + value + " = rt->newObject(" + elements + ");");
+}
+
+void Transpiler::visitNameExpr(NameExpr* node) {
+    value = temp();
+    line("Value " + value + " = Aot::lookupName(rt, ctxChain, " +
+         symbol(node->identName) + ", " + address(node->addr) + ", " +
+         position(node) + ");");
+}
+
+void Transpiler::visitIndexExpr(IndexExpr* node) {
+    std::string var = temp();
+    line("Variable* " + var + " = Aot::lookupArray(ctxChain, " +
+         symbol(node->identName) + ", " + address(node->addr) + ", " +
+         position(node) + ");");
+    std::string index = emit(node->index);
+    value = temp();
+    line("Value " + value + " = Interpreter::lookupElement(" +
+         symbol(node->identName) + ", " + var + ", " + index + ", " +
+         position(node) + ");");
+}
+
+void Transpiler::visitBinaryExpr(BinaryExpr* node) {
+    std::string lhs =
+        node->lhs ? emit(node->lhs) : constant("rt->newObject()");
+    std::string rhs =
+        node->rhs ? emit(node->rhs) : constant("rt->newObject()");
+    value = temp();
+    line("Value " + value + " = Aot::binary(" + lhs + ", " +
+         tokenName(node->opt) + ", " + rhs + ");");
+}
+
+void Transpiler::visitFunCallExpr(FunCallExpr* node) {
+    std::string ret = temp();
+    bool isLength = node->receiver != nullptr &&
+                    node->funcName == Runtime::LengthMethod;
+    if (node->receiver != nullptr) {
+        // Receiver is evaluated for its side effects unless it's asked for
+        // its length
+        std::string receiver = emit(node->receiver);
+        if (isLength) {
+            line("Value " + ret + " = Aot::length(rt, " + receiver + ");");
+            open("if (" + ret + " == nullptr) {");
+        }
+    }
+    if (!isLength) {
+        line("Value " + ret + " = nullptr;");
+    }
+    // Lookup order is the same as interpreter does, i.e. builtin function,
+    // user defined function and closure function
+    if (rt->getBuiltinFunction(node->funcName) != nullptr) {
+        std::string args = emitArguments(node->args);
+        line(ret + " = nyx_builtin_" + node->funcName.str() +
+             "(rt, ctxChain, " + args + ");");
+    } else if (Func* callee = rt->getFunction(node->funcName);
+               callee != nullptr) {
+        if (callee->params.size() != node->args.size()) {
+            line("Aot::argumentsMismatch(" +
+                 std::to_string(callee->params.size()) + ", " +
+                 std::to_string(node->args.size()) + ", " + position(node) +
+                 ");");
+        } else {
+            std::string args = emitArguments(node->args);
+            line(ret + " = Aot::call(rt, &func" +
+                 std::to_string(funcIds.at(callee)) + ", " + args + ");");
+        }
+    } else {
+        std::string args = emitArguments(node->args);
+        line(ret + " = Aot::callClosure(rt, ctxChain, " +
+             symbol(node->funcName) + ", " + address(node->addr) + ", " + args +
+             ", " + position(node) + ");");
+    }
+    if (isLength) {
+        close();
+    }
+    value = ret;
+}
+
+void Transpiler::visitAssignExpr(AssignExpr* node) {
+    std::string rhs = emit(node->rhs);
+    if (typeid(*node->lhs) == typeid(NameExpr)) {
+        auto* lhs = dynamic_cast<NameExpr*>(node->lhs);
+        line("Aot::assign(ctxChain, " + address(lhs->addr) + ", " +
+             tokenName(node->opt) + ", " + rhs + ");");
+    } else if (typeid(*node->lhs) == typeid(IndexExpr)) {
+        auto* lhs = dynamic_cast<IndexExpr*>(node->lhs);
+        std::string index = emit(lhs->index);
+        line("Interpreter::assignElement(ctxChain, " + symbol(lhs->identName) +
+             ", " + address(lhs->addr) + ", " + tokenName(node->opt) + ", " +
+             index + ", " + rhs + ", " + position(node) + ");");
+    } else {
+        panic("can not assign to %s at line %d, col %d\n",
+              typeid(node->lhs).name(), node->line, node->column);
+    }
+    value = rhs;
+}
+
+void Transpiler::visitClosureExpr(ClosureExpr* node) {
+    std::string id = std::to_string(closures++);
+    Function* enclosing = func;
+    Function fn;
+    func = &fn;
+    line("ContextChain* ctxChain = Aot::enter(rt, f, closure, args);");
+    emitBody(node->block->stmts);
+    line("return Aot::leave(ctxChain, nullptr);");
+    func = enclosing;
+    std::string signature = "static Value closure" + id +
+                            "(Runtime* rt, Func* f, const BoundFunc* closure, "
+                            "ObjectArray& args)";
+    prototypes.push_back(signature);
+    definitions.push_back(signature + " {\n" + fn.code + "}\n");
+
+    Func* prototype = ClosureConverter::prototype(node);
+    std::string params;
+    for (const auto& param : prototype->params) {
+        params += (params.empty() ? "" : ", ") + symbol(param);
+    }
+    std::string freeVars;
+    for (const auto& freeVar : prototype->freeVars) {
+        freeVars += (freeVars.empty() ? "{" : ", {") + symbol(freeVar.name) +
+                    (freeVar.assigned ? ", true, " : ", false, ") +
+                    address(freeVar.capture) + ", " +
+                    std::to_string(freeVar.slot) + "}";
+    }
+    // Prototype is created once and shared by every evaluation
+    std::string f = temp();
+    line("static Func* " + f + " = Aot::newPrototype({" + params + "}, {" +
+         freeVars + "}, " + std::to_string(prototype->frameSize) + ", " +
+         captured(prototype->captured) + ", &closure" + id + ");");
+    value = temp();
+    line("Value " + value + " = Aot::newClosure(rt, ctxChain, " + f + ");");
+}
+
+void Transpiler::visitStatement(Statement* node) {
+    panic("abstract statement at line %d, col %d\n", node->line, node->column);
+}
+
+void Transpiler::visitBreakStmt(BreakStmt* node) {
+    line("goto " +
+         (func->loops.empty() ? func->stmtEnd : func->loops.back().breakLabel) +
+         ";");
+}
+
+void Transpiler::visitContinueStmt(ContinueStmt* node) {
+    line("goto " +
+         (func->loops.empty() ? func->stmtEnd
+                              : func->loops.back().continueLabel) +
+         ";");
+}
+
+void Transpiler::visitSimpleStmt(SimpleStmt* node) {
+    emit(node->expr);
+}
+
+void Transpiler::visitReturnStmt(ReturnStmt* node) {
+    if (FunCallExpr* call = node->tailCall; call != nullptr && func->isNamed &&
+                                            rt->getBuiltinFunction(
+                                                call->funcName) == nullptr) {
+        // Leave the call to the caller if it calls a named function, see
+        // Interpreter::callFunc
+        if (Func* callee = rt->getFunction(call->funcName);
+            callee != nullptr && callee->params.size() == call->args.size()) {
+            std::string args = emitArguments(call->args);
+            line("Aot::tailCall(&func" + std::to_string(funcIds.at(callee)) +
+                 ", ctxChain, " + args + ");");
+            line("return nullptr;");
+            return;
+        }
+    }
+    std::string ret = node->ret != nullptr ? emit(node->ret) : "nullptr";
+    if (func->isTopLevel) {
+        line("goto " + func->stmtEnd + ";");
+    } else {
+        line("return Aot::leave(ctxChain, " + ret + ");");
+    }
+}
+
+void Transpiler::visitIfStmt(IfStmt* node) {
+    std::string cond = emit(node->cond);
+    open("if (Aot::condition(" + cond + ", " + position(node) + ")) {");
+    line("Scope scope(ctxChain);");
+    emitBlock(node->block);
+    if (node->elseBlock != nullptr) {
+        func->indent--;
+        open("} else {");
+        line("Scope scope(ctxChain);");
+        emitBlock(node->elseBlock);
+    }
+    close();
+}
+
+void Transpiler::visitWhileStmt(WhileStmt* node) {
+    line("Scope scope(ctxChain);");
+    Loop loop{label(), label()};
+    open("for (;;) {");
+    std::string cond = emit(node->cond);
+    line("if (!Aot::condition(" + cond + ", " + position(node) + ")) goto " +
+         loop.breakLabel + ";");
+    func->loops.push_back(loop);
+    open("{");
+    emitBlock(node->block);
+    close();
+    func->loops.pop_back();
+    line(loop.continueLabel + ":;");
+    close();
+    line(loop.breakLabel + ":;");
+}
+
+void Transpiler::visitForStmt(ForStmt* node) {
+    line("Scope scope(ctxChain);");
+    if (node->init != nullptr) {
+        emit(node->init);
+    }
+    Loop loop{label(), label()};
+    open("for (;;) {");
+    if (node->cond != nullptr) {
+        std::string cond = emit(node->cond);
+        line("if (!Aot::condition(" + cond + ", " + position(node) +
+             ")) goto " + loop.breakLabel + ";");
+    }
+    func->loops.push_back(loop);
+    open("{");
+    emitBlock(node->block);
+    close();
+    func->loops.pop_back();
+    line(loop.continueLabel + ":;");
+    if (node->post != nullptr) {
+        emit(node->post);
+    }
+    close();
+    line(loop.breakLabel + ":;");
+}
+
+void Transpiler::visitForEachStmt(ForEachStmt* node) {
+    line("Scope scope(ctxChain);");
+    // Iterator variable is updated in place, later statements might push new
+    // contexts which hide it from lookups
+    std::string var = temp();
+    line("Variable* " + var + " = Interpreter::defineVariable(ctxChain, " +
+         address(node->addr) + ", rt->newObject());");
+    std::string list = emit(node->list);
+    std::string element = temp();
+    Loop loop{label(), label()};
+    open("for (Value " + element + " : Aot::elements(" + list + ", " +
+         position(node) + ")) {");
+    line(var + "->value = " + element + ";");
+    func->loops.push_back(loop);
+    open("{");
+    emitBlock(node->block);
+    close();
+    func->loops.pop_back();
+    line(loop.continueLabel + ":;");
+    close();
+    line(loop.breakLabel + ":;");
+}
+
+void Transpiler::visitMatchStmt(MatchStmt* node) {
+    std::string cond = node->cond != nullptr
+                           ? emit(node->cond)
+                           : constant("rt->newObject(true)");
+    int branches = 0;
+    for (const auto& [theCase, theBranch, isAny] : node->matches) {
+        // Case expression of any(_) match is never evaluated, nor are cases
+        // after it
+        if (isAny) {
+            open("{");
+            line("Scope scope(ctxChain);");
+            emitBlock(theBranch);
+            close();
+            break;
+        }
+        std::string caseValue = emit(theCase);
+        open("if (" + cond + ".equalsDeep(" + caseValue + ")) {");
+        line("Scope scope(ctxChain);");
+        emitBlock(theBranch);
+        func->indent--;
+        open("} else {");
+        branches++;
+    }
+    for (int i = 0; i < branches; i++) {
+        close();
+    }
+}
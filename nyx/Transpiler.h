@@ -0,0 +1,151 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_TRANSPILER_H
+#define NYX_TRANSPILER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Ast.h"
+#include "Runtime.hpp"
+
+//===----------------------------------------------------------------------===//
+// Translate a parsed program to C++ source of a standalone executable, which
+// links against nyx runtime library. Named functions that only compute on int
+// and bool values get statically typed code made of plain C++ arithmetic, as
+// JIT compiler does. Everything else is dynamically typed code that calls
+// into Aot helpers
+//===----------------------------------------------------------------------===//
+class Transpiler : public AstVisitor {
+public:
+    explicit Transpiler(Runtime* rt) : rt(rt) {}
+
+    std::string transpile(const std::string& fileName);
+
+    struct TypedFunc {
+        int id;
+        bool returnsBool;
+    };
+
+    // Statically typed code of named function f, or nullptr if it has none
+    const TypedFunc* typedFunc(Func* f);
+
+    int functionId(Func* f) const { return funcIds.at(f); }
+
+private:
+    struct Loop {
+        std::string breakLabel;
+        std::string continueLabel;
+    };
+
+    // C++ function being generated
+    struct Function {
+        std::string code;
+        int indent{1};
+        bool isTopLevel{};
+        // Named function whose tail calls run in place
+        bool isNamed{};
+        std::vector<Loop> loops;
+        // End of current outermost statement, which is where break, continue
+        // outside of loops and top-level return resume execution
+        std::string stmtEnd;
+    };
+
+    void visitExpression(Expression* node) override;
+    void visitBoolExpr(BoolExpr* node) override;
+    void visitCharExpr(CharExpr* node) override;
+    void visitNullExpr(NullExpr* node) override;
+    void visitIntExpr(IntExpr* node) override;
+    void visitDoubleExpr(DoubleExpr* node) override;
+    void visitStringExpr(StringExpr* node) override;
+    void visitArrayExpr(ArrayExpr* node) override;
+    void visitNameExpr(NameExpr* node) override;
+    void visitIndexExpr(IndexExpr* node) override;
+    void visitBinaryExpr(BinaryExpr* node) override;
+    void visitFunCallExpr(FunCallExpr* node) override;
+    void visitAssignExpr(AssignExpr* node) override;
+    void visitClosureExpr(ClosureExpr* node) override;
+    void visitStatement(Statement* node) override;
+    void visitBreakStmt(BreakStmt* node) override;
+    void visitContinueStmt(ContinueStmt* node) override;
+    void visitSimpleStmt(SimpleStmt* node) override;
+    void visitReturnStmt(ReturnStmt* node) override;
+    void visitIfStmt(IfStmt* node) override;
+    void visitWhileStmt(WhileStmt* node) override;
+    void visitForStmt(ForStmt* node) override;
+    void visitForEachStmt(ForEachStmt* node) override;
+    void visitMatchStmt(MatchStmt* node) override;
+
+    // Emit expression and return the temporary that holds its value
+    std::string emit(Expression* node);
+
+    void emitBlock(Block* block);
+
+    // Emit function body or top-level statements
+    void emitBody(const std::vector<Statement*>& stmts);
+
+    void emitNamedFunc(Func* f);
+
+    std::string emitArguments(const std::vector<Expression*>& args);
+
+    void line(const std::string& text);
+
+    void open(const std::string& text);
+
+    void close(const std::string& text = "}");
+
+    std::string temp();
+
+    std::string label();
+
+    // Object created once at startup, literals never change
+    std::string constant(const std::string& init);
+
+    // Symbol interned once at startup
+    std::string symbol(Symbol name);
+
+    // Address of variable resolved by Resolver as a C++ expression
+    static std::string address(Address addr);
+
+    // Initializer of Func::captured
+    static std::string captured(const std::vector<bool>& slots);
+
+    Runtime* rt;
+    Function* func{};
+    std::string value;
+    int temps{};
+    int labels{};
+    int closures{};
+    std::vector<std::string> constants;
+    std::vector<Symbol> symbols;
+    std::unordered_map<Func*, int> funcIds;
+    // Named functions and their statically typed code, if any
+    std::unordered_map<Func*, TypedFunc*> typedFuncs;
+    // Named functions whose statically typed code is being generated
+    std::vector<Func*> typing;
+    std::vector<std::string> prototypes;
+    std::vector<std::string> definitions;
+};
+
+#endif  // NYX_TRANSPILER_H
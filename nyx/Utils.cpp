@@ -29,12 +29,17 @@
 #include "Object.hpp"
 #include "Runtime.hpp"
 
-std::string repeatString(int count, const std::string& str) {
+ObjectString repeatString(int count, const ObjectString& str) {
     std::string result;
+    result.reserve(count > 0 ? count * str.length() : 0);
     for (int i = 0; i < count; i++) {
-        result += str;
+        result += str.view();
     }
-    return result;
+    return ObjectString(result);
+}
+
+ObjectString concatString(const ObjectString& lhs, const ObjectString& rhs) {
+    return ObjectString::concat(lhs, rhs);
 }
 
 [[noreturn]] void panic(char const* const format, ...) {
@@ -78,13 +83,13 @@ void checkArgsType(int idx, ObjectArray* args, ValueType expectedType) {
     if (args->size() <= idx) {
         panic("missing arguments");
     }
-    if (!args->at(idx)->isType(expectedType)) {
+    if (!args->at(idx).isType(expectedType)) {
         panic("argument at %d has unexpected type", idx);
     }
 }
-void checkObjectType(const Object* object, ValueType t) {
-    if (object == nullptr || object->getType() != t) {
-        panic("object(%p) is expected %d but got %d", object, object->getType(),
+void checkObjectType(Value object, ValueType t) {
+    if (object == nullptr || object.getType() != t) {
+        panic("object(%p) is expected %d but got %d", object, object.getType(),
               t);
     }
 }
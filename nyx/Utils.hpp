@@ -30,7 +30,9 @@
 #include "Object.hpp"
 #include "Runtime.hpp"
 
-std::string repeatString(int count, const std::string& str);
+ObjectString repeatString(int count, const ObjectString& str);
+
+ObjectString concatString(const ObjectString& lhs, const ObjectString& rhs);
 
 template <typename DesireType, typename... ArgumentType>
 inline bool anyone(DesireType k, ArgumentType... args) {
@@ -44,4 +46,4 @@ std::string type2String(ValueType type);
 void checkArgsCount(int expectedCount, ObjectArray* args);
 void checkArgsType(int idx, ObjectArray* args, ValueType expectedType);
 
-void checkObjectType(const Object* object, ValueType t);
+void checkObjectType(Value object, ValueType t);
@@ -0,0 +1,377 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "VM.h"
+#include "Interpreter.h"
+#include "Jit.h"
+#include "Utils.hpp"
+
+void VM::execute() {
+    Interpreter::newContext(ctxChain);
+
+    BytecodeCompiler compiler(rt);
+    Chunk* chunk = compiler.compile(rt->getStatements(), false);
+    run(chunk, ctxChain);
+}
+
+Chunk* VM::getChunk(Block* block) {
+    if (auto iter = chunks.find(block); iter != chunks.end()) {
+        return iter->second;
+    }
+    BytecodeCompiler compiler(rt);
+    Chunk* chunk = compiler.compile(block->stmts, true);
+    chunks.emplace(block, chunk);
+    return chunk;
+}
+
+int VM::maxDepth = 1000000;
+
+bool VM::enter(Frame& frame,
+               Func* f,
+               int argc,
+               bool isTail,
+               const BoundFunc* closure) {
+    size_t base = stack.size() - argc;
+    // Native code that calls functions recurses on native stack, leave it to
+    // frames of VM so that deep recursion still works
+    if (Value ret = Jit::invoke(rt, f, stack.data() + base, true);
+        ret != nullptr) {
+        stack.resize(base);
+        stack.push_back(ret);
+        return false;
+    }
+    if (isTail) {
+        // Callee takes over the frame of its caller, see
+        // Interpreter::callFunc
+        leave(frame);
+    } else {
+        if ((int)frames.size() >= maxDepth) {
+            panic("call depth exceeds %d at line %d, col %d\n", maxDepth,
+                  frame.chunk->positions[frame.pc].first,
+                  frame.chunk->positions[frame.pc].second);
+        }
+        frames.push_back(frame);
+    }
+
+    ContextChain* funcCtxChain = Interpreter::enterFunc(f, closure);
+    for (int i = 0; i < argc; i++) {
+        Interpreter::bindArgument(rt, funcCtxChain, i, stack[base + i]);
+    }
+    stack.resize(base);
+    frame = Frame{getChunk(f->block), 0, funcCtxChain, iterations.size(),
+                  true};
+    Gc::safepoint();
+    return true;
+}
+
+void VM::markRoots() {
+    Gc::mark(ctxChain);
+    Gc::mark(stack);
+    for (auto& iter : iterations) {
+        Gc::mark(iter.values);
+    }
+    for (const auto& frame : frames) {
+        Gc::mark(frame.ctxChain);
+    }
+    if (current != nullptr) {
+        Gc::mark(current->ctxChain);
+    }
+}
+
+void VM::leave(Frame& frame) {
+    iterations.resize(frame.iterBase);
+    if (!frame.ownsChain) {
+        return;
+    }
+    Interpreter::leaveFunc(frame.ctxChain);
+}
+
+Variable* VM::resolve(Chunk* chunk, int pc, ContextChain* ctxChain) {
+    Address addr = chunk->addresses[pc];
+    return addr.isResolved() ? Interpreter::lookupVariable(ctxChain, addr)
+                             : nullptr;
+}
+
+bool VM::call(Frame& frame, int argc, bool isTail) {
+    Chunk* chunk = frame.chunk;
+    int pc = frame.pc;
+    Symbol funcName = chunk->names[chunk->code[pc].a];
+    auto [line, column] = chunk->positions[pc];
+    CallCache* cache = &chunk->calls[pc];
+
+    // Lookup order is the same as interpreter does, i.e. builtin function,
+    // user defined function and closure function
+    Interpreter::resolveCall(rt, funcName, cache);
+    if (auto* builtinFunc = cache->builtin; builtinFunc != nullptr) {
+        ObjectArray arguments(stack.end() - argc, stack.end());
+        stack.resize(stack.size() - argc);
+        stack.push_back(builtinFunc(rt, frame.ctxChain, arguments));
+        return false;
+    }
+    if (auto* normalFunc = cache->func; normalFunc != nullptr) {
+        if ((int)normalFunc->params.size() != argc) {
+            panic(
+                "expects %d arguments but got %d at line %d, "
+                "col %d\n",
+                (int)normalFunc->params.size(), argc, line, column);
+        }
+        return enter(frame, normalFunc, argc, isTail);
+    }
+    if (auto closure =
+            Interpreter::lookupClosure(frame.ctxChain, chunk->addresses[pc]);
+        closure != nullptr) {
+        auto* closureFunc = closure.asClosure();
+        if ((int)closureFunc->func->params.size() != argc) {
+            panic(
+                "expects %d arguments but got %d at line "
+                "%d, col %d\n",
+                (int)closureFunc->func->params.size(), argc, line, column);
+        }
+        return enter(frame, closureFunc->func, argc, isTail, closureFunc);
+    }
+    panic("can not find function %s at line %d, col %d", funcName.c_str(),
+          line, column);
+}
+
+Value VM::run(Chunk* chunk, ContextChain* ctxChain) {
+    const size_t frameBase = frames.size();
+    Frame frame{chunk, 0, ctxChain, iterations.size(), false};
+    const Instruction* code = chunk->code.data();
+    int& pc = frame.pc;
+    const Frame* outer = current;
+    current = &frame;
+
+// Switch to the frame which call instructions enter or return to
+#define RELOAD()               \
+    chunk = frame.chunk;       \
+    ctxChain = frame.ctxChain; \
+    code = frame.chunk->code.data()
+#define POSITION chunk->positions[pc].first, chunk->positions[pc].second
+
+    for (;;) {
+        const Instruction& inst = code[pc];
+        switch (inst.op) {
+            case OP_CONST:
+                stack.push_back(chunk->constants[inst.a]);
+                break;
+            case OP_POP:
+                stack.pop_back();
+                break;
+            case OP_LOAD_NAME: {
+                if (auto* var = resolve(chunk, pc, ctxChain); var != nullptr) {
+                    stack.push_back(var->value);
+                    break;
+                }
+                stack.push_back(
+                    Interpreter::lookupName(rt, ctxChain, chunk->names[inst.a],
+                                            chunk->addresses[pc], POSITION));
+                break;
+            }
+            case OP_LOAD_INDEX: {
+                auto* var = resolve(chunk, pc, ctxChain);
+                if (var == nullptr) {
+                    panic(
+                        "use of undefined variable \"%s\" at line %d, col "
+                        "%d\n",
+                        chunk->names[inst.a].c_str(), POSITION);
+                }
+                stack.back() = Interpreter::lookupElement(
+                    chunk->names[inst.a], var, stack.back(), POSITION);
+                break;
+            }
+            case OP_ASSIGN_NAME: {
+                if (auto* var = resolve(chunk, pc, ctxChain); var != nullptr) {
+                    var->value = Interpreter::assignment((Token)inst.b,
+                                                         var->value,
+                                                         stack.back());
+                    Gc::writeBarrier(var);
+                    break;
+                }
+                Interpreter::assignVariable(ctxChain, chunk->addresses[pc],
+                                            (Token)inst.b, stack.back());
+                break;
+            }
+            case OP_ASSIGN_INDEX: {
+                Value index = stack.back();
+                stack.pop_back();
+                Interpreter::assignElement(
+                    ctxChain, chunk->names[inst.a], chunk->addresses[pc],
+                    (Token)inst.b, index, stack.back(), POSITION);
+                break;
+            }
+            case OP_DEFINE_NAME:
+                Interpreter::defineVariable(ctxChain, chunk->addresses[pc],
+                                            rt->newObject());
+                break;
+            case OP_UNARY:
+                stack.back() =
+                    Interpreter::evalUnaryExpr(stack.back(), (Token)inst.b);
+                break;
+            case OP_BINARY: {
+                Value rhs = stack.back();
+                stack.pop_back();
+                Value lhs = stack.back();
+                // Binary expression whose rhs is evaluated to null is treated
+                // as unary expression, keep it consistent with interpreter
+                if (!lhs.isNull() && rhs.isNull()) {
+                    stack.back() =
+                        Interpreter::evalUnaryExpr(lhs, (Token)inst.b);
+                } else {
+                    stack.back() =
+                        Interpreter::evalBinaryExpr(lhs, (Token)inst.b, rhs);
+                }
+                break;
+            }
+            case OP_ARRAY: {
+                ObjectArray elements(stack.end() - inst.a, stack.end());
+                stack.resize(stack.size() - inst.a);
+                stack.push_back(rt->newObject(elements));
+                break;
+            }
+            case OP_CLOSURE:
+                stack.push_back(Interpreter::newClosure(
+                    rt, chunk->closures[inst.a], ctxChain));
+                break;
+            case OP_CALL:
+                if (call(frame, inst.b, false)) {
+                    RELOAD();
+                    continue;
+                }
+                break;
+            case OP_TAIL_CALL:
+                if (call(frame, inst.b, true)) {
+                    RELOAD();
+                    continue;
+                }
+                goto leaveFrame;
+            case OP_LENGTH: {
+                Value recv = stack.back();
+                stack.pop_back();
+                if (recv.isArray()) {
+                    stack.push_back(rt->newObject((int)recv.asArray().size()));
+                    pc = inst.a;
+                    continue;
+                }
+                if (recv.isString()) {
+                    stack.push_back(
+                        rt->newObject((int)recv.asString().length()));
+                    pc = inst.a;
+                    continue;
+                }
+                break;
+            }
+            case OP_JUMP:
+                // Loops jump backward through it at the end of each iteration
+                Gc::safepoint();
+                pc = inst.a;
+                continue;
+            case OP_JUMP_IF_FALSE: {
+                Value cond = stack.back();
+                stack.pop_back();
+                if (!cond.isBool()) {
+                    panic(
+                        "expects bool type in while condition at line %d, "
+                        "col %d\n",
+                        POSITION);
+                }
+                if (!cond.asBool()) {
+                    pc = inst.a;
+                    continue;
+                }
+                break;
+            }
+            case OP_JUMP_IF_NE: {
+                Value theCase = stack.back();
+                stack.pop_back();
+                if (!stack.back().equalsDeep(theCase)) {
+                    pc = inst.a;
+                    continue;
+                }
+                break;
+            }
+            case OP_NEW_CONTEXT:
+                Interpreter::newContext(ctxChain);
+                break;
+            case OP_LEAVE_CONTEXT:
+                Interpreter::leaveContext(ctxChain, inst.a);
+                break;
+            case OP_ITER_PREP: {
+                Value list = stack.back();
+                stack.pop_back();
+                if (!list.isArray()) {
+                    panic(
+                        "expects array type within foreach statement at line "
+                        "%d, col %d\n",
+                        POSITION);
+                }
+                iterations.push_back(Iteration{
+                    list.asArray(), 0,
+                    Interpreter::lookupVariable(ctxChain,
+                                                chunk->addresses[pc])});
+                break;
+            }
+            case OP_ITER_NEXT: {
+                Iteration& iter = iterations.back();
+                if (iter.index >= (int)iter.values.size()) {
+                    pc = inst.a;
+                    continue;
+                }
+                iter.var->value = iter.values[iter.index++];
+                Gc::writeBarrier(iter.var);
+                break;
+            }
+            case OP_ITER_END:
+                iterations.pop_back();
+                break;
+            case OP_ITER_RESET:
+                iterations.resize(frame.iterBase);
+                break;
+            case OP_RETURN:
+                goto leaveFrame;
+            case OP_RETURN_NULL:
+                stack.push_back(nullptr);
+                goto leaveFrame;
+            default:
+                panic("unknown opcode %d", inst.op);
+        }
+        pc++;
+        continue;
+
+    leaveFrame:
+        // Return value is left on top of stack for the caller
+        leave(frame);
+        if (frames.size() == frameBase) {
+            Value retValue = stack.back();
+            stack.pop_back();
+            current = outer;
+            return retValue;
+        }
+        frame = frames.back();
+        frames.pop_back();
+        RELOAD();
+        pc++;
+    }
+
+#undef POSITION
+#undef RELOAD
+}
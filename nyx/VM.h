@@ -0,0 +1,101 @@
+// MIT License
+//
+// Copyright (c) 2023 y1yang0 <kelthuzadx@qq.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#ifndef NYX_VM_H
+#define NYX_VM_H
+
+#include <unordered_map>
+#include <vector>
+#include "Bytecode.h"
+#include "Gc.h"
+#include "Object.hpp"
+#include "Runtime.hpp"
+
+//===----------------------------------------------------------------------===//
+// Execute bytecode within a dispatch loop, every user defined function is
+// lowered to bytecode at its first call. Calls never recurse on native stack,
+// frames of callers are kept in a frame stack managed by VM itself, so the
+// depth of recursion is only bounded by maxDepth
+//===----------------------------------------------------------------------===//
+class VM : public RootSet {
+public:
+    explicit VM(Runtime* rt) : rt(rt), ctxChain(new ContextChain) {
+        Gc::addRootSet(this);
+    }
+
+    ~VM() override { Gc::removeRootSet(this); }
+
+    void execute();
+
+    void markRoots() override;
+
+    static int maxDepth;
+
+private:
+    struct Iteration {
+        ObjectArray values;
+        int index;
+        Variable* var;
+    };
+
+    struct Frame {
+        Chunk* chunk;
+        // Instruction being executed, or the call instruction that is waiting
+        // for its callee if the frame is suspended
+        int pc;
+        ContextChain* ctxChain;
+        // Iterations of foreach statements within this frame start here
+        size_t iterBase;
+        // Context chain is created for this frame, so it's recycled once the
+        // frame leaves
+        bool ownsChain;
+    };
+
+    Value run(Chunk* chunk, ContextChain* ctxChain);
+
+    bool call(Frame& frame, int argc, bool isTail);
+
+    bool enter(Frame& frame,
+               Func* f,
+               int argc,
+               bool isTail,
+               const BoundFunc* closure = nullptr);
+
+    void leave(Frame& frame);
+
+    Chunk* getChunk(Block* block);
+
+    Variable* resolve(Chunk* chunk, int pc, ContextChain* ctxChain);
+
+    Runtime* rt;
+    ContextChain* ctxChain;
+    std::vector<Value> stack;
+    std::vector<Iteration> iterations;
+    // Suspended callers of current frame, the innermost one comes last
+    std::vector<Frame> frames;
+    // Frame being executed by run()
+    const Frame* current{};
+    std::unordered_map<Block*, Chunk*> chunks;
+};
+
+#endif  // NYX_VM_H